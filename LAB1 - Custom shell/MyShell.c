@@ -1,4 +1,5 @@
 // Libraries
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -6,483 +7,746 @@
 #include <string.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "myshell.h"
+#include "spawn.h"
+#include "pathcache.h"
+#include "builtins.h"
+#include "vars.h"
+#include "input.h"
+#include "jobs.h"
+#include "joblog.h"
+#include "ast.h"
+#include "script.h"
+#include "acct.h"
+#include "trace.h"
+#include "subst.h"
+#include "wildcard.h"
+#include "history.h"
+#include "lineedit.h"
 
 /*
     To build:
-    gcc MyShell.c -o MyShell
+    make MyShell
 
     To run:
     ./MyShell
+    ./MyShell script.sh [args...]
+    ./MyShell -c 'commands' [args...]
 
     To run System Monito:
     gnome-system-monitor &
 
 */
 
-// Global Variables
-#define MAX_INPUT 1024
-#define MAX_ARGS 64
-
 // Functions
-void parse_input(char *input, char *args[]);
-void execute_command(char *args[], char background_flag);
-void sigchld_handler(int signo);
-char *reconstruct_args(char *args[], int start_idx);
-
-void handle_cd(char *args[]);
-void handle_echo(char *args[]);
-void handle_export(char *args[]);
-void expand_variables(char *str);
+int execute_command(char *args[], int fds[3], char background_flag);
+int execute_pipeline(struct command commands[], int n_stages, char background_flag);
 
 // Log file name
 const char *LOG_FILE = "myshell.log";
 
-int main()
+// Before the shell blocks waiting for input: write out the log and the trace
+static void flush_logs(void)
+{
+    joblog_flush();
+    trace_flush();
+}
+
+int main(int argc, char *argv[])
 {
-    // Variables to store input
-    char input[MAX_INPUT];
-    char *args[MAX_ARGS];
-    char cwd[MAX_INPUT]; // Buffer to store the current working directory
-
-    // Set up signal handling with sigaction for SIGCHLD
-    struct sigaction sa;
-    sa.sa_handler = sigchld_handler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-    if (sigaction(SIGCHLD, &sa, 0) == -1)
+    builtins_init();
+    vars_init();
+    vars_set_substitution(command_substitute);
+
+    // Variables to store input (the line buffer grows in input.c, the rest lives in the arena)
+    struct input in = INPUT_INIT(STDIN_FILENO);
+    char *input;
+    struct arena arena = ARENA_INIT;
+    char cwd[PATH_MAX]; // Buffer to store the current working directory
+    char prompt[PATH_MAX + 32];
+
+    /*
+    Background jobs are watched through pidfds in an epoll set: the main loop reaps
+    and logs them whenever that fd is ready while it waits for input.
+    */
+    int jobs_fd = jobs_init();
+    if (jobs_fd < 0)
     {
-        perror("sigaction");
+        perror("epoll_create1");
         exit(1);
     }
+    if (joblog_open(LOG_FILE) != 0)
+        perror(LOG_FILE);
+
+    // TRACE=<file> in the environment traces from the first command
+    trace_update();
+
+    // Script mode: run the file (or the -c string) and exit with its status
+    if (argc > 1)
+    {
+        int status;
+        jobs_forget_finished();
+        if (strcmp(argv[1], "-c") == 0 && argc > 2)
+            status = script_run_string(argv[2], argv + 3);
+        else if (strcmp(argv[1], "-c") == 0)
+        {
+            fprintf(stderr, "\033[1;31mMyShell: -c: option requires an argument\033[0m\n");
+            status = 2;
+        }
+        else
+            status = script_run_file(argv[1], argv + 2);
+
+        jobs_reap();
+        joblog_close();
+        trace_close();
+        return status;
+    }
+
+    // Lines of a command that isn't finished yet ("for i in 1 2" waiting for "do ...")
+    char *pending = NULL;
+    size_t pending_len = 0;
+    int exit_status = 0;
 
-    // Background process flag
-    char background_flag = 0;
+    // On a terminal the line is edited (with Tab completion), otherwise it is read as it comes
+    int editing = lineedit_usable(STDIN_FILENO);
+    int record = isatty(STDIN_FILENO); // Only what is typed goes to the history
 
     while (1)
     {
+        // Report the background jobs that finished
+        jobs_notify();
 
         // Get the current working directory
-        if (getcwd(cwd, sizeof(cwd)) != NULL)
+        long long span = TRACE_BEGIN();
+        if (pending)
+            snprintf(prompt, sizeof(prompt), "\033[1;34m> \033[0m");
+        else if (getcwd(cwd, sizeof(cwd)) != NULL)
         {
             // Update the prompt to include the path
-            printf("\033[1;34mMyShell: %s> \033[0m", cwd);
+            snprintf(prompt, sizeof(prompt), "\033[1;34mMyShell: %s> \033[0m", cwd);
         }
         else
         {
             // Fallback to the default prompt if getcwd() fails
-            printf("\033[1;34mMyShell> \033[0m");
+            snprintf(prompt, sizeof(prompt), "\033[1;34mMyShell> \033[0m");
         }
 
+        fputs(prompt, stdout);
         fflush(stdout);
+        TRACE_END(TRACE_PROMPT, span, NULL);
 
-        // EOF encountered (ctrl+D) or max input exceded -> BREAK
-        if (!fgets(input, MAX_INPUT, stdin))
-            break;
-
-        // Format input by replacing \n to \0
-        input[strcspn(input, "\n")] = 0;
-
-        // Skips empty lines
-        if (strlen(input) == 0)
-            continue;
+        // Everything from the previous line goes at once
+        arena_reset(&arena);
 
-        // Dealing with background processes (intially = 0)
-        background_flag = 0;
-        if (input[strlen(input) - 1] == '&')
+        // EOF encountered (ctrl+D) -> BREAK
+        // (reaps finished children while waiting, and flushes the log before blocking)
+        span = TRACE_BEGIN();
+        if (editing)
+            input = lineedit_read_line(&in, prompt, jobs_fd, jobs_reap, flush_logs);
+        else
+            input = input_read_line(&in, jobs_fd, jobs_reap, flush_logs);
+        TRACE_END(TRACE_READ, span, NULL);
+        if (!input)
         {
-            background_flag = 1;
-            input[strlen(input) - 1] = '\0';
-
-            // Remove any space before &
-            if (strlen(input) > 0 && input[strlen(input) - 1] == ' ')
-                input[strlen(input) - 1] = '\0';
-        }
-
-        // Parse input into (arg[0] = command , arg[n] = arguments)
-        parse_input(input, args);
-        if (args[0] == NULL)
-            continue;
-
-        // Handle built-in commands
-        if (strcmp(args[0], "exit") == 0)
+            if (pending)
+                fprintf(stderr, "\033[1;31mMyShell: syntax error: unexpected end of file\033[0m\n");
             break;
+        }
 
-        else if (strcmp(args[0], "cd") == 0)
+        // The command so far: the lines of an unfinished one are joined with newlines
+        size_t input_len = strlen(input);
+        char *text = arena_alloc(&arena, pending_len + input_len + 2);
+        size_t text_len = 0;
+        if (pending)
         {
-            handle_cd(args);
-            continue;
+            memcpy(text, pending, pending_len);
+            text[pending_len] = '\n';
+            text_len = pending_len + 1;
         }
-        else if (strcmp(args[0], "echo") == 0)
+        memcpy(text + text_len, input, input_len + 1);
+        text_len += input_len;
+
+        // Keep the raw text: lexing unquotes it in place
+        char *raw = strndup(text, text_len);
+        free(pending);
+        pending = NULL;
+        pending_len = 0;
+
+        // Split the line into words and operators (quotes and escapes are handled here)
+        struct token *tokens;
+        span = TRACE_BEGIN();
+        int lexed = lex(&arena, text, &tokens);
+        TRACE_END(TRACE_LEX, span, NULL);
+        if (lexed < 0)
         {
-            handle_echo(args);
+            free(raw);
             continue;
         }
-        else if (strcmp(args[0], "export") == 0)
+
+        /*
+        Parse one complete command at a time into a tree and run it: loops and
+        functions run from the tree, their text is never parsed again.
+        */
+        struct parser parser = PARSER_INIT(&arena, tokens, NULL);
+        int status = 0;
+        while (parser.t->type != TOK_END && status != BUILTIN_EXIT)
         {
-            handle_export(args);
-            continue;
+            struct node *node;
+            span = TRACE_BEGIN();
+            enum parse_result r = parse_command(&parser, &node);
+            TRACE_END(TRACE_PARSE, span, NULL);
+            if (r == PARSE_INCOMPLETE)
+            {
+                // Not finished: read the next line and parse everything again
+                pending = raw;
+                pending_len = text_len;
+                raw = NULL;
+            }
+            else if (r == PARSE_ERROR)
+                vars_set_status(2);
+            if (r != PARSE_OK)
+                break;
+
+            if (node)
+            {
+                status = script_run(node);
+                if (status != 0 && status != BUILTIN_EXIT)
+                    printf("\033[1;31mAbnormal exit: %d\033[0m\n", status);
+            }
         }
 
-        // Expand variables in arguments
-        for (int i = 0; args[i] != NULL; i++)
+        // The whole command once it is complete (its lines stay together)
+        if (raw && record)
+            history_add(raw);
+        free(raw);
+
+        if (status == BUILTIN_EXIT)
         {
-            if (strchr(args[i], '$') != NULL)
-                expand_variables(args[i]);
+            exit_status = script_exit_status();
+            break;
         }
-
-        // Execute external commands
-        execute_command(args, background_flag);
     }
 
+    free(pending);
+    input_free(&in);
+    arena_free(&arena);
+    jobs_reap();
+    joblog_close();
+    trace_close();
     printf("\033[1;36mExiting MyShell...\033[0m\n");
-    return 0;
+    return exit_status;
 }
 
 /////////////////////////////////////////////////////////////////////
 //////////////**********  FUNCTIONS   ***********////////////////////
 /////////////////////////////////////////////////////////////////////
 
-// A function to parse the input in this format (arg[0] = command , arg[n] = arguments)
-void parse_input(char *input, char *args[])
+// The value of a word: expanded if it has variables (or lexer markers) in it, the slice of the line otherwise
+static char *word_value(struct arena *a, struct token *t)
 {
-    int i = 0;
-    char *token = strtok(input, " "); // strtok() splits input into tokens based on spaces.
-    while (token)
-    {
-        args[i++] = token;
-        token = strtok(NULL, " ");
-    }
-    args[i] = NULL;
+    return (t->flags & (WORD_EXPAND | WORD_LITERAL | WORD_GLOB)) ? expand_variables(a, t->text) : t->text;
 }
 
-// Function to execute commands
-void execute_command(char *args[], char background_flag)
+// An argv being built: the array grows by doubling (in place while it is the arena's last allocation)
+struct words
 {
-    // Create a new child process (parent is the shell)
-    pid_t pid = fork();
+    char **list;
+    int n, cap; // 'cap' counts the NULL at the end
+};
 
-    /*
-    If fork() returns:
-        < 0  : Forking failed, so an error is printed using perror("fork").
-        == 0 : This is the child process.
-        > 0  : This is the parent process.
-    */
-
-    if (pid < 0)
+static void push_words(struct arena *a, struct words *w, char **list, int n)
+{
+    if (w->n + n + 1 > w->cap)
     {
-        perror("fork");
-        return;
+        int cap = 2 * (w->n + n + 1);
+        w->list = arena_grow(a, w->list, w->cap * sizeof(char *), cap * sizeof(char *));
+        w->cap = cap;
     }
+    memcpy(w->list + w->n, list, n * sizeof(char *));
+    w->n += n;
+    w->list[w->n] = NULL;
+}
 
-    // Child process
-    else if (pid == 0)
+/*
+Add the value(s) of the word 't': "$@" is every argument, a pattern (with 'glob')
+the file names it matches or itself if there is none, any other word its value.
+*/
+static void add_word(struct arena *a, struct words *w, struct token *t, int glob)
+{
+    if (is_all_args(t))
     {
-        // The child process replaces itself with the requested command using execvp().
-        if (execvp(args[0], args) == -1)
-        {
-            perror("execvp");
-            // ensure that if execution fails, the child process terminates cleanly.
-            exit(EXIT_FAILURE);
-        }
+        char **args = vars_args();
+        int n = 0;
+        while (args[n])
+            n++;
+        push_words(a, w, args, n);
+        return;
     }
 
-    // Parent process
-    else
+    char *value;
+    if (glob && (t->flags & WORD_GLOB))
     {
-        if (!background_flag)
+        // What variables hold is matched literally, only the word's own wildcards count
+        int n;
+        value = (t->flags & (WORD_EXPAND | WORD_LITERAL)) ? expand_pattern(a, t->text)
+                                                          : arena_strndup(a, t->text, t->len);
+        char **names = glob_expand(a, value, &n);
+        if (names)
         {
-            // The parent waits for the child process to complete. (if backgorund == 0)
-            int status;
-            waitpid(pid, &status, 0);
-            if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
-            {
-                printf("\033[1;31mAbnormal exit: %d\033[0m\n", WEXITSTATUS(status));
-            }
-        }
-        else
-        {
-            // The parent does not wait, allowing the shell to continue accepting new commands.
-            printf("[Background] Process ID: %d\n", pid);
+            push_words(a, w, names, n);
+            return;
         }
+        glob_restore(value);
     }
+    else
+        value = word_value(a, t);
+    push_words(a, w, &value, 1);
 }
 
-// Signal handler for SIGCHLD (sent to the parent process whenever a child process terminates.)
-void sigchld_handler(int signo)
+char **expand_words(struct arena *a, struct token *tokens)
 {
-    // Variables to store status and pid
-    int status; // Stores the exit status of the terminated child process.
-    pid_t pid;  // Stores the process ID (PID) of the child process that has terminated.
-
-    // Reap (clean up) all terminated children
-    // The while loop ensures that all zombie processes are reaped
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
-    {
-        /*
-        pid = waitpid(-1, &status, WNOHANG
+    int n = 0;
+    for (struct token *t = tokens; t->type != TOK_END; t++)
+        n++;
+
+    struct words w = {arena_alloc(a, (n + 1) * sizeof(char *)), 0, n + 1};
+    w.list[0] = NULL;
+    for (struct token *t = tokens; t->type != TOK_END; t++)
+        add_word(a, &w, t, 1);
+    return w.list;
+}
 
-        -1 : Means "wait for any child process."
-        &status : Stores the exit status of the child.
-        WNOHANG :  Ensures non-blocking behavior:
+static int syntax_error(struct token *t)
+{
+    fprintf(stderr, "\033[1;31mMyShell: syntax error near '%s'\033[0m\n", token_name(t));
+    return -1;
+}
 
-        If no child has terminated, waitpid() returns 0 instead of blocking the shell.
-        If a child has terminated, waitpid() returns its PID.
-        */
+// Record the redirection 't' (whose file name is the next token) in 'r'
+static int add_redirection(struct arena *a, struct token *t, struct redirs *r)
+{
+    struct token *file = t + 1;
+    if (file->type != TOK_WORD)
+    {
+        fprintf(stderr, "\033[1;31mMyShell: syntax error: missing file after redirection\033[0m\n");
+        return -1;
+    }
 
-        // Open a log file (LOG_FILE) in append mode ("a") to record that a child process has exited.
-        FILE *log = fopen(LOG_FILE, "a");
-        if (log) // Checks if the file was opened successfully.
-        {
-            fprintf(log, "Child process was terminated\n");
-            fclose(log);
-        }
+    char *name = word_value(a, file);
+    if (t->type == TOK_LESS && t->fd == 0)
+        r->in = name;
+    else if (t->type != TOK_LESS && t->fd == 1)
+    {
+        r->out = name;
+        r->append = (t->type == TOK_DGREAT);
+    }
+    else if (t->type != TOK_LESS && t->fd == 2)
+    {
+        r->err = name;
+        r->err_append = (t->type == TOK_DGREAT);
     }
+    else
+    {
+        fprintf(stderr, "\033[1;31mMyShell: redirecting fd %d is not supported\033[0m\n", t->fd);
+        return -1;
+    }
+    return 0;
 }
 
-// cd command to change the current working directory.
-void handle_cd(char *args[])
+/*
+Turn the tokens of a line into the commands of "cmd1 | cmd2 | ... [&]".
+The words are expanded and the argv arrays allocated in the arena, one slot per
+token to start with, grown when "$@" or a pattern stands for more words.
+Returns the number of commands (0 for an empty line), -1 after printing a syntax error,
+EXPANSION_FAILED when a word couldn't be expanded (the command must not run).
+*/
+int parse_pipeline(struct arena *a, struct token *tokens, struct command **commands, char *background_flag)
 {
-    char *target_dir;
+    int n_stages = 1;
+    struct token *t;
+
+    *background_flag = 0;
+    vars_substitution_status(); // Only the $(...)s of this command count for its status
+    vars_expansion_failed();
+    if (tokens[0].type == TOK_END)
+        return 0;
+    for (t = tokens; t->type != TOK_END; t++)
+    {
+        if (t->type == TOK_PIPE)
+            n_stages++;
+    }
 
-    // Case 1: cd (no arguments) or cd ~ -> Change to home directory
-    if (!args[1] || strcmp(args[1], "~") == 0)
+    struct command *cmds = arena_alloc(a, n_stages * sizeof(struct command));
+    t = tokens;
+    for (int s = 0; s < n_stages; s++)
     {
-        target_dir = getenv("HOME"); // Get the home directory from environment variables
-        if (!target_dir)
+        // Room for one word per token: only "$@" and patterns make the array grow
+        struct token *u;
+        int n_tokens = 0;
+        for (u = t; u->type != TOK_PIPE && u->type != TOK_END; u++)
+            n_tokens++;
+
+        struct words w = {arena_alloc(a, (n_tokens + 1) * sizeof(char *)), 0, n_tokens + 1};
+        w.list[0] = NULL;
+        memset(&cmds[s].redirs, 0, sizeof(struct redirs));
+
+        struct token *first = t;
+        int assigning = 1; // Still in the NAME=value words in front of the command: not patterns
+        for (; t->type != TOK_PIPE && t->type != TOK_END; t++)
         {
-            fprintf(stderr, "\033[1;31mcd: HOME environment variable not set\033[0m\n");
-            return;
+            if (t->type == TOK_WORD)
+            {
+                assigning = assigning && is_assignment(t->text);
+                add_word(a, &w, t, !assigning);
+            }
+            else if (t->type == TOK_LESS || t->type == TOK_GREAT || t->type == TOK_DGREAT)
+            {
+                if (add_redirection(a, t, &cmds[s].redirs) != 0)
+                    return -1;
+                t++; // The file name
+            }
+            else if (t->type == TOK_AMP && t[1].type == TOK_END)
+                *background_flag = 1;
+            else
+                return syntax_error(t); // ; && || ( ) and a '&' that doesn't end the line
         }
-    }
+        cmds[s].args = w.list;
 
-    // Case 2: cd ..-> Change to parent directory
-    else if (strcmp(args[1], "..") == 0)
-    {
-        target_dir = args[1];
+        // "ls |", "| wc", "ls | | wc"
+        if (t == first && n_stages > 1)
+            return syntax_error(t->type == TOK_END ? t - 1 : t);
+        if (t->type == TOK_PIPE)
+            t++;
     }
 
-    // Case 3: cd absolute_path or cd relative_path -> Change to the specified path
-    // Handle paths with spaces by concatenating multiple arguments
+    *commands = cmds;
+    return vars_expansion_failed() ? EXPANSION_FAILED : n_stages;
+}
 
-    else if ((args[1][0] == '"') || (args[1][0] == '\''))
-    {
-        char path[1024] = "";
-        int i = 1;
-        char quote_char = args[1][0]; // Store quote type (' or ")
+// Open the redirection files, fds[0..2] = stdin/stdout/stderr replacements (-1 = none)
+int open_redirections(struct redirs *r, int fds[3])
+{
+    const char *names[3] = {r->in, r->out, r->err};
+    int flags[3] = {O_RDONLY,
+                    O_WRONLY | O_CREAT | (r->append ? O_APPEND : O_TRUNC),
+                    O_WRONLY | O_CREAT | (r->err_append ? O_APPEND : O_TRUNC)};
 
-        while (args[i])
-        {
-            strcat(path, args[i]);
-            if (args[i + 1]) // Add space between words if more arguments exist
-                strcat(path, " ");
-            i++;
-        }
+    for (int i = 0; i < 3; i++)
+    {
+        fds[i] = -1;
+        if (!names[i])
+            continue;
 
-        // Remove leading and trailing quotes
-        int len = strlen(path);
-        if (len > 1 && path[len - 1] == quote_char)
+        // O_CLOEXEC: children only get the copy dup2()ed onto 0/1/2
+        fds[i] = open(names[i], flags[i] | O_CLOEXEC, 0644);
+        if (fds[i] < 0)
         {
-            path[len - 1] = '\0'; // Remove the closing quote
+            fprintf(stderr, "\033[1;31mMyShell: %s: %s\033[0m\n", names[i], strerror(errno));
+            close_redirections(fds);
+            return -1;
         }
-        memmove(path, path + 1, strlen(path)); // Remove the first quote
-
-        strcpy(target_dir, path);
-    }
-
-    else
-    {
-        // If no quotes, use only the first argument
-        strcpy(target_dir, args[1]);
     }
+    return 0;
+}
 
-    // Attempt to change the directory
-    if (chdir(target_dir) != 0)
+void close_redirections(int fds[3])
+{
+    for (int i = 0; i < 3; i++)
     {
-        fprintf(stderr, "\033[1;31mcd: %s: No such file or directory\033[0m\n", target_dir);
+        if (fds[i] >= 0)
+            close(fds[i]);
+        fds[i] = -1;
     }
 }
 
-// echo command to print arguments to the console.
-void handle_echo(char *args[])
+// Pipe capacity asked for with "PIPESIZE=<bytes>" (0 = kernel default)
+static int pipe_size(void)
 {
+    const char *size = var_lookup("PIPESIZE", 8, NULL);
+    return size ? atoi(size) : 0;
+}
 
-    // If no arguments, just print a newline
-    if (args[1] == NULL)
+// "cmd args | cmd args" for the job table (cut at JOB_COMMAND_MAX)
+void job_text(char *buf, struct command commands[], int n_stages)
+{
+    size_t len = 0;
+    buf[0] = '\0';
+    for (int i = 0; i < n_stages; i++)
     {
-        printf("\n");
-        return;
+        for (int a = 0; commands[i].args[a] && len < JOB_COMMAND_MAX; a++)
+            len += snprintf(buf + len, JOB_COMMAND_MAX - len, "%s%s", (i || a) ? " " : "", commands[i].args[a]);
+        if (i < n_stages - 1 && len < JOB_COMMAND_MAX)
+            len += snprintf(buf + len, JOB_COMMAND_MAX - len, " |");
     }
+}
 
-    int i = 1;
-    while (args[i] != NULL)
-    {
-        char expanded[MAX_INPUT];
-        strcpy(expanded, args[i]);
+// A background command or pipeline becomes a job with one entry per command that has a name
+static int start_job(struct command commands[], int n_stages)
+{
+    char text[JOB_COMMAND_MAX];
+    int n_procs = 0;
+    for (int i = 0; i < n_stages; i++)
+        n_procs += (commands[i].args[0] != NULL);
+
+    job_text(text, commands, n_stages);
+    int id = job_start(text, n_procs);
+    if (id < 0)
+        fprintf(stderr, "\033[1;31mMyShell: out of memory for the job table\033[0m\n");
+    return id;
+}
 
-        // Expand variables in the argument
-        if (strchr(expanded, '$') != NULL)
-        {
-            expand_variables(expanded);
-        }
+/*
+Run commands parse_pipeline() expanded: a pipeline, NAME=value assignments,
+a builtin or a program. Returns the exit status (BUILTIN_EXIT for "exit").
+*/
+int run_pipeline(struct command commands[], int n_stages, char background_flag)
+{
+    if (n_stages > 1)
+        return execute_pipeline(commands, n_stages, background_flag);
 
-        // If this is a quoted string, remove the quotes
-        int len = strlen(expanded);
-        if (len >= 2 && expanded[0] == '"' && expanded[len - 1] == '"')
-        {
-            // Remove quotes and print the content
-            expanded[len - 1] = '\0';
-            printf("%s", expanded + 1);
-        }
-        else
-        {
-            printf("%s", expanded);
-        }
+    // (arg[0] = command , arg[n] = arguments)
+    char **args = commands[0].args;
+    if (args[0] == NULL)
+        return 0;
 
-        // Add space between arguments
-        if (args[i + 1] != NULL)
+    // NAME=value ...: set shell variables (not exported)
+    if (is_assignment(args[0]))
+    {
+        int i = 0;
+        while (args[i] && is_assignment(args[i]))
+            i++;
+        if (!args[i])
         {
-            printf(" ");
+            // x=$(cmd): the status is the command's
+            int status = handle_assignment(args);
+            int substituted = vars_substitution_status();
+            return (substituted >= 0) ? substituted : status;
         }
-        i++;
     }
 
-    printf("\n");
-}
+    // Handle built-in commands (one hash lookup instead of a strcmp chain)
+    const struct builtin *builtin = builtin_find(args[0]);
 
-// export command to set environment variables.
-void handle_export(char *args[])
-{
-    if (!args[1])
-    {
-        fprintf(stderr, "\033[1;31mexport: missing argument\033[0m\n");
-        return;
-    }
+    // Open "< file", "> file", ">> file" and "2> file"
+    int fds[3];
+    if (open_redirections(&commands[0].redirs, fds) != 0)
+        return 1;
 
-    // Locate the '=' sign in args[1] to separate the variable name
-    char *equals_pos = strchr(args[1], '=');
-    if (!equals_pos)
+    // A backgrounded utility runs as the real program so the shell doesn't block
+    int status;
+    if (builtin && !(builtin->utility && background_flag))
     {
-        fprintf(stderr, "\033[1;31mexport: invalid syntax. Usage: export VAR=value\033[0m\n");
-        return;
+        long long span = TRACE_BEGIN();
+        status = builtin_run(builtin, args, fds);
+        TRACE_END(TRACE_BUILTIN, span, args[0]);
     }
+    else
+        status = execute_command(args, fds, background_flag); // Execute external commands
+    close_redirections(fds);
+    return status;
+}
 
-    // Extract the variable name (before the equals sign)
-    char var_name[MAX_INPUT];
-    int name_len = equals_pos - args[1]; // Length of the variable name
-    strncpy(var_name, args[1], name_len);
-    var_name[name_len] = '\0'; // Null-terminate the name
+/*
+Run every stage of "cmd1 | cmd2 | ... | cmdN" at the same time, each one's stdout
+connected to the next one's stdin. The exit status is the one of the last stage
+that failed (pipefail), 0 if they all succeeded.
+*/
+int execute_pipeline(struct command commands[], int n_stages, char background_flag)
+{
+    int pipes[n_stages - 1][2];
+    pid_t pids[n_stages];
+    int size = pipe_size();
+    int job = background_flag ? start_job(commands, n_stages) : 0;
+    if (job < 0)
+        return 1;
 
-    // Get the value part (after the equals sign)
-    char *value_start = equals_pos + 1; // Start of the value
-    char value[MAX_INPUT] = "";         // Buffer for the full value
+    /*
+    O_CLOEXEC: every pipe end closes itself on exec, so a stage only keeps the
+    two ends it dup2()s onto stdin/stdout (dup2 clears the flag on the copy).
+    Without it each child would hold all the pipes open and never see EOF.
+    */
+    for (int i = 0; i < n_stages - 1; i++)
+    {
+        if (pipe2(pipes[i], O_CLOEXEC) == -1)
+        {
+            perror("pipe2");
+            for (int j = 0; j < i; j++)
+            {
+                close(pipes[j][0]);
+                close(pipes[j][1]);
+            }
+            return 1;
+        }
+        // Bigger pipes mean fewer context switches between fast stages
+        if (size > 0 && fcntl(pipes[i][1], F_SETPIPE_SZ, size) == -1)
+            perror("fcntl(F_SETPIPE_SZ)");
+    }
 
-    // If the value starts with a quote, extract the entire quoted string
-    if (*value_start == '"')
+    for (int i = 0; i < n_stages; i++)
     {
-        // Skip the opening quote
-        value_start++;
+        pids[i] = -1;
+        if (commands[i].args[0] == NULL)
+            continue;
 
-        // Check if the closing quote is in the same argument
-        char *closing_quote = strchr(value_start, '"');
-        if (closing_quote != NULL)
+        // Read from the previous stage, write to the next one (unless redirected)
+        int fds[3];
+        pid_t pid = -1;
+        if (open_redirections(&commands[i].redirs, fds) != 0)
         {
-            // Copy everything between quotes
-            strncpy(value, value_start, closing_quote - value_start);
-            value[closing_quote - value_start] = '\0';
+            pids[i] = -1;
+            if (job)
+                job_add_process(job, -1, commands[i].args[0]);
+            continue;
         }
-        else
-        {
-            // The string continues to other arguments
-            strcpy(value, value_start);
-
-            // Process remaining arguments to find closing quote
-            int i = 2;
-            while (args[i] != NULL)
-            {
-                strcat(value, " "); // Add space between arguments
+        if (fds[0] < 0 && i > 0)
+            fds[0] = dup(pipes[i - 1][0]);
+        if (fds[1] < 0 && i < n_stages - 1)
+            fds[1] = dup(pipes[i][1]);
 
-                char *arg_content = args[i];
-                closing_quote = strchr(arg_content, '"');
+        // A background pipeline is one process group, led by its first stage
+        pid_t pgid = job ? job_pgid(job) : -1;
 
-                if (closing_quote != NULL)
+        long long span = TRACE_BEGIN();
+        const struct builtin *builtin = builtin_find(commands[i].args[0]);
+        if (builtin)
+        {
+            // Builtins work the same inside a pipeline, they run in a forked copy of the shell
+            // (which must not write what the shell still has buffered a second time)
+            fflush(stdout);
+            joblog_flush();
+            pid = fork();
+            if (pid > 0 && pgid >= 0)
+                setpgid(pid, pgid ? pgid : pid); // Both sides do it, whichever runs first
+            if (pid == 0)
+            {
+                trace_forked();
+                if (pgid >= 0)
+                    setpgid(0, pgid);
+                for (int fd = 0; fd < 3; fd++)
                 {
-                    // Found closing quote, copy up to it
-                    strncat(value, arg_content, closing_quote - arg_content);
-                    break;
+                    if (fds[fd] >= 0)
+                        dup2(fds[fd], fd);
                 }
-                else
+
+                // No exec here to close the O_CLOEXEC ends, so drop them by hand
+                // (a reader holding a write end would never see EOF)
+                close_redirections(fds);
+                for (int j = 0; j < n_stages - 1; j++)
                 {
-                    // This argument is part of the value
-                    strcat(value, arg_content);
+                    close(pipes[j][0]);
+                    close(pipes[j][1]);
                 }
-                i++;
+                int status = builtin->fn(commands[i].args);
+                fflush(stdout);
+                joblog_flush();
+                _exit(status == BUILTIN_EXIT ? EXIT_SUCCESS : status);
             }
         }
+        else
+            pid = spawn_command_in_group(commands[i].args, fds[0], fds[1], fds[2], pgid);
+        TRACE_END(TRACE_SPAWN, span, commands[i].args[0]);
+        close_redirections(fds);
+
+        if (pid < 0)
+            fprintf(stderr, "\033[1;31m%s: %s\033[0m\n", commands[i].args[0], strerror(errno));
+        pids[i] = pid;
+        if (job)
+            job_add_process(job, pid, commands[i].args[0]);
     }
-    else
+
+    // The shell keeps no pipe end open, so each stage sees EOF when its writer exits
+    for (int i = 0; i < n_stages - 1; i++)
     {
-        // Not quoted, just copy the value
-        strcpy(value, value_start);
+        close(pipes[i][0]);
+        close(pipes[i][1]);
     }
 
-    // Set the environment variable
-    setenv(var_name, value, 1);
-}
-
-// Improve variable expansion to handle adjacent variables
-void expand_variables(char *str)
-{
-    char result[MAX_INPUT] = "";
-    char temp[MAX_INPUT] = "";
-    char *read_ptr = str;
-    
-    while (*read_ptr) {
-        if (*read_ptr == '$') {
-            // Variable found, skip the $
-            read_ptr++;
-            
-            // Extract the variable name
-            char var_name[MAX_INPUT] = "";
-            int i = 0;
-            
-            while (isalnum(*read_ptr) || *read_ptr == '_') {
-                var_name[i++] = *read_ptr++;
-            }
-            var_name[i] = '\0';
-            
-            // Get the value and append it to the result
-            char *value = getenv(var_name);
-            if (value) {
-                strcat(result, value);
+    if (background_flag)
+    {
+        printf("[Background] Job %d, pipeline process IDs:", job);
+        for (int i = 0; i < n_stages; i++)
+        {
+            if (pids[i] > 0)
+                printf(" %d", pids[i]);
+        }
+        printf("\n");
+        return 0;
+    }
+    else
+    {
+        int pipeline_status = 0;
+        long long span = TRACE_BEGIN();
+        for (int i = 0; i < n_stages; i++)
+        {
+            // A stage that couldn't be started counts as "command not found"
+            int status, code = 127;
+            struct rusage usage;
+            if (pids[i] > 0)
+            {
+                if (wait4(pids[i], &status, 0, &usage) == -1)
+                    continue;
+                acct_child(&usage);
+                code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
             }
-        } else {
-            // Append the current character
-            temp[0] = *read_ptr;
-            temp[1] = '\0';
-            strcat(result, temp);
-            read_ptr++;
+
+            // pipefail: the rightmost stage that failed decides
+            if (code != 0)
+                pipeline_status = code;
         }
+        TRACE_END(TRACE_WAIT, span, commands[0].args[0]);
+        return pipeline_status;
     }
-    
-    // Copy the result back to the original string
-    strcpy(str, result);
 }
 
-// Function to recreate the original string from args
-char *reconstruct_args(char *args[], int start_idx)
+// Function to execute commands
+int execute_command(char *args[], int fds[3], char background_flag)
 {
-    static char buffer[MAX_INPUT];
-    buffer[0] = '\0';
+    struct command command = {args};
+    int job = background_flag ? start_job(&command, 1) : 0;
+    if (job < 0)
+        return 1;
 
-    int i = start_idx;
-    while (args[i] != NULL)
+    /*
+    Start the command as a new child process (parent is the shell).
+    spawn_command() uses posix_spawn instead of fork() + execvp(): the child shares
+    the shell's memory until it execs, so the launch cost doesn't grow with the shell.
+    A background job gets a process group of its own (so fg/bg can signal it).
+    */
+    long long span = TRACE_BEGIN();
+    pid_t pid = spawn_command_in_group(args, fds[0], fds[1], fds[2], job ? 0 : -1);
+    TRACE_END(TRACE_SPAWN, span, args[0]);
+    if (job)
+        job_add_process(job, pid, args[0]);
+
+    if (pid < 0)
     {
-        strcat(buffer, args[i]);
-        if (args[i + 1] != NULL)
-            strcat(buffer, " ");
-        i++;
+        // The command couldn't be started (not found, not executable, ...)
+        fprintf(stderr, "\033[1;31m%s: %s\033[0m\n", args[0], strerror(errno));
+        return 127;
     }
-
-    return buffer;
-}
\ No newline at end of file
+    else if (!background_flag)
+    {
+        // The parent waits for the child process to complete. (if backgorund == 0)
+        int status;
+        struct rusage usage;
+        span = TRACE_BEGIN();
+        pid_t waited = wait4(pid, &status, 0, &usage);
+        TRACE_END(TRACE_WAIT, span, args[0]);
+        if (waited < 0)
+            return 1;
+        acct_child(&usage);
+        return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    }
+    else
+    {
+        // The parent does not wait, allowing the shell to continue accepting new commands.
+        printf("[Background] Job %d, process ID: %d\n", job, pid);
+        return 0;
+    }
+}
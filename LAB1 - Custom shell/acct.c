@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <string.h>
+#include "acct.h"
+#include "joblog.h"
+#include "vars.h"
+
+static struct acct *current = NULL; // Innermost command being measured
+
+int acct_enabled(void)
+{
+    const char *value = var_lookup("ACCOUNTING", 10, NULL);
+    return value && strcmp(value, "0") != 0;
+}
+
+static void add_time(struct timeval *sum, struct timeval t)
+{
+    sum->tv_sec += t.tv_sec;
+    sum->tv_usec += t.tv_usec;
+    if (sum->tv_usec >= 1000000)
+    {
+        sum->tv_sec++;
+        sum->tv_usec -= 1000000;
+    }
+}
+
+static void sub_time(struct timeval *t, struct timeval before)
+{
+    t->tv_sec -= before.tv_sec;
+    t->tv_usec -= before.tv_usec;
+    if (t->tv_usec < 0)
+    {
+        t->tv_sec--;
+        t->tv_usec += 1000000;
+    }
+}
+
+void acct_add_usage(struct rusage *sum, const struct rusage *usage)
+{
+    add_time(&sum->ru_utime, usage->ru_utime);
+    add_time(&sum->ru_stime, usage->ru_stime);
+    if (usage->ru_maxrss > sum->ru_maxrss)
+        sum->ru_maxrss = usage->ru_maxrss;
+    sum->ru_minflt += usage->ru_minflt;
+    sum->ru_majflt += usage->ru_majflt;
+    sum->ru_nvcsw += usage->ru_nvcsw;
+    sum->ru_nivcsw += usage->ru_nivcsw;
+}
+
+void acct_begin(struct acct *a)
+{
+    memset(a, 0, sizeof(struct acct));
+    a->parent = current;
+    current = a;
+    getrusage(RUSAGE_SELF, &a->self);
+    clock_gettime(CLOCK_MONOTONIC, &a->start);
+}
+
+void acct_child(const struct rusage *usage)
+{
+    if (!current)
+        return;
+    acct_add_usage(&current->children, usage);
+    current->n_procs++;
+}
+
+void acct_end(struct acct *a, int status, const char *command, struct job_record *record)
+{
+    struct timespec now;
+    struct rusage self;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    getrusage(RUSAGE_SELF, &self);
+
+    current = a->parent;
+    if (current)
+    {
+        acct_add_usage(&current->children, &a->children);
+        current->n_procs += a->n_procs;
+    }
+
+    long ns = (now.tv_sec - a->start.tv_sec) * 1000000000L + (now.tv_nsec - a->start.tv_nsec);
+    memset(record, 0, sizeof(struct job_record));
+    record->kind = RECORD_FG;
+    record->pid = -1;
+    record->status = status;
+    record->real.tv_sec = ns / 1000000000L;
+    record->real.tv_nsec = ns % 1000000000L;
+    record->n_procs = a->n_procs;
+    snprintf(record->command, sizeof(record->command), "%s", command);
+
+    // The shell's share: what it used meanwhile (its maxrss is a peak, not a delta)
+    sub_time(&self.ru_utime, a->self.ru_utime);
+    sub_time(&self.ru_stime, a->self.ru_stime);
+    self.ru_minflt -= a->self.ru_minflt;
+    self.ru_majflt -= a->self.ru_majflt;
+    self.ru_nvcsw -= a->self.ru_nvcsw;
+    self.ru_nivcsw -= a->self.ru_nivcsw;
+    if (a->n_procs > 0)
+        self.ru_maxrss = 0;
+
+    record->usage = a->children;
+    acct_add_usage(&record->usage, &self);
+}
+
+static void print_time(const char *name, double seconds)
+{
+    int minutes = (int)(seconds / 60);
+    fprintf(stderr, "%s\t%dm%.3fs\n", name, minutes, seconds - minutes * 60);
+}
+
+void acct_print(const struct job_record *r)
+{
+    const struct rusage *u = &r->usage;
+    print_time("real", r->real.tv_sec + r->real.tv_nsec / 1e9);
+    print_time("user", u->ru_utime.tv_sec + u->ru_utime.tv_usec / 1e6);
+    print_time("sys", u->ru_stime.tv_sec + u->ru_stime.tv_usec / 1e6);
+    fprintf(stderr, "maxrss %ldKB, faults %ld minor / %ld major, context switches %ld voluntary / %ld involuntary, %d process%s\n",
+            u->ru_maxrss, u->ru_minflt, u->ru_majflt, u->ru_nvcsw, u->ru_nivcsw, r->n_procs, (r->n_procs == 1) ? "" : "es");
+}
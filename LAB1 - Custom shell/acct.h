@@ -0,0 +1,44 @@
+#include <time.h>
+#include <sys/resource.h>
+
+/*
+Resource accounting: wall time plus the rusage of everything a command ran.
+    - the children a command waited for are added from their wait4() (user / sys,
+      faults, context switches summed, maxrss the largest), nothing is asked twice
+    - builtins, functions and loops run in the shell, so the shell's own getrusage()
+      delta over the command is added too
+    - accumulators nest ("time" around a loop with ACCOUNTING on): a finished one
+      adds its children to the one around it
+    - "time command" prints the result; with ACCOUNTING=1 every foreground command
+      and background job is also logged as an "acct" record (joblog.c). When it is
+      off the only cost is one variable lookup per command
+*/
+
+struct job_record;
+
+struct acct
+{
+    struct timespec start;
+    struct rusage self;     // The shell's own usage when it started
+    struct rusage children; // Children reaped since
+    int n_procs;
+    struct acct *parent;    // The accumulator that was current before this one
+};
+
+// Is ACCOUNTING set (and not "0")?
+int acct_enabled(void);
+
+// Start measuring: children reaped from now on are added to 'a'
+void acct_begin(struct acct *a);
+
+// A child was reaped (no-op when nothing is being measured)
+void acct_child(const struct rusage *usage);
+
+// Stop measuring 'a' and fill 'record' (usage, wall time, process count; kind RECORD_FG)
+void acct_end(struct acct *a, int status, const char *command, struct job_record *record);
+
+// sum += usage (maxrss: the largest of the two)
+void acct_add_usage(struct rusage *sum, const struct rusage *usage);
+
+// "real / user / sys" and the rest, on stderr
+void acct_print(const struct job_record *record);
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_CHUNK_MIN 4096
+#define ARENA_ALIGN 16
+
+static size_t align_up(size_t n)
+{
+    return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+// Move to a chunk with room for 'size' bytes: the next kept one if it fits, a new one otherwise
+static void next_chunk(struct arena *a, size_t size)
+{
+    struct arena_chunk *c = a->current;
+
+    // (No current chunk: back at the start of an arena that already has chunks)
+    struct arena_chunk *next = c ? c->next : a->head;
+    if (next && next->size >= size)
+    {
+        a->current = next;
+        a->used = 0;
+        return;
+    }
+
+    size_t chunk_size = c ? c->size * 2 : ARENA_CHUNK_MIN;
+    while (chunk_size < size)
+        chunk_size *= 2;
+
+    struct arena_chunk *fresh = malloc(sizeof(struct arena_chunk) + chunk_size);
+    if (!fresh)
+    {
+        perror("MyShell: arena");
+        exit(1);
+    }
+    fresh->size = chunk_size;
+
+    // Insert after the current chunk, the smaller kept ones after it are still reused later
+    if (c)
+    {
+        fresh->next = c->next;
+        c->next = fresh;
+    }
+    else
+    {
+        fresh->next = a->head;
+        a->head = fresh;
+    }
+    a->current = fresh;
+    a->used = 0;
+}
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+    size_t start = align_up(a->used);
+    if (!a->current || start + size > a->current->size)
+    {
+        next_chunk(a, size);
+        start = 0;
+    }
+    a->used = start + size;
+    return a->current->data + start;
+}
+
+void *arena_grow(struct arena *a, void *ptr, size_t old_size, size_t new_size)
+{
+    // The last allocation of the current chunk can just take more of it
+    if (ptr && (char *)ptr + old_size == a->current->data + a->used
+        && (char *)ptr - a->current->data + new_size <= a->current->size)
+    {
+        a->used = (char *)ptr - a->current->data + new_size;
+        return ptr;
+    }
+
+    void *moved = arena_alloc(a, new_size);
+    if (ptr)
+        memcpy(moved, ptr, old_size < new_size ? old_size : new_size);
+    return moved;
+}
+
+char *arena_strndup(struct arena *a, const char *s, size_t len)
+{
+    char *copy = arena_alloc(a, len + 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+struct arena_mark arena_save(struct arena *a)
+{
+    struct arena_mark mark = {a->current, a->used};
+    return mark;
+}
+
+void arena_restore(struct arena *a, struct arena_mark mark)
+{
+    // The chunks after mark.chunk stay in the list and are reused
+    a->current = mark.chunk;
+    a->used = mark.used;
+}
+
+void arena_reset(struct arena *a)
+{
+    a->current = a->head;
+    a->used = 0;
+}
+
+void arena_free(struct arena *a)
+{
+    struct arena_chunk *c = a->head;
+    while (c)
+    {
+        struct arena_chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    a->head = a->current = NULL;
+    a->used = 0;
+}
@@ -0,0 +1,53 @@
+#include <stddef.h>
+
+/*
+Bump allocator for everything that lives as long as one command line
+(tokens, argv arrays, expanded words).
+    - an allocation is a pointer bump inside the current chunk
+    - when a chunk is full the next one is twice as big, so a line of any length
+      costs a handful of malloc() calls the first time and none after that
+    - arena_reset() rewinds to the first chunk in O(1) and keeps every chunk for reuse
+*/
+
+struct arena_chunk
+{
+    struct arena_chunk *next;
+    size_t size; // Bytes in data[]
+    char data[];
+};
+
+struct arena
+{
+    struct arena_chunk *head;    // First chunk (NULL until the first allocation)
+    struct arena_chunk *current; // Chunk allocations come from
+    size_t used;                 // Bytes used in 'current'
+};
+
+#define ARENA_INIT {NULL, NULL, 0}
+
+// 'size' bytes aligned for any type, exits the shell if memory runs out
+void *arena_alloc(struct arena *a, size_t size);
+
+// Resize the last allocation (in place when it still fits), like realloc()
+void *arena_grow(struct arena *a, void *ptr, size_t old_size, size_t new_size);
+
+// NUL-terminated copy of the first 'len' bytes of 's'
+char *arena_strndup(struct arena *a, const char *s, size_t len);
+
+// Position in an arena: everything allocated after it can be dropped at once
+struct arena_mark
+{
+    struct arena_chunk *chunk;
+    size_t used;
+};
+
+struct arena_mark arena_save(struct arena *a);
+
+// Drop what was allocated since 'mark' (nested uses: a command inside a loop inside a function)
+void arena_restore(struct arena *a, struct arena_mark mark);
+
+// Forget every allocation, keep the chunks
+void arena_reset(struct arena *a);
+
+// Give the chunks back to malloc
+void arena_free(struct arena *a);
@@ -0,0 +1,382 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "arith.h"
+#include "vars.h"
+
+#define ARITH_DEPTH_MAX 256 // Nested operators / parentheses (and variables holding expressions)
+#define ARITH_NAME_MAX 256
+
+struct arith
+{
+    const char *expr; // The whole expression, for error messages
+    const char *p;    // Next character
+    int skip;         // > 0: in an operand && || ?: don't take
+    int failed;
+    int depth;
+};
+
+struct binop
+{
+    const char *op;
+    int prec; // Higher binds tighter
+};
+
+// Longest first, so "<<" is never read as "<"
+static const struct binop binops[] = {
+    {"||", 1}, {"&&", 2}, {"==", 6}, {"!=", 6}, {"<=", 7}, {">=", 7}, {"<<", 8}, {">>", 8}, {"**", 11},
+    {"|", 3},  {"^", 4},  {"&", 5},  {"<", 7},  {">", 7},  {"+", 9},  {"-", 9},  {"*", 10}, {"/", 10}, {"%", 10},
+};
+
+static const char *const assign_ops[] = {"<<=", ">>=", "+=", "-=", "*=", "/=", "%=", "&=", "^=", "|=", "=", NULL};
+
+static int eval_depth = 0; // Variables being evaluated as expressions (arith_eval() calls itself)
+
+static long long comma(struct arith *a);
+static long long assignment(struct arith *a);
+static long long unary(struct arith *a);
+
+static void fail(struct arith *a, const char *message)
+{
+    // What is left of the expression from where it went wrong (nothing to show at the end)
+    if (!a->failed && *a->p)
+        fprintf(stderr, "\033[1;31mMyShell: %s: %s (error token is \"%s\")\033[0m\n", a->expr, message, a->p);
+    else if (!a->failed)
+        fprintf(stderr, "\033[1;31mMyShell: %s: %s\033[0m\n", a->expr, message);
+    a->failed = 1;
+}
+
+static void skip_blanks(struct arith *a)
+{
+    while (*a->p == ' ' || *a->p == '\t' || *a->p == '\n')
+        a->p++;
+}
+
+// Is 'op' next? (then it is consumed)
+static int accept(struct arith *a, const char *op)
+{
+    skip_blanks(a);
+    size_t n = strlen(op);
+    if (strncmp(a->p, op, n) != 0)
+        return 0;
+    a->p += n;
+    return 1;
+}
+
+// A variable's value: a number, or an expression of its own ("a=b+1")
+static long long variable(struct arith *a, const char *name, size_t len)
+{
+    const char *value = var_lookup(name, len, NULL);
+    if (!value || !*value)
+        return 0;
+
+    char *end;
+    long long n = strtoll(value, &end, 0);
+    while (*end == ' ' || *end == '\t')
+        end++;
+    if (end != value && *end == '\0')
+        return n;
+
+    if (eval_depth >= ARITH_DEPTH_MAX)
+    {
+        fail(a, "expression recursion level exceeded");
+        return 0;
+    }
+    eval_depth++;
+    int failed = arith_eval(value, &n);
+    eval_depth--;
+    if (failed)
+        a->failed = 1;
+    return n;
+}
+
+static void set(struct arith *a, const char *name, size_t len, long long value)
+{
+    char var[ARITH_NAME_MAX], number[24];
+    if (a->skip || a->failed)
+        return;
+    if (len >= sizeof(var))
+    {
+        fail(a, "variable name too long");
+        return;
+    }
+    memcpy(var, name, len);
+    var[len] = '\0';
+    snprintf(number, sizeof(number), "%lld", value);
+    var_set(var, number, 0);
+}
+
+static long long power(struct arith *a, long long base, long long exponent)
+{
+    unsigned long long result = 1, b = base;
+    if (exponent < 0)
+    {
+        fail(a, "exponent less than 0");
+        return 0;
+    }
+    for (; exponent > 0; exponent >>= 1, b *= b)
+    {
+        if (exponent & 1)
+            result *= b;
+    }
+    return (long long)result;
+}
+
+// x op y, wrapping around on overflow ("<<" for "<<=" and so on)
+static long long apply(struct arith *a, const char *op, long long x, long long y)
+{
+    unsigned long long ux = x, uy = y;
+
+    switch (op[0])
+    {
+    case '+':
+        return (long long)(ux + uy);
+    case '-':
+        return (long long)(ux - uy);
+    case '*':
+        return (op[1] == '*') ? power(a, x, y) : (long long)(ux * uy);
+    case '/':
+    case '%':
+        if (y == 0)
+        {
+            if (!a->skip)
+                fail(a, "division by 0");
+            return 0;
+        }
+        if (y == -1) // LLONG_MIN / -1 would trap
+            return (op[0] == '/') ? (long long)(0ULL - ux) : 0;
+        return (op[0] == '/') ? x / y : x % y;
+    case '<':
+        if (op[1] == '<')
+            return (long long)(ux << (y & 63));
+        return (op[1] == '=') ? x <= y : x < y;
+    case '>':
+        if (op[1] == '>')
+            return x >> (y & 63);
+        return (op[1] == '=') ? x >= y : x > y;
+    case '=':
+        return x == y;
+    case '!':
+        return x != y;
+    case '&':
+        return x & y;
+    case '^':
+        return x ^ y;
+    case '|':
+        return x | y;
+    }
+    return 0;
+}
+
+// ( expression ), a number, or a variable (with x++ / x--)
+static long long primary(struct arith *a)
+{
+    skip_blanks(a);
+
+    if (*a->p == '(')
+    {
+        a->p++;
+        long long value = comma(a);
+        if (!accept(a, ")"))
+            fail(a, "missing ')'");
+        return value;
+    }
+
+    if (isdigit((unsigned char)*a->p))
+    {
+        char *end;
+        long long value = (long long)strtoull(a->p, &end, 0);
+        a->p = end;
+        if (isalnum((unsigned char)*end) || *end == '_')
+            fail(a, "value too great for base");
+        return value;
+    }
+
+    size_t len = var_name_length(a->p);
+    if (len == 0)
+    {
+        fail(a, *a->p ? "operand expected" : "operand expected at the end");
+        return 0;
+    }
+    const char *name = a->p;
+    a->p += len;
+    long long value = a->skip ? 0 : variable(a, name, len);
+    if (accept(a, "++"))
+        set(a, name, len, apply(a, "+", value, 1));
+    else if (accept(a, "--"))
+        set(a, name, len, apply(a, "-", value, 1));
+    return value;
+}
+
+// ++x --x + - ! ~
+static long long prefixed(struct arith *a)
+{
+    skip_blanks(a);
+    const char *start = a->p;
+
+    if (accept(a, "++") || accept(a, "--"))
+    {
+        int increment = (a->p[-1] == '+');
+        skip_blanks(a);
+        size_t len = var_name_length(a->p);
+        if (len > 0)
+        {
+            const char *name = a->p;
+            a->p += len;
+            long long value = apply(a, increment ? "+" : "-", a->skip ? 0 : variable(a, name, len), 1);
+            set(a, name, len, value);
+            return value;
+        }
+        a->p = start; // "--5": two minus signs
+    }
+
+    if (accept(a, "+"))
+        return unary(a);
+    if (accept(a, "-"))
+        return (long long)(0ULL - (unsigned long long)unary(a));
+    if (accept(a, "!"))
+        return !unary(a);
+    if (accept(a, "~"))
+        return ~unary(a);
+    return primary(a);
+}
+
+// Every operand goes through here, so this bounds the recursion ("((((...", "- - - -...")
+static long long unary(struct arith *a)
+{
+    if (a->depth >= ARITH_DEPTH_MAX)
+    {
+        fail(a, "expression nested too deeply");
+        return 0;
+    }
+    a->depth++;
+    long long value = prefixed(a);
+    a->depth--;
+    return value;
+}
+
+// The binary operator next, NULL if there is none (or it is a compound assignment like "+=")
+static const struct binop *next_binop(struct arith *a)
+{
+    skip_blanks(a);
+    for (size_t i = 0; i < sizeof(binops) / sizeof(binops[0]); i++)
+    {
+        size_t n = strlen(binops[i].op);
+        if (strncmp(a->p, binops[i].op, n) != 0)
+            continue;
+        if (a->p[n] == '=' && binops[i].prec != 6 && binops[i].prec != 7)
+            return NULL;
+        return &binops[i];
+    }
+    return NULL;
+}
+
+// Operators of precedence 'min_prec' and up (precedence climbing)
+static long long binary(struct arith *a, int min_prec)
+{
+    long long left = unary(a);
+
+    for (;;)
+    {
+        const struct binop *b = next_binop(a);
+        if (!b || b->prec < min_prec || a->failed)
+            return left;
+        a->p += strlen(b->op);
+
+        // && / ||: the right side is only parsed when the left one decides
+        if (b->prec <= 2)
+        {
+            int decided = (b->prec == 1) ? (left != 0) : (left == 0);
+            a->skip += decided;
+            long long right = binary(a, b->prec + 1);
+            a->skip -= decided;
+            left = (b->prec == 1) ? (left || right) : (left && right);
+            continue;
+        }
+
+        // ** groups to the right, the others to the left
+        long long right = binary(a, (b->prec == 11) ? b->prec : b->prec + 1);
+        left = apply(a, b->op, left, right);
+    }
+}
+
+static long long conditional(struct arith *a)
+{
+    long long condition = binary(a, 1);
+    if (!accept(a, "?"))
+        return condition;
+
+    a->skip += !condition;
+    long long yes = assignment(a);
+    a->skip -= !condition;
+    if (!accept(a, ":"))
+    {
+        fail(a, "':' expected for conditional expression");
+        return 0;
+    }
+    a->skip += !!condition;
+    long long no = conditional(a);
+    a->skip -= !!condition;
+    return condition ? yes : no;
+}
+
+// NAME = value, NAME += value, ... (right to left: a = b = 1)
+static long long assignment(struct arith *a)
+{
+    skip_blanks(a);
+    const char *name = a->p;
+    size_t len = var_name_length(name);
+
+    if (len > 0)
+    {
+        a->p += len;
+        skip_blanks(a);
+        for (int i = 0; assign_ops[i]; i++)
+        {
+            size_t n = strlen(assign_ops[i]);
+            if (strncmp(a->p, assign_ops[i], n) != 0 || (n == 1 && a->p[1] == '='))
+                continue;
+            a->p += n;
+
+            long long value = assignment(a);
+            if (n > 1)
+            {
+                char op[3] = {0};
+                memcpy(op, assign_ops[i], n - 1);
+                value = apply(a, op, a->skip ? 0 : variable(a, name, len), value);
+            }
+            set(a, name, len, value);
+            return value;
+        }
+        a->p = name;
+    }
+    return conditional(a);
+}
+
+static long long comma(struct arith *a)
+{
+    long long value = assignment(a);
+    while (!a->failed && accept(a, ","))
+        value = assignment(a);
+    return value;
+}
+
+int arith_eval(const char *expr, long long *result)
+{
+    struct arith a = {expr, expr, 0, 0, 0};
+
+    *result = 0;
+    skip_blanks(&a);
+    if (*a.p == '\0')
+        return 0; // $(( )) is 0
+
+    long long value = comma(&a);
+    skip_blanks(&a);
+    if (*a.p)
+        fail(&a, "syntax error in expression");
+    if (a.failed)
+        return -1;
+    *result = value;
+    return 0;
+}
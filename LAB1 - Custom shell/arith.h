@@ -0,0 +1,15 @@
+/*
+Arithmetic expansion: $((expression)) is evaluated by the shell, in 64-bit signed
+integers, instead of starting expr. The operators are C's, by precedence:
+    ( )   x++ x--   ++x --x + - ! ~   **   * / %   + -   << >>   < <= > >=
+    == !=   &   ^   |   &&   ||   ?:   = += -= *= /= %= <<= >>= &= ^= |=   ,
+Names are shell variables (unset or empty = 0, a value that isn't a number is
+evaluated as an expression), and the assignments set them. Numbers are decimal,
+0x hex or 0 octal. Overflow wraps around, and && || ?: skip the operand they don't
+take (no assignments, no division-by-zero errors in it).
+The expression is parsed as it is evaluated (recursive descent, no tree):
+a counter like i=$((i + 1)) costs a few hash lookups and one snprintf().
+*/
+
+// Evaluate 'expr' into *result, returns 0, or -1 after printing what is wrong
+int arith_eval(const char *expr, long long *result);
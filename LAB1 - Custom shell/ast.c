@@ -0,0 +1,411 @@
+#include <stdio.h>
+#include <string.h>
+#include "ast.h"
+#include "vars.h"
+
+// Words that close a construct: they can't start a command
+static const char *const closers[] = {"then", "elif", "else", "fi", "do", "done", "}", NULL};
+
+static const char *const then_end[] = {"then", NULL};
+static const char *const if_ends[] = {"elif", "else", "fi", NULL};
+static const char *const fi_end[] = {"fi", NULL};
+static const char *const do_end[] = {"do", NULL};
+static const char *const done_end[] = {"done", NULL};
+static const char *const brace_end[] = {"}", NULL};
+
+static enum parse_result parse_and_or(struct parser *p, struct node **node);
+
+static int is_word(const struct token *t, const char *word)
+{
+    return t->type == TOK_WORD && strcmp(t->text, word) == 0;
+}
+
+static int is_one_of(const struct token *t, const char *const *words)
+{
+    for (; *words; words++)
+    {
+        if (is_word(t, *words))
+            return 1;
+    }
+    return 0;
+}
+
+static int is_redirection(const struct token *t)
+{
+    return t->type == TOK_LESS || t->type == TOK_GREAT || t->type == TOK_DGREAT;
+}
+
+static enum parse_result syntax_error(struct parser *p, const struct token *t)
+{
+    if (t->type == TOK_END && p->source)
+        fprintf(stderr, "\033[1;31m%s: line %d: syntax error: unexpected end of file\033[0m\n", p->source, p->line);
+    else if (p->source)
+        fprintf(stderr, "\033[1;31m%s: line %d: syntax error near '%s'\033[0m\n", p->source, p->line, token_name(t));
+    else
+        fprintf(stderr, "\033[1;31mMyShell: syntax error near '%s'\033[0m\n", token_name(t));
+    return PARSE_ERROR;
+}
+
+static struct node *new_node(struct parser *p, enum node_type type)
+{
+    struct node *n = arena_alloc(p->a, sizeof(struct node));
+    memset(n, 0, sizeof(struct node));
+    n->type = type;
+    n->line = p->line;
+    return n;
+}
+
+static void skip_newlines(struct parser *p)
+{
+    while (p->t->type == TOK_NEWLINE)
+    {
+        p->t++;
+        p->line++;
+    }
+}
+
+static enum parse_result expect(struct parser *p, const char *word)
+{
+    if (is_word(p->t, word))
+    {
+        p->t++;
+        return PARSE_OK;
+    }
+    return (p->t->type == TOK_END) ? PARSE_INCOMPLETE : syntax_error(p, p->t);
+}
+
+// The tokens from 'from' up to the parser's position, newlines left out, followed by a TOK_END
+static struct token *copy_tokens(struct parser *p, struct token *from, int n)
+{
+    struct token *copy = arena_alloc(p->a, (n + 1) * sizeof(struct token));
+    int i = 0;
+    for (struct token *t = from; t < p->t; t++)
+    {
+        if (t->type != TOK_NEWLINE)
+            copy[i++] = *t;
+    }
+    memset(&copy[i], 0, sizeof(struct token));
+    copy[i].type = TOK_END;
+    copy[i].fd = -1;
+    return copy;
+}
+
+// cmd [args] [redirections] | cmd ... [&]
+static enum parse_result parse_simple_pipeline(struct parser *p, struct node **node)
+{
+    struct node *n = new_node(p, NODE_PIPELINE);
+    struct token *start = p->t;
+    int n_tokens = 0, stage_tokens = 0;
+
+    for (;;)
+    {
+        struct token *t = p->t;
+        if (t->type == TOK_WORD)
+            p->t++;
+        else if (is_redirection(t))
+        {
+            if (t[1].type != TOK_WORD)
+                return syntax_error(p, t + 1);
+            p->t += 2;
+            n_tokens++;
+            stage_tokens++;
+        }
+        else if (t->type == TOK_PIPE)
+        {
+            // "| wc", "ls | | wc"
+            if (stage_tokens == 0)
+                return syntax_error(p, t);
+            p->t++;
+            skip_newlines(p);
+            if (p->t->type == TOK_END)
+                return PARSE_INCOMPLETE;
+            stage_tokens = -1;
+        }
+        else
+            break;
+        n_tokens++;
+        stage_tokens++;
+    }
+    if (stage_tokens == 0)
+        return syntax_error(p, p->t);
+
+    // A trailing '&' stays part of it: parse_pipeline() sees a background command
+    if (p->t->type == TOK_AMP)
+    {
+        p->t++;
+        n_tokens++;
+    }
+    n->tokens = copy_tokens(p, start, n_tokens);
+    *node = n;
+    return PARSE_OK;
+}
+
+/*
+Commands separated by ';', '&' or newlines, up to one of the 'ends' words (not consumed).
+An empty list is a syntax error ("then fi").
+*/
+static enum parse_result parse_list(struct parser *p, const char *const *ends, struct node **list)
+{
+    struct node *head = NULL, **tail = &head;
+    enum parse_result r;
+
+    for (;;)
+    {
+        skip_newlines(p);
+        if (p->t->type == TOK_END)
+            return PARSE_INCOMPLETE;
+        if (is_one_of(p->t, ends))
+            break;
+        if (is_one_of(p->t, closers))
+            return syntax_error(p, p->t);
+
+        struct node *n;
+        if ((r = parse_and_or(p, &n)) != PARSE_OK)
+            return r;
+        *tail = n;
+        tail = &n->next;
+
+        // A separator, the end of the line, or "done" right after a compound command ("done done")
+        if (p->t->type == TOK_SEMI)
+            p->t++;
+        else if (p->t[-1].type != TOK_AMP && p->t->type != TOK_NEWLINE && p->t->type != TOK_END
+                 && !is_one_of(p->t, ends))
+            return syntax_error(p, p->t);
+    }
+
+    if (!head)
+        return syntax_error(p, p->t);
+    *list = head;
+    return PARSE_OK;
+}
+
+// if / elif: the condition, the "then" part, then an elif (another if), an else part or just fi
+static enum parse_result parse_if(struct parser *p, struct node **node)
+{
+    struct node *n = new_node(p, NODE_IF);
+    enum parse_result r;
+    p->t++;
+
+    if ((r = parse_list(p, then_end, &n->a)) != PARSE_OK || (r = expect(p, "then")) != PARSE_OK)
+        return r;
+    if ((r = parse_list(p, if_ends, &n->b)) != PARSE_OK)
+        return r;
+
+    if (is_word(p->t, "elif"))
+        r = parse_if(p, &n->c); // Takes the "fi" too
+    else
+    {
+        if (is_word(p->t, "else"))
+        {
+            p->t++;
+            if ((r = parse_list(p, fi_end, &n->c)) != PARSE_OK)
+                return r;
+        }
+        r = expect(p, "fi");
+    }
+    *node = n;
+    return r;
+}
+
+static enum parse_result parse_loop(struct parser *p, struct node **node)
+{
+    struct node *n = new_node(p, is_word(p->t, "while") ? NODE_WHILE : NODE_UNTIL);
+    enum parse_result r;
+    p->t++;
+
+    if ((r = parse_list(p, do_end, &n->a)) != PARSE_OK || (r = expect(p, "do")) != PARSE_OK)
+        return r;
+    if ((r = parse_list(p, done_end, &n->b)) != PARSE_OK)
+        return r;
+    *node = n;
+    return expect(p, "done");
+}
+
+// for NAME [in word...] (; or newline) do list done
+static enum parse_result parse_for(struct parser *p, struct node **node)
+{
+    struct node *n = new_node(p, NODE_FOR);
+    enum parse_result r;
+    p->t++;
+
+    if (p->t->type != TOK_WORD || var_name_length(p->t->text) != p->t->len)
+        return (p->t->type == TOK_END) ? PARSE_INCOMPLETE : syntax_error(p, p->t);
+    n->name = p->t->text;
+    p->t++;
+    skip_newlines(p);
+
+    if (is_word(p->t, "in"))
+    {
+        struct token *start = ++p->t;
+        while (p->t->type == TOK_WORD)
+            p->t++;
+        if (p->t->type != TOK_SEMI && p->t->type != TOK_NEWLINE && p->t->type != TOK_END)
+            return syntax_error(p, p->t);
+        n->tokens = copy_tokens(p, start, p->t - start);
+    }
+    if (p->t->type == TOK_SEMI)
+        p->t++;
+    skip_newlines(p);
+
+    if ((r = expect(p, "do")) != PARSE_OK || (r = parse_list(p, done_end, &n->a)) != PARSE_OK)
+        return r;
+    *node = n;
+    return expect(p, "done");
+}
+
+static enum parse_result parse_group(struct parser *p, struct node **node)
+{
+    struct node *n = new_node(p, NODE_GROUP);
+    enum parse_result r;
+    p->t++;
+
+    if ((r = parse_list(p, brace_end, &n->a)) != PARSE_OK)
+        return r;
+    *node = n;
+    return expect(p, "}");
+}
+
+static int starts_compound(const struct token *t)
+{
+    return is_word(t, "if") || is_word(t, "while") || is_word(t, "until") || is_word(t, "for") || is_word(t, "{");
+}
+
+static enum parse_result parse_unit(struct parser *p, struct node **node);
+
+// NAME() body / function NAME [()] body: the body is a compound command, usually { ... }
+static enum parse_result parse_function(struct parser *p, struct node **node)
+{
+    struct node *n = new_node(p, NODE_FUNCTION);
+
+    if (is_word(p->t, "function"))
+    {
+        p->t++;
+        if (p->t->type != TOK_WORD)
+            return (p->t->type == TOK_END) ? PARSE_INCOMPLETE : syntax_error(p, p->t);
+    }
+    n->name = p->t->text;
+    p->t++;
+    if (p->t->type == TOK_LPAREN && p->t[1].type == TOK_RPAREN)
+        p->t += 2;
+
+    skip_newlines(p);
+    if (p->t->type == TOK_END)
+        return PARSE_INCOMPLETE;
+    if (!starts_compound(p->t))
+        return syntax_error(p, p->t);
+
+    *node = n;
+    return parse_unit(p, &n->a);
+}
+
+// time command: the command that follows, whatever it is, is measured as a whole
+static enum parse_result parse_time(struct parser *p, struct node **node)
+{
+    struct node *n = new_node(p, NODE_TIME);
+    p->t++;
+    *node = n;
+
+    // "time" alone measures nothing (but still prints)
+    struct token *t = p->t;
+    if (t->type == TOK_SEMI || t->type == TOK_NEWLINE || t->type == TOK_END || t->type == TOK_AMP
+        || t->type == TOK_AND || t->type == TOK_OR || is_one_of(t, closers))
+        return PARSE_OK;
+    return parse_unit(p, &n->a);
+}
+
+// One command: a compound command, a function definition or a pipeline
+static enum parse_result parse_unit(struct parser *p, struct node **node)
+{
+    struct token *t = p->t;
+    enum parse_result r;
+
+    if (t->type == TOK_END)
+        return PARSE_INCOMPLETE;
+    if (is_word(t, "time"))
+        return parse_time(p, node);
+    if (is_word(t, "if"))
+        r = parse_if(p, node);
+    else if (is_word(t, "while") || is_word(t, "until"))
+        r = parse_loop(p, node);
+    else if (is_word(t, "for"))
+        r = parse_for(p, node);
+    else if (is_word(t, "{"))
+        r = parse_group(p, node);
+    else if (is_word(t, "function") || (t->type == TOK_WORD && t[1].type == TOK_LPAREN && t[2].type == TOK_RPAREN))
+        return parse_function(p, node);
+    else if (t->type == TOK_WORD || is_redirection(t))
+    {
+        if (is_one_of(t, closers))
+            return syntax_error(p, t);
+        return parse_simple_pipeline(p, node);
+    }
+    else
+        return syntax_error(p, t);
+
+    // Compound commands can't be piped, redirected or put in the background (yet)
+    if (r == PARSE_OK && p->t->type != TOK_SEMI && p->t->type != TOK_NEWLINE && p->t->type != TOK_END
+        && p->t->type != TOK_AND && p->t->type != TOK_OR && !is_one_of(p->t, closers))
+        return syntax_error(p, p->t);
+    return r;
+}
+
+static enum parse_result parse_and_or(struct parser *p, struct node **node)
+{
+    struct node *left;
+    enum parse_result r;
+
+    if ((r = parse_unit(p, &left)) != PARSE_OK)
+        return r;
+
+    while (p->t->type == TOK_AND || p->t->type == TOK_OR)
+    {
+        struct node *n = new_node(p, (p->t->type == TOK_AND) ? NODE_AND : NODE_OR);
+        p->t++;
+        skip_newlines(p); // "a &&\n b"
+        n->a = left;
+        if ((r = parse_unit(p, &n->b)) != PARSE_OK)
+            return r;
+        left = n;
+    }
+    *node = left;
+    return PARSE_OK;
+}
+
+enum parse_result parse_command(struct parser *p, struct node **node)
+{
+    struct node *head = NULL, **tail = &head;
+    enum parse_result r;
+
+    *node = NULL;
+    skip_newlines(p);
+
+    while (p->t->type != TOK_END)
+    {
+        if (is_one_of(p->t, closers))
+            return syntax_error(p, p->t);
+
+        struct node *n;
+        if ((r = parse_and_or(p, &n)) != PARSE_OK)
+            return r;
+        *tail = n;
+        tail = &n->next;
+
+        int separated = (p->t[-1].type == TOK_AMP);
+        if (p->t->type == TOK_SEMI)
+        {
+            p->t++;
+            separated = 1;
+        }
+        if (p->t->type == TOK_NEWLINE)
+        {
+            p->t++;
+            p->line++;
+            break;
+        }
+        if (!separated && p->t->type != TOK_END)
+            return syntax_error(p, p->t);
+    }
+
+    *node = head;
+    return PARSE_OK;
+}
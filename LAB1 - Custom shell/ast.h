@@ -0,0 +1,67 @@
+#include "lexer.h"
+
+/*
+Parser: the tokens of a line or a script become a tree of commands, built once.
+A loop body or a function is then run as many times as needed from that tree,
+the text is never lexed or parsed again. Words stay tokens (slices of the text)
+and are expanded each time the command they belong to runs.
+
+    list      commands separated by ';', '&' or newlines (chained through 'next')
+    and_or    pipeline { && pipeline | || pipeline }
+    command   pipeline of simple commands [&]
+              if list; then list; [elif list; then list;] [else list;] fi
+              while list; do list; done / until list; do list; done
+              for NAME [in words]; do list; done
+              { list; }
+              NAME() command / function NAME command
+              time command
+*/
+
+enum node_type
+{
+    NODE_PIPELINE, // tokens: "cmd | cmd [&]" up to a TOK_END (run by parse_pipeline() + run_pipeline())
+    NODE_AND,      // a && b
+    NODE_OR,       // a || b
+    NODE_IF,       // if a; then b; else c; fi (an elif is an if in c)
+    NODE_WHILE,    // while a; do b; done
+    NODE_UNTIL,    // until a; do b; done
+    NODE_FOR,      // for name in tokens (NULL = "$@"); do a; done
+    NODE_GROUP,    // { a; }
+    NODE_FUNCTION, // name() a
+    NODE_TIME,     // time a (a = NULL: "time" alone)
+};
+
+struct node
+{
+    enum node_type type;
+    int line;             // Line it starts on
+    struct node *next;    // Next command of the same list
+    struct token *tokens; // Words (up to a TOK_END)
+    char *name;
+    struct node *a;
+    struct node *b;
+    struct node *c;
+};
+
+enum parse_result
+{
+    PARSE_OK,
+    PARSE_INCOMPLETE, // The input ended inside a command (more lines are needed)
+    PARSE_ERROR,      // Syntax error (already reported)
+};
+
+struct parser
+{
+    struct arena *a;    // Where the nodes go
+    struct token *t;    // Next token
+    int line;
+    const char *source; // Script name for error messages, NULL for the terminal
+};
+
+#define PARSER_INIT(a, tokens, source) {(a), (tokens), 1, (source)}
+
+/*
+Parse the next complete command: everything up to the end of its line (or of the
+input). *node is NULL for an empty line. Call until p->t is TOK_END.
+*/
+enum parse_result parse_command(struct parser *p, struct node **node);
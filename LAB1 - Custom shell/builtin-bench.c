@@ -0,0 +1,83 @@
+/*
+    Compares running a utility inside the shell (builtins.c) with launching the
+    external program (spawn.c), like a script calling "[" or printf in a loop.
+
+    To build:
+    make builtin-bench
+
+    To run:
+    ./builtin-bench [iterations]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "spawn.h"
+#include "builtins.h"
+#include "vars.h"
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Commands per second, looking the builtin up every time like the shell does
+static double run_builtin(char *argv[], int fds[3], int iterations)
+{
+    double start = now_us();
+    for (int i = 0; i < iterations; i++)
+        builtin_run(builtin_find(argv[0]), argv, fds);
+    return iterations / ((now_us() - start) / 1e6);
+}
+
+static double run_external(char *argv[], int fds[3], int iterations)
+{
+    double start = now_us();
+    for (int i = 0; i < iterations; i++)
+    {
+        int status;
+        pid_t pid = spawn_command(argv, fds[0], fds[1], fds[2]);
+        if (pid < 0)
+        {
+            perror(argv[0]);
+            exit(1);
+        }
+        waitpid(pid, &status, 0);
+    }
+    return iterations / ((now_us() - start) / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = (argc > 1) ? atoi(argv[1]) : 2000;
+    char *commands[][5] = {
+        {"true", NULL},
+        {"test", "3", "-lt", "5", NULL},
+        {"[", "-n", "abc", "]", NULL},
+        {"printf", "%s=%d\\n", "x", "1", NULL},
+        {"pwd", NULL},
+    };
+
+    builtins_init();
+    vars_init();
+
+    // Output goes nowhere so only the cost of running the command is measured
+    int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    int fds[3] = {-1, devnull, devnull};
+
+    printf("%8s %14s %14s %8s\n", "command", "builtin(/s)", "external(/s)", "speedup");
+    for (int i = 0; i < (int)(sizeof(commands) / sizeof(commands[0])); i++)
+    {
+        double inside = run_builtin(commands[i], fds, iterations);
+        double outside = run_external(commands[i], fds, iterations / 10 + 1);
+        printf("%8s %14.0f %14.0f %7.0fx\n", commands[i][0], inside, outside, inside / outside);
+    }
+
+    close(devnull);
+    return 0;
+}
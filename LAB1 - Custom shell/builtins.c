@@ -0,0 +1,654 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <ctype.h>
+#include <math.h>
+#include <sys/stat.h>
+#include "myshell.h"
+#include "builtins.h"
+#include "pathcache.h"
+#include "wildcard.h"
+#include "memo.h"
+#include "history.h"
+#include "vars.h"
+#include "jobs.h"
+#include "parallel.h"
+
+static int builtin_exit(char *args[]);
+static int builtin_true(char *args[]);
+static int builtin_false(char *args[]);
+static int builtin_test(char *args[]);
+static int builtin_printf(char *args[]);
+static int builtin_pwd(char *args[]);
+static int builtin_cat(char *args[]);
+static int builtin_wc(char *args[]);
+static int builtin_sleep(char *args[]);
+
+static const struct builtin builtins[] = {
+    {"exit", builtin_exit, 0},
+    {"cd", handle_cd, 0},
+    {"echo", handle_echo, 0},
+    {"export", handle_export, 0},
+    {"unset", handle_unset, 0},
+    {"jobs", handle_jobs, 0},
+    {"wait", handle_wait, 0},
+    {"fg", handle_fg, 0},
+    {"bg", handle_bg, 0},
+    {"hash", handle_hash, 0},
+    {"globcache", handle_globcache, 0},
+    {"parallel", handle_parallel, 0},
+    {"memo", handle_memo, 0},
+    {"history", handle_history, 0},
+
+    // In-process versions of small utilities scripts run all the time
+    {"true", builtin_true, 1},
+    {"false", builtin_false, 1},
+    {"test", builtin_test, 1},
+    {"[", builtin_test, 1},
+    {"printf", builtin_printf, 1},
+    {"pwd", builtin_pwd, 1},
+    {"cat", builtin_cat, 1},
+    {"wc", builtin_wc, 1},
+    {"sleep", builtin_sleep, 1},
+};
+
+#define N_BUILTINS (int)(sizeof(builtins) / sizeof(builtins[0]))
+#define DISPATCH_SIZE 64 // Power of 2, comfortably above N_BUILTINS
+#define SLEEP_MAX 1e15 // Seconds (over 30 million years): a longer sleep is cut to this, which fits a time_t
+
+static const struct builtin *dispatch[DISPATCH_SIZE];
+static unsigned int dispatch_seed = 0;
+
+// FNV-1a starting from 'seed'
+static unsigned int builtin_hash(const char *name, unsigned int seed)
+{
+    unsigned int h = 2166136261u ^ seed;
+    while (*name)
+        h = (h ^ (unsigned char)*name++) * 16777619u;
+    return (h ^ (h >> 15)) & (DISPATCH_SIZE - 1);
+}
+
+void builtins_init(void)
+{
+    // Try seeds until every name lands in its own slot
+    for (unsigned int seed = 1;; seed++)
+    {
+        int i;
+        memset(dispatch, 0, sizeof(dispatch));
+        for (i = 0; i < N_BUILTINS; i++)
+        {
+            unsigned int slot = builtin_hash(builtins[i].name, seed);
+            if (dispatch[slot])
+                break;
+            dispatch[slot] = &builtins[i];
+        }
+        if (i == N_BUILTINS)
+        {
+            dispatch_seed = seed;
+            return;
+        }
+    }
+}
+
+const struct builtin *builtin_find(const char *name)
+{
+    const struct builtin *b = dispatch[builtin_hash(name, dispatch_seed)];
+    return (b && strcmp(b->name, name) == 0) ? b : NULL;
+}
+
+const struct builtin *builtin_at(int i)
+{
+    return (i >= 0 && i < N_BUILTINS) ? &builtins[i] : NULL;
+}
+
+int builtin_run(const struct builtin *b, char *args[], int fds[3])
+{
+    int saved[3];
+
+    // Point stdin/stdout/stderr at the redirections for the duration of the builtin
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < 3; i++)
+    {
+        saved[i] = -1;
+        if (fds[i] >= 0)
+        {
+            saved[i] = fcntl(i, F_DUPFD_CLOEXEC, 10);
+            dup2(fds[i], i);
+        }
+    }
+
+    int status = b->fn(args);
+
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < 3; i++)
+    {
+        if (saved[i] >= 0)
+        {
+            dup2(saved[i], i);
+            close(saved[i]);
+        }
+    }
+    if (fds[0] >= 0)
+        clearerr(stdin);
+    return status;
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////**********  UTILITIES   ***********////////////////////
+/////////////////////////////////////////////////////////////////////
+
+static int builtin_exit(char *args[])
+{
+    return BUILTIN_EXIT;
+}
+
+static int builtin_true(char *args[])
+{
+    return 0;
+}
+
+static int builtin_false(char *args[])
+{
+    return 1;
+}
+
+// test / [ with one to four arguments (unary file/string tests, string and integer comparisons, !)
+static int test_unary(const char *op, const char *arg)
+{
+    struct stat st;
+
+    if (strcmp(op, "-n") == 0)
+        return arg[0] != '\0';
+    if (strcmp(op, "-z") == 0)
+        return arg[0] == '\0';
+    if (strcmp(op, "-r") == 0)
+        return access(arg, R_OK) == 0;
+    if (strcmp(op, "-w") == 0)
+        return access(arg, W_OK) == 0;
+    if (strcmp(op, "-x") == 0)
+        return access(arg, X_OK) == 0;
+
+    if (stat(arg, &st) != 0)
+        return 0;
+    if (strcmp(op, "-e") == 0)
+        return 1;
+    if (strcmp(op, "-f") == 0)
+        return S_ISREG(st.st_mode);
+    if (strcmp(op, "-d") == 0)
+        return S_ISDIR(st.st_mode);
+    if (strcmp(op, "-s") == 0)
+        return st.st_size > 0;
+    return -1;
+}
+
+static int test_binary(const char *a, const char *op, const char *b)
+{
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+        return strcmp(a, b) == 0;
+    if (strcmp(op, "!=") == 0)
+        return strcmp(a, b) != 0;
+
+    long long x = strtoll(a, NULL, 10), y = strtoll(b, NULL, 10);
+    if (strcmp(op, "-eq") == 0)
+        return x == y;
+    if (strcmp(op, "-ne") == 0)
+        return x != y;
+    if (strcmp(op, "-lt") == 0)
+        return x < y;
+    if (strcmp(op, "-le") == 0)
+        return x <= y;
+    if (strcmp(op, "-gt") == 0)
+        return x > y;
+    if (strcmp(op, "-ge") == 0)
+        return x >= y;
+    return -1;
+}
+
+static int test_eval(char *argv[], int argc)
+{
+    switch (argc)
+    {
+    case 0:
+        return 0;
+    case 1:
+        return argv[0][0] != '\0';
+    case 2:
+        if (strcmp(argv[0], "!") == 0)
+            return !test_eval(argv + 1, 1);
+        return test_unary(argv[0], argv[1]);
+    case 3:
+    {
+        int r = test_binary(argv[0], argv[1], argv[2]);
+        if (r < 0 && strcmp(argv[0], "!") == 0)
+        {
+            r = test_eval(argv + 1, 2);
+            return r < 0 ? r : !r;
+        }
+        return r;
+    }
+    case 4:
+        if (strcmp(argv[0], "!") == 0)
+        {
+            int r = test_eval(argv + 1, 3);
+            return r < 0 ? r : !r;
+        }
+    }
+    return -1;
+}
+
+static int builtin_test(char *args[])
+{
+    int argc = 0;
+    while (args[argc + 1])
+        argc++;
+
+    // "[ ... ]" needs its closing bracket
+    if (strcmp(args[0], "[") == 0)
+    {
+        if (argc == 0 || strcmp(args[argc], "]") != 0)
+        {
+            fprintf(stderr, "\033[1;31m[: missing ']'\033[0m\n");
+            return 2;
+        }
+        argc--;
+    }
+
+    int r = test_eval(args + 1, argc);
+    if (r < 0)
+    {
+        fprintf(stderr, "\033[1;31m%s: unsupported expression\033[0m\n", args[0]);
+        return 2;
+    }
+    return r ? 0 : 1;
+}
+
+// Backslash escapes of printf formats
+static int printf_escape(const char **p)
+{
+    switch (*++(*p))
+    {
+    case 'n':
+        return '\n';
+    case 't':
+        return '\t';
+    case 'r':
+        return '\r';
+    case 'a':
+        return '\a';
+    case '\\':
+        return '\\';
+    case '\0':
+        (*p)--;
+        return '\\';
+    default:
+        return **p;
+    }
+}
+
+// printf FORMAT [ARGUMENTS...]: the format is reused until every argument is consumed
+static int builtin_printf(char *args[])
+{
+    if (!args[1])
+    {
+        fprintf(stderr, "\033[1;31mprintf: usage: printf format [arguments]\033[0m\n");
+        return 1;
+    }
+
+    char **arg = &args[2];
+    int consumed;
+    do
+    {
+        consumed = 0;
+        for (const char *p = args[1]; *p; p++)
+        {
+            if (*p == '\\')
+            {
+                putchar(printf_escape(&p));
+                continue;
+            }
+            if (*p != '%')
+            {
+                putchar(*p);
+                continue;
+            }
+            // "%%", or a '%' ending the format, is a literal '%'
+            if (p[1] == '%' || p[1] == '\0')
+            {
+                putchar('%');
+                if (p[1])
+                    p++;
+                continue;
+            }
+
+            // Copy "%[flags][width][.precision]" and add the length modifier ourselves
+            char spec[32] = "%";
+            int len = 1;
+            p++;
+            while (*p && strchr("-+ #0123456789.", *p) && len < 24)
+                spec[len++] = *p++;
+
+            const char *value = *arg ? *arg++ : NULL;
+            consumed = 1;
+            switch (*p)
+            {
+            case 'd':
+            case 'i':
+                strcpy(spec + len, "lld");
+                printf(spec, value ? strtoll(value, NULL, 0) : 0LL);
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+                spec[len++] = 'l';
+                spec[len++] = 'l';
+                spec[len++] = *p;
+                spec[len] = '\0';
+                printf(spec, value ? strtoull(value, NULL, 0) : 0ULL);
+                break;
+            case 'c':
+                // The first character, padded to the width (an empty argument is only the padding)
+                if (value && value[0])
+                {
+                    strcpy(spec + len, "c");
+                    printf(spec, value[0]);
+                }
+                else
+                {
+                    strcpy(spec + len, "s");
+                    printf(spec, "");
+                }
+                break;
+            case 's':
+                strcpy(spec + len, "s");
+                printf(spec, value ? value : "");
+                break;
+            default:
+                fprintf(stderr, "\033[1;31mprintf: %%%c: invalid directive\033[0m\n", *p);
+                return 1;
+            }
+            if (*p == '\0')
+                break;
+        }
+    } while (consumed && *arg);
+
+    return 0;
+}
+
+static int builtin_pwd(char *args[])
+{
+    char cwd[4096];
+    if (!getcwd(cwd, sizeof(cwd)))
+    {
+        perror("pwd");
+        return 1;
+    }
+    printf("%s\n", cwd);
+    return 0;
+}
+
+// Open a file argument ("-" = stdin)
+static int open_input(const char *name, const char *who)
+{
+    if (strcmp(name, "-") == 0)
+        return STDIN_FILENO;
+
+    int fd = open(name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        fprintf(stderr, "\033[1;31m%s: %s: %s\033[0m\n", who, name, strerror(errno));
+    return fd;
+}
+
+static int builtin_cat(char *args[])
+{
+    static char buf[1 << 16];
+    char *stdin_only[] = {"-", NULL};
+    char **files = args[1] ? &args[1] : stdin_only;
+    int status = 0;
+
+    fflush(stdout);
+    for (int i = 0; files[i]; i++)
+    {
+        int fd = open_input(files[i], "cat");
+        if (fd < 0)
+        {
+            status = 1;
+            continue;
+        }
+
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR))
+        {
+            for (ssize_t off = 0; off < n;)
+            {
+                ssize_t w = write(STDOUT_FILENO, buf + off, n - off);
+                if (w < 0 && errno == EINTR)
+                    continue;
+                if (w < 0)
+                {
+                    // Reader went away (cat file | head)
+                    if (fd != STDIN_FILENO)
+                        close(fd);
+                    return 1;
+                }
+                off += w;
+            }
+        }
+        if (fd != STDIN_FILENO)
+            close(fd);
+    }
+    return status;
+}
+
+// wc [-lwc] [FILE...]
+static int builtin_wc(char *args[])
+{
+    static char buf[1 << 16];
+    int show_lines = 0, show_words = 0, show_bytes = 0, status = 0, n_files = 0, i;
+    long total[3] = {0, 0, 0};
+    char **files = args + 1; // The file names are packed over the options (never ahead of them)
+    static char *no_files[] = {"-", NULL};
+
+    for (i = 1; args[i]; i++)
+    {
+        if (args[i][0] == '-' && args[i][1])
+        {
+            for (char *o = args[i] + 1; *o; o++)
+            {
+                if (*o == 'l')
+                    show_lines = 1;
+                else if (*o == 'w')
+                    show_words = 1;
+                else if (*o == 'c')
+                    show_bytes = 1;
+                else
+                {
+                    fprintf(stderr, "\033[1;31mwc: invalid option -- '%c'\033[0m\n", *o);
+                    return 1;
+                }
+            }
+        }
+        else
+            files[n_files++] = args[i];
+    }
+    if (!show_lines && !show_words && !show_bytes)
+        show_lines = show_words = show_bytes = 1;
+    if (n_files == 0)
+    {
+        files = no_files;
+        n_files = 1;
+    }
+
+    int single = (show_lines + show_words + show_bytes == 1);
+    for (i = 0; i < n_files; i++)
+    {
+        int fd = open_input(files[i], "wc");
+        if (fd < 0)
+        {
+            status = 1;
+            continue;
+        }
+
+        long counts[3] = {0, 0, 0};
+        int in_word = 0;
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR))
+        {
+            counts[2] += (n > 0) ? n : 0;
+            for (ssize_t k = 0; k < n; k++)
+            {
+                if (buf[k] == '\n')
+                    counts[0]++;
+                if (isspace((unsigned char)buf[k]))
+                    in_word = 0;
+                else if (!in_word)
+                {
+                    in_word = 1;
+                    counts[1]++;
+                }
+            }
+        }
+        if (fd != STDIN_FILENO)
+            close(fd);
+
+        const char *fmt = single ? "%ld" : "%7ld";
+        int first = 1;
+        int show[3] = {show_lines, show_words, show_bytes};
+        for (int c = 0; c < 3; c++)
+        {
+            total[c] += counts[c];
+            if (show[c])
+            {
+                printf(first ? fmt : " %7ld", counts[c]);
+                first = 0;
+            }
+        }
+        if (strcmp(files[i], "-") != 0)
+            printf(" %s", files[i]);
+        printf("\n");
+    }
+
+    if (n_files > 1)
+    {
+        int show[3] = {show_lines, show_words, show_bytes};
+        for (int c = 0; c < 3; c++)
+        {
+            if (show[c])
+                printf("%7ld ", total[c]);
+        }
+        printf("total\n");
+    }
+    return status;
+}
+
+// sleep NUMBER[smhd]...
+static int builtin_sleep(char *args[])
+{
+    double seconds = 0;
+
+    if (!args[1])
+    {
+        fprintf(stderr, "\033[1;31msleep: missing operand\033[0m\n");
+        return 1;
+    }
+    for (int i = 1; args[i]; i++)
+    {
+        char *end;
+        double value = strtod(args[i], &end);
+        if (end == args[i] || value < 0 || (*end && end[1]) || (*end && !strchr("smhd", *end)))
+        {
+            fprintf(stderr, "\033[1;31msleep: invalid time interval '%s'\033[0m\n", args[i]);
+            return 1;
+        }
+        seconds += value * (*end == 'm' ? 60 : *end == 'h' ? 3600 : *end == 'd' ? 86400 : 1);
+
+        // "inf", "nan" and 1e400 (which strtod() makes inf) can't be slept
+        if (!isfinite(seconds))
+        {
+            fprintf(stderr, "\033[1;31msleep: invalid time interval '%s'\033[0m\n", args[i]);
+            return 1;
+        }
+    }
+    if (seconds > SLEEP_MAX)
+        seconds = SLEEP_MAX;
+
+    struct timespec left;
+    left.tv_sec = (time_t)seconds;
+    left.tv_nsec = (long)((seconds - left.tv_sec) * 1e9);
+
+    // SIGCHLD from background jobs interrupts the sleep, keep going with what's left
+    while (nanosleep(&left, &left) == -1 && errno == EINTR)
+        ;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////**********  SHELL BUILTINS   ***********///////////////
+/////////////////////////////////////////////////////////////////////
+
+// cd command to change the current working directory.
+int handle_cd(char *args[])
+{
+    char *target_dir;
+
+    // Case 1: cd (no arguments) or cd ~ -> Change to home directory
+    if (!args[1] || strcmp(args[1], "~") == 0)
+    {
+        target_dir = (char *)var_lookup("HOME", 4, NULL); // Get the home directory from the shell variables
+        if (!target_dir)
+        {
+            fprintf(stderr, "\033[1;31mcd: HOME environment variable not set\033[0m\n");
+            return 1;
+        }
+    }
+
+    // Case 2: cd .. / cd absolute_path / cd relative_path -> Change to the specified path
+    // (a quoted path with spaces is already one argument, the lexer removed the quotes)
+    else
+    {
+        target_dir = args[1];
+    }
+
+    // Attempt to change the directory
+    if (chdir(target_dir) != 0)
+    {
+        fprintf(stderr, "\033[1;31mcd: %s: No such file or directory\033[0m\n", target_dir);
+        return 1;
+    }
+    return 0;
+}
+
+// echo command to print arguments to the console.
+int handle_echo(char *args[])
+{
+
+    // If no arguments, just print a newline
+    if (args[1] == NULL)
+    {
+        printf("\n");
+        return 0;
+    }
+
+    // Arguments arrive expanded and unquoted
+    int i = 1;
+    while (args[i] != NULL)
+    {
+        printf("%s", args[i]);
+
+        // Add space between arguments
+        if (args[i + 1] != NULL)
+        {
+            printf(" ");
+        }
+        i++;
+    }
+
+    printf("\n");
+    return 0;
+}
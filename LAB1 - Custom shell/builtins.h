@@ -0,0 +1,31 @@
+/*
+Builtin registry: every command MyShell runs without starting a process.
+Lookup is a perfect hash (a seed picked at startup so no two names share a slot),
+so dispatch costs one hash and one strcmp whatever the number of builtins.
+*/
+
+#define BUILTIN_EXIT -1 // Status returned by "exit": leave the shell
+
+typedef int (*builtin_fn)(char *args[]);
+
+struct builtin
+{
+    const char *name;
+    builtin_fn fn;
+    int utility; // Stands in for an external program (expanded, redirected, reports its status)
+};
+
+// Build the dispatch table (call once at startup)
+void builtins_init(void);
+
+// The builtin called 'name', NULL if there is none
+const struct builtin *builtin_find(const char *name);
+
+// The i-th builtin of the table, NULL after the last one (for completion)
+const struct builtin *builtin_at(int i);
+
+// Run a builtin in the shell process with its stdin/stdout/stderr on fds[0..2] (-1 = unchanged)
+int builtin_run(const struct builtin *b, char *args[], int fds[3]);
+
+int handle_cd(char *args[]);
+int handle_echo(char *args[]);
@@ -0,0 +1,588 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "complete.h"
+#include "lexer.h"
+#include "vars.h"
+#include "builtins.h"
+#include "wildcard.h"
+
+#define COMMAND_DIRS_MAX 63  // PATH directories completed from (one bit each, bit 0 is the builtins)
+#define RACY_NS 1000000000LL // A directory changed this close to its read is read again
+#define NO_NODE UINT32_MAX
+#define DEFAULT_PATH "/usr/local/bin:/usr/bin:/bin"
+
+// Characters a backslash goes before when a name is put on the line
+#define SPECIAL " \t\n\\'\"|&;<>()$`*?[#"
+
+/*
+Trie node: the children of a node are a sorted list (first child, then siblings),
+all nodes live in one array and point at each other by index (0 = none, the root
+is node 0 and nobody's child).
+*/
+struct node
+{
+    uint32_t child;
+    uint32_t sibling;
+    uint32_t live;    // Names in this subtree that are still somewhere
+    uint64_t sources; // Where the name ending here is: bit 0 the builtins, bit 1 + i PATH directory i
+    unsigned char c;
+};
+
+// A PATH directory, and the names it had when it was read
+struct command_dir
+{
+    char *dir;
+    struct timespec mtime;
+    struct timespec read_at; // Clock when it was read (0 = never)
+    char *names;             // Executables, each followed by a '\0'
+    size_t names_len;
+};
+
+static struct node *nodes = NULL;
+static uint32_t n_nodes = 0, nodes_cap = 0;
+
+static struct command_dir dirs[COMMAND_DIRS_MAX];
+static int n_dirs = 0;          // Slots in use are below (a free one has dir == NULL)
+static char *path_value = NULL; // PATH when dirs[] was set up (NULL = not yet)
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  TRIE   **********//////////////////////////
+/////////////////////////////////////////////////////////////////////
+
+static uint32_t new_node(unsigned char c)
+{
+    if (n_nodes == nodes_cap)
+    {
+        uint32_t cap = nodes_cap ? nodes_cap * 2 : 1024;
+        struct node *n = realloc(nodes, cap * sizeof(struct node));
+        if (!n)
+            return 0;
+        nodes = n;
+        nodes_cap = cap;
+    }
+    memset(&nodes[n_nodes], 0, sizeof(struct node));
+    nodes[n_nodes].c = c;
+    return n_nodes++;
+}
+
+// Child of 'parent' for byte 'c' (created in its sorted place if 'create'), 0 if there is none
+static uint32_t child(uint32_t parent, unsigned char c, int create)
+{
+    uint32_t prev = 0, i = nodes[parent].child;
+    while (i && nodes[i].c < c)
+    {
+        prev = i;
+        i = nodes[i].sibling;
+    }
+    if ((i && nodes[i].c == c) || !create)
+        return (i && nodes[i].c == c) ? i : 0;
+
+    uint32_t n = new_node(c); // May move 'nodes'
+    if (!n)
+        return 0;
+    nodes[n].sibling = i;
+    if (prev)
+        nodes[prev].sibling = n;
+    else
+        nodes[parent].child = n;
+    return n;
+}
+
+// Add or remove (add = 0) 'name' for the source 'bit', keeping the live counts of the path to it
+static void trie_update(const char *name, uint64_t bit, int add)
+{
+    uint32_t path[NAME_MAX + 2];
+    int depth = 0;
+
+    if (!nodes)
+    {
+        new_node(0); // The root
+        if (!nodes)
+            return;
+    }
+    path[depth++] = 0;
+    for (const char *p = name; *p && depth < NAME_MAX + 1; p++)
+    {
+        uint32_t n = child(path[depth - 1], *p, add);
+        if (!n)
+            return;
+        path[depth++] = n;
+    }
+
+    struct node *end = &nodes[path[depth - 1]];
+    int was_live = end->sources != 0;
+    end->sources = add ? (end->sources | bit) : (end->sources & ~bit);
+    int is_live = end->sources != 0;
+    for (int i = 0; was_live != is_live && i < depth; i++)
+        nodes[path[i]].live += is_live ? 1 : -1;
+}
+
+// Node of the names starting with 'prefix' (the root for ""), NO_NODE if there are none
+static uint32_t trie_find(const char *prefix)
+{
+    uint32_t n = 0;
+    if (!nodes)
+        return NO_NODE;
+    for (const char *p = prefix; *p; p++)
+    {
+        if (!(n = child(n, *p, 0)))
+            return NO_NODE;
+    }
+    return nodes[n].live ? n : NO_NODE;
+}
+
+// The names under 'n' in order (as 'name' + what the path adds), at most 'max' into 'list'
+static void trie_list(uint32_t n, char *name, size_t len, char **list, int *count, int max, struct arena *a)
+{
+    if (nodes[n].sources && *count < max)
+        list[(*count)++] = arena_strndup(a, name, len);
+    for (uint32_t i = nodes[n].child; i && *count < max; i = nodes[i].sibling)
+    {
+        if (!nodes[i].live || len >= NAME_MAX)
+            continue;
+        name[len] = nodes[i].c;
+        trie_list(i, name, len + 1, list, count, max, a);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  COMMANDS   **********//////////////////////
+/////////////////////////////////////////////////////////////////////
+
+static long long ns_between(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1000000000LL + (to->tv_nsec - from->tv_nsec);
+}
+
+// Take the names of dirs[i] out of the trie
+static void drop_names(int i)
+{
+    for (size_t k = 0; k < dirs[i].names_len; k += strlen(dirs[i].names + k) + 1)
+        trie_update(dirs[i].names + k, 2ULL << i, 0);
+    free(dirs[i].names);
+    dirs[i].names = NULL;
+    dirs[i].names_len = 0;
+}
+
+// Read dirs[i] again if it changed since (or was never read)
+static void refresh_dir(int i)
+{
+    struct command_dir *d = &dirs[i];
+    struct stat st;
+    if (stat(d->dir, &st) != 0)
+        memset(&st.st_mtim, 0, sizeof(struct timespec));
+    if (d->read_at.tv_sec && ns_between(&d->mtime, &st.st_mtim) == 0 && ns_between(&d->mtime, &d->read_at) >= RACY_NS)
+        return;
+
+    drop_names(i);
+    d->mtime = st.st_mtim;
+    clock_gettime(CLOCK_REALTIME, &d->read_at);
+
+    DIR *dir = opendir(d->dir);
+    if (!dir)
+        return;
+    size_t cap = 0;
+    struct dirent *e;
+    while ((e = readdir(dir)))
+    {
+        struct stat file;
+        if (e->d_name[0] == '.' || e->d_type == DT_DIR)
+            continue;
+        if (fstatat(dirfd(dir), e->d_name, &file, 0) != 0 || !S_ISREG(file.st_mode) || !(file.st_mode & 0111))
+            continue;
+
+        size_t len = strlen(e->d_name) + 1;
+        if (d->names_len + len > cap)
+        {
+            cap = cap ? cap * 2 : 4096;
+            char *names = realloc(d->names, cap);
+            if (!names)
+                break;
+            d->names = names;
+        }
+        memcpy(d->names + d->names_len, e->d_name, len);
+        d->names_len += len;
+        trie_update(e->d_name, 2ULL << i, 1);
+    }
+    closedir(dir);
+}
+
+// Slot of the directory 'dir' in dirs[], -1 if it has none
+static int find_dir(const char *dir)
+{
+    for (int i = 0; i < n_dirs; i++)
+    {
+        if (dirs[i].dir && strcmp(dirs[i].dir, dir) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/*
+Follow PATH: directories are matched by name, so one still in PATH keeps its slot
+(its bit in the trie) and its names wherever it moved. Only the ones that left are
+dropped and only the new ones read. Their order doesn't matter: a name is listed
+once whichever directories have it.
+*/
+static void update_path(void)
+{
+    const char *path = var_lookup("PATH", 4, NULL);
+    if (!path)
+        path = DEFAULT_PATH;
+    if (path_value && strcmp(path_value, path) == 0)
+        return;
+
+    if (!path_value)
+    {
+        for (int i = 0; builtin_at(i); i++)
+            trie_update(builtin_at(i)->name, 1, 1);
+    }
+    free(path_value);
+    path_value = strdup(path);
+
+    // The directories still there (the first COMMAND_DIRS_MAX entries count, as below)
+    int kept[COMMAND_DIRS_MAX] = {0};
+    char *copy = strdup(path);
+    char *save = NULL;
+    int n = 0;
+    for (char *dir = strtok_r(copy, ":", &save); dir && n < COMMAND_DIRS_MAX; dir = strtok_r(NULL, ":", &save), n++)
+    {
+        int i = find_dir(dir);
+        if (i >= 0)
+            kept[i] = 1;
+    }
+    for (int i = 0; i < n_dirs; i++)
+    {
+        if (dirs[i].dir && !kept[i])
+        {
+            drop_names(i);
+            free(dirs[i].dir);
+            dirs[i].dir = NULL;
+        }
+    }
+
+    // The new ones take free slots, they are read on the next completion
+    strcpy(copy, path);
+    save = NULL;
+    n = 0;
+    for (char *dir = strtok_r(copy, ":", &save); dir && n < COMMAND_DIRS_MAX; dir = strtok_r(NULL, ":", &save), n++)
+    {
+        if (find_dir(dir) >= 0)
+            continue;
+        int i = 0;
+        while (i < n_dirs && dirs[i].dir)
+            i++;
+        memset(&dirs[i], 0, sizeof(struct command_dir));
+        dirs[i].dir = strdup(dir);
+        if (i == n_dirs)
+            n_dirs++;
+    }
+    while (n_dirs > 0 && !dirs[n_dirs - 1].dir)
+        n_dirs--;
+    free(copy);
+}
+
+static void complete_command(struct arena *a, const char *prefix, struct completion *c)
+{
+    update_path();
+    for (int i = 0; i < n_dirs; i++)
+    {
+        if (dirs[i].dir)
+            refresh_dir(i);
+    }
+
+    uint32_t n = trie_find(prefix);
+    if (n == NO_NODE)
+        return;
+    c->n = nodes[n].live;
+
+    // What they share: down the trie while there is a single way to go
+    char name[NAME_MAX + 1];
+    size_t len = strlen(prefix);
+    memcpy(name, prefix, len);
+    size_t shared = len;
+    for (uint32_t at = n; !nodes[at].sources && shared < NAME_MAX;)
+    {
+        uint32_t next = 0, ways = 0;
+        for (uint32_t i = nodes[at].child; i; i = nodes[i].sibling)
+        {
+            if (nodes[i].live)
+            {
+                next = i;
+                ways++;
+            }
+        }
+        if (ways != 1)
+            break;
+        name[shared++] = nodes[next].c;
+        at = next;
+    }
+    c->common = arena_strndup(a, name, shared);
+
+    int count = 0;
+    c->matches = arena_alloc(a, (COMPLETE_LIST_MAX + 1) * sizeof(char *));
+    trie_list(n, name, len, c->matches, &count, COMPLETE_LIST_MAX, a);
+    c->matches[count] = NULL;
+    c->done = (c->n == 1);
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  VARIABLES AND FILES   **********///////////
+/////////////////////////////////////////////////////////////////////
+
+struct name_list
+{
+    struct arena *a;
+    const char *prefix;
+    size_t prefix_len;
+    char **names;
+    int n, cap;
+};
+
+static void add_name(const char *name, void *data)
+{
+    struct name_list *l = data;
+    if (strncmp(name, l->prefix, l->prefix_len) != 0)
+        return;
+    if (l->n + 1 >= l->cap)
+    {
+        int cap = l->cap ? l->cap * 2 : 64;
+        l->names = arena_grow(l->a, l->names, l->cap * sizeof(char *), cap * sizeof(char *));
+        l->cap = cap;
+    }
+    l->names[l->n++] = arena_strndup(l->a, name, strlen(name));
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Length of the longest prefix the 'n' names share
+static size_t shared_length(char **names, int n)
+{
+    size_t len = n ? strlen(names[0]) : 0;
+    for (int i = 1; i < n; i++)
+    {
+        size_t k = 0;
+        while (k < len && names[i][k] == names[0][k])
+            k++;
+        len = k;
+    }
+    return len;
+}
+
+static void complete_variable(struct arena *a, const char *prefix, int braces, struct completion *c)
+{
+    struct name_list l = {a, prefix, strlen(prefix), NULL, 0, 0};
+    vars_each(add_name, &l);
+    if (l.n == 0)
+        return;
+    qsort(l.names, l.n, sizeof(char *), compare_names);
+    l.names[l.n] = NULL;
+
+    c->n = l.n;
+    c->matches = l.names;
+    size_t len = shared_length(l.names, l.n);
+    c->common = arena_alloc(a, len + 2);
+    memcpy(c->common, l.names[0], len);
+    strcpy(c->common + len, (l.n == 1 && braces) ? "}" : "");
+}
+
+// 'text' with a backslash before every character the lexer would take for something else
+static char *escape(struct arena *a, const char *text, size_t len)
+{
+    char *out = arena_alloc(a, 2 * len + 1), *o = out;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (strchr(SPECIAL, text[i]))
+            *o++ = '\\';
+        *o++ = text[i];
+    }
+    *o = '\0';
+    return out;
+}
+
+static int is_dir(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// 'dir' (with its '/', or "") and the start of the name: the names of the glob "<dir><base>*"
+static void complete_file(struct arena *a, const char *dir, const char *base, struct completion *c)
+{
+    size_t dir_len = strlen(dir), base_len = strlen(base);
+    char *pattern = arena_alloc(a, dir_len + base_len + 2);
+    memcpy(pattern, dir, dir_len);
+    memcpy(pattern + dir_len, base, base_len);
+    pattern[dir_len + base_len] = GLOB_STAR;
+    pattern[dir_len + base_len + 1] = '\0';
+
+    int n;
+    char **paths = glob_expand(a, pattern, &n);
+    if (!paths)
+        return;
+
+    // The names alone (a path ends with its name: glob_expand() never adds a '/' after it)
+    char **names = arena_alloc(a, (n + 1) * sizeof(char *));
+    for (int i = 0; i < n; i++)
+    {
+        char *slash = strrchr(paths[i], '/');
+        names[i] = slash ? slash + 1 : paths[i];
+    }
+    names[n] = NULL;
+    size_t len = shared_length(names, n);
+
+    c->n = n;
+    c->common = escape(a, names[0], len);
+    if (n == 1 && is_dir(paths[0]))
+    {
+        size_t common_len = strlen(c->common);
+        c->common = arena_grow(a, c->common, common_len + 1, common_len + 2);
+        strcpy(c->common + common_len, "/");
+    }
+    else
+        c->done = (n == 1);
+
+    // Listed with a '/' after the directories
+    int listed = (n < COMPLETE_LIST_MAX) ? n : COMPLETE_LIST_MAX;
+    c->matches = arena_alloc(a, (listed + 1) * sizeof(char *));
+    for (int i = 0; i < listed; i++)
+    {
+        int dir_match = is_dir(paths[i]);
+        size_t name_len = strlen(names[i]);
+        c->matches[i] = arena_alloc(a, name_len + 2);
+        memcpy(c->matches[i], names[i], name_len);
+        strcpy(c->matches[i] + name_len, dir_match ? "/" : "");
+    }
+    c->matches[listed] = NULL;
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  THE WORD   **********//////////////////////
+/////////////////////////////////////////////////////////////////////
+
+// Does a word like this leave the next one in command position?
+static int keeps_command(const char *word, size_t len)
+{
+    static const char *keywords[] = {"if", "then", "else", "elif", "do", "while", "until", "!", "{", NULL};
+    for (int i = 0; keywords[i]; i++)
+    {
+        if (strlen(keywords[i]) == len && strncmp(word, keywords[i], len) == 0)
+            return 1;
+    }
+    size_t name_len = var_name_length(word);
+    return name_len > 0 && name_len < len && word[name_len] == '='; // NAME=value cmd
+}
+
+// Start of the word the cursor is at the end of ('command': it is the command's name)
+static size_t word_start(const char *line, size_t cursor, int *command)
+{
+    size_t start = 0;
+    char quote = 0;
+    int expect_command = 1, redirect = 0;
+
+    for (size_t i = 0; i < cursor; i++)
+    {
+        char ch = line[i];
+        if (quote)
+        {
+            if (ch == quote)
+                quote = 0;
+            else if (ch == '\\' && quote == '"')
+                i++;
+            continue;
+        }
+        if (ch == '\\')
+        {
+            i++;
+            continue;
+        }
+        if (ch == '\'' || ch == '"')
+        {
+            quote = ch;
+            continue;
+        }
+        if (!strchr(" \t|;&<>()", ch))
+            continue;
+
+        // A word ends here (the file of a redirection doesn't change what comes next)
+        if (i > start)
+        {
+            if (redirect)
+                redirect = 0;
+            else if (!keeps_command(line + start, i - start))
+                expect_command = 0;
+        }
+        if (ch == '<' || ch == '>')
+            redirect = 1;
+        else if (ch != ' ' && ch != '\t')
+            expect_command = 1;
+        start = i + 1;
+    }
+    *command = expect_command && !redirect;
+    return start;
+}
+
+// line[start, end) without its quotes and backslashes: the text it stands for
+static char *unquote(struct arena *a, const char *line, size_t start, size_t end)
+{
+    char *out = arena_alloc(a, end - start + 1), *o = out;
+    for (size_t i = start; i < end; i++)
+    {
+        if (line[i] == '\'' || line[i] == '"')
+            continue;
+        if (line[i] == '\\' && i + 1 < end)
+            i++;
+        *o++ = line[i];
+    }
+    *o = '\0';
+    return out;
+}
+
+int complete(struct arena *a, const char *line, size_t cursor, struct completion *c)
+{
+    int command;
+    size_t start = word_start(line, cursor, &command);
+    memset(c, 0, sizeof(struct completion));
+
+    // $NAME or ${NAME} at the end of the word
+    size_t name = cursor;
+    while (name > start && (var_name_length(line + name - 1) > 0 || (line[name - 1] >= '0' && line[name - 1] <= '9')))
+        name--;
+    int braces = (name > start && line[name - 1] == '{');
+    size_t dollar = name - braces;
+    if (dollar > start && line[dollar - 1] == '$' && (dollar < start + 2 || line[dollar - 2] != '\\'))
+    {
+        c->start = name;
+        complete_variable(a, unquote(a, line, name, cursor), braces, c);
+        return c->n;
+    }
+
+    // A command's name, unless it is a path
+    char *word = unquote(a, line, start, cursor);
+    if (command && !strchr(word, '/'))
+    {
+        c->start = start;
+        complete_command(a, word, c);
+        if (c->n)
+            c->common = escape(a, c->common, strlen(c->common));
+        return c->n;
+    }
+
+    // A file: what comes after the last '/' is completed, the directory stays as written
+    size_t slash = cursor;
+    while (slash > start && line[slash - 1] != '/')
+        slash--;
+    c->start = slash;
+    complete_file(a, unquote(a, line, start, slash), unquote(a, line, slash, cursor), c);
+    return c->n;
+}
@@ -0,0 +1,32 @@
+#include <stddef.h>
+
+/*
+Tab completion for the line editor: what the word under the cursor can become.
+    - the first word of a command completes to a builtin or an executable of PATH,
+      from a prefix trie built the first time and then kept up to date: each PATH
+      directory is read again only when its mtime changed (one stat() per directory
+      and keypress), and a changed PATH only reads the directories that are new.
+      Each name records which directories have it, so a directory read again only
+      adds and removes its own names
+    - $NAME / ${NAME} complete to the shell's variables
+    - anything else completes to file names, through the glob cache (wildcard.c):
+      "src/ma" is globbed as "src/ma*", directories get a '/'
+The longest text all the matches share is computed from the trie without listing
+them, so a command prefix shared by thousands of names costs a walk down the trie.
+*/
+
+#define COMPLETE_LIST_MAX 256 // Matches listed at most (more are only counted)
+
+struct arena;
+
+struct completion
+{
+    size_t start;   // The completion replaces line[start, cursor)
+    char *common;   // The longest text every match starts with, escaped for the line
+    char **matches; // The first COMPLETE_LIST_MAX matches (as listed, not escaped), NULL-terminated
+    int n;          // Number of matches
+    int done;       // One match and it is a whole word: a space can follow it
+};
+
+// Complete the word ending at 'cursor' in 'line' (everything is allocated in 'a'), returns the number of matches
+int complete(struct arena *a, const char *line, size_t cursor, struct completion *c);
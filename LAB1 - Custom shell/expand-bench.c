@@ -0,0 +1,148 @@
+/*
+    Measures variable expansion throughput on a generated script: the old
+    expand_variables() (strcat one character at a time, getenv for every name)
+    against vars.c (one pass into a growable buffer, hash table lookups).
+
+    To build:
+    make expand-bench
+
+    To run:
+    ./expand-bench [script_kb] [variables]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "lexer.h"
+#include "vars.h"
+
+#define LEGACY_MAX 1024 // The old fixed buffers
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// The expansion MyShell used before, kept as the baseline
+static void legacy_expand(char *str)
+{
+    char result[LEGACY_MAX] = "";
+    char temp[LEGACY_MAX] = "";
+    char *read_ptr = str;
+
+    while (*read_ptr)
+    {
+        if (*read_ptr == '$')
+        {
+            read_ptr++;
+            char var_name[LEGACY_MAX] = "";
+            int i = 0;
+            while (isalnum(*read_ptr) || *read_ptr == '_')
+                var_name[i++] = *read_ptr++;
+            var_name[i] = '\0';
+
+            char *value = getenv(var_name);
+            if (value)
+                strcat(result, value);
+        }
+        else
+        {
+            temp[0] = *read_ptr;
+            temp[1] = '\0';
+            strcat(result, temp);
+            read_ptr++;
+        }
+    }
+    strcpy(str, result);
+}
+
+/*
+A script of 'size' bytes made of words of about 'word_len' bytes, each mixing
+literal text with $NAME references (every expanded word stays under LEGACY_MAX
+so the old code can run it too).
+*/
+static char *make_script(size_t size, int word_len, int n_vars)
+{
+    char *script = malloc(size + LEGACY_MAX);
+    size_t len = 0;
+
+    while (len < size)
+    {
+        int w = 0;
+        while (w < word_len)
+        {
+            int n = (rand() % 3 == 0)
+                        ? sprintf(script + len, "$VAR%d", rand() % n_vars)
+                        : sprintf(script + len, "text%d", rand() % 100);
+            len += n;
+            w += n;
+        }
+        script[len++] = (rand() % 8 == 0) ? '\n' : ' ';
+    }
+    script[len] = '\0';
+    return script;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t script_kb = (argc > 1) ? atoi(argv[1]) : 1024;
+    int n_vars = (argc > 2) ? atoi(argv[2]) : 200;
+    const int word_lens[] = {16, 128, 512};
+
+    // Every variable is exported, so getenv() has a big environ to scan
+    for (int i = 0; i < n_vars; i++)
+    {
+        char name[32], value[32];
+        sprintf(name, "VAR%d", i);
+        sprintf(value, "val%d", i);
+        setenv(name, value, 1);
+    }
+    vars_init();
+
+    printf("%10s %14s %14s %8s\n", "word_bytes", "legacy(MB/s)", "vars.c(MB/s)", "speedup");
+    for (int i = 0; i < (int)(sizeof(word_lens) / sizeof(word_lens[0])); i++)
+    {
+        srand(42);
+        char *script = make_script(script_kb << 10, word_lens[i], n_vars);
+        size_t script_len = strlen(script);
+        char *copy = malloc(script_len + 1);
+
+        // Both sides expand the same words: the lexer output of the script, line by line
+        struct arena arena = ARENA_INIT;
+        double legacy_us = 0, table_us = 0;
+        memcpy(copy, script, script_len + 1);
+        for (char *line = strtok(copy, "\n"); line; line = strtok(NULL, "\n"))
+        {
+            struct token *tokens;
+            arena_reset(&arena);
+            int n = lex(&arena, line, &tokens);
+
+            double start = now_us();
+            for (int t = 0; t < n; t++)
+                expand_variables(&arena, tokens[t].text);
+            table_us += now_us() - start;
+
+            char word[LEGACY_MAX];
+            start = now_us();
+            for (int t = 0; t < n; t++)
+            {
+                strcpy(word, tokens[t].text);
+                legacy_expand(word);
+            }
+            legacy_us += now_us() - start;
+        }
+
+        double mb = script_len / 1e6;
+        printf("%10d %14.1f %14.1f %7.1fx\n", word_lens[i],
+               mb / (legacy_us / 1e6), mb / (table_us / 1e6), legacy_us / table_us);
+
+        arena_free(&arena);
+        free(copy);
+        free(script);
+    }
+    return 0;
+}
@@ -0,0 +1,347 @@
+#define _GNU_SOURCE // memmem()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "history.h"
+#include "vars.h"
+
+#define HISTORY_FILE ".myshell_history"
+#define HISTORY_NEWLINE '\036' // A newline inside an entry (a command of several lines): one entry per line of the file
+#define TRIGRAM_BITS 16
+#define TRIGRAM_BUCKETS (1 << TRIGRAM_BITS)
+
+// Entries containing one of the trigrams hashed to a bucket
+struct posting
+{
+    unsigned char *ids; // Entry numbers, each as the varint of its distance from the previous one
+    uint32_t len, cap;
+    uint32_t count;
+    uint32_t next; // Last entry + 1 (0 = empty): the base of the next delta, and no entry is listed twice
+};
+
+static char *path = NULL;       // The history file in use (NULL until the first use)
+static int append_fd = -1;
+static const char *map = NULL;  // The file, read-only, as far as it was mapped
+static size_t map_len = 0;
+static size_t indexed = 0;      // Bytes of the mapping split into entries (always after a '\n')
+static uint32_t *offsets = NULL; // Where each entry starts in the file
+static size_t n_entries = 0, offsets_cap = 0;
+static struct posting *postings = NULL; // TRIGRAM_BUCKETS lists, allocated by the first search
+static size_t trigram_entries = 0;      // Entries in the trigram index
+
+// HISTFILE, or ~/.myshell_history (NULL: no history)
+static const char *history_path(void)
+{
+    static char home_path[PATH_MAX];
+    const char *file = var_lookup("HISTFILE", 8, NULL);
+    if (file)
+        return *file ? file : NULL;
+
+    const char *home = var_lookup("HOME", 4, NULL);
+    if (!home || !*home)
+        return NULL;
+    snprintf(home_path, sizeof(home_path), "%s/%s", home, HISTORY_FILE);
+    return home_path;
+}
+
+static void forget(void)
+{
+    if (append_fd >= 0)
+        close(append_fd);
+    if (map)
+        munmap((void *)map, map_len);
+    if (postings)
+    {
+        for (int i = 0; i < TRIGRAM_BUCKETS; i++)
+            free(postings[i].ids);
+        free(postings);
+    }
+    free(offsets);
+    free(path);
+    path = NULL;
+    append_fd = -1;
+    map = NULL;
+    map_len = indexed = n_entries = offsets_cap = trigram_entries = 0;
+    offsets = NULL;
+    postings = NULL;
+}
+
+// Is 'path' still the history file? (HISTFILE may have changed: then start over with the new one)
+static int open_history(void)
+{
+    const char *file = history_path();
+    if (path && (!file || strcmp(path, file) != 0))
+        forget();
+    if (!file)
+        return -1;
+    if (!path)
+        path = strdup(file);
+    return path ? 0 : -1;
+}
+
+void history_add(const char *command)
+{
+    if (command[strspn(command, " \t\n")] == '\0' || open_history() != 0)
+        return;
+    if (append_fd < 0)
+        append_fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (append_fd < 0)
+        return;
+
+    char *entry = strdup(command);
+    if (!entry)
+        return;
+    for (char *nl = entry; (nl = strchr(nl, '\n'));)
+        *nl = HISTORY_NEWLINE;
+
+    // One write() with O_APPEND: lines from shells writing at the same time don't mix
+    struct iovec iov[2] = {{entry, strlen(entry)}, {"\n", 1}};
+    if (writev(append_fd, iov, 2) < 0)
+    {
+        close(append_fd);
+        append_fd = -1;
+    }
+    free(entry);
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  INDEX   **********/////////////////////////
+/////////////////////////////////////////////////////////////////////
+
+// Start and length of entry 'i'
+static const char *entry(size_t i, size_t *len)
+{
+    size_t end = (i + 1 < n_entries) ? offsets[i + 1] - 1 : indexed - 1;
+    *len = end - offsets[i];
+    return map + offsets[i];
+}
+
+static unsigned int trigram(const char *p)
+{
+    uint32_t t = (unsigned char)p[0] << 16 | (unsigned char)p[1] << 8 | (unsigned char)p[2];
+    return (t * 2654435761u) >> (32 - TRIGRAM_BITS);
+}
+
+static int post(struct posting *p, uint32_t id)
+{
+    if (p->next == id + 1)
+        return 0; // The entry has this trigram (or another one of the bucket) already
+    if (p->len + 5 > p->cap)
+    {
+        uint32_t cap = p->cap ? p->cap * 2 : 16;
+        unsigned char *ids = realloc(p->ids, cap);
+        if (!ids)
+            return -1;
+        p->ids = ids;
+        p->cap = cap;
+    }
+    for (uint32_t delta = id + 1 - p->next;; delta >>= 7)
+    {
+        if (delta < 0x80)
+        {
+            p->ids[p->len++] = delta;
+            break;
+        }
+        p->ids[p->len++] = (delta & 0x7f) | 0x80;
+    }
+    p->next = id + 1;
+    p->count++;
+    return 0;
+}
+
+// Add the entries the trigram index doesn't have yet
+static int index_trigrams(void)
+{
+    if (!postings && !(postings = calloc(TRIGRAM_BUCKETS, sizeof(struct posting))))
+        return -1;
+    for (; trigram_entries < n_entries; trigram_entries++)
+    {
+        size_t len;
+        const char *e = entry(trigram_entries, &len);
+        for (size_t i = 0; i + 3 <= len; i++)
+        {
+            if (post(&postings[trigram(e + i)], trigram_entries) != 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+// Map what was appended to the file since the last time and split it into entries
+static int refresh(void)
+{
+    if (open_history() != 0)
+        return -1;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        return 0; // No history yet
+    }
+    if ((size_t)st.st_size < indexed)
+    {
+        // Shorter than what was read: it was replaced, start over
+        close(fd);
+        char *file = strdup(path);
+        forget();
+        path = file;
+        return refresh();
+    }
+    if ((size_t)st.st_size > map_len && (uint64_t)st.st_size <= UINT32_MAX)
+    {
+        void *m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (m != MAP_FAILED)
+        {
+            if (map)
+                munmap((void *)map, map_len);
+            map = m;
+            map_len = st.st_size;
+        }
+    }
+    close(fd);
+
+    // Only whole lines: another shell may be in the middle of a write
+    for (const char *p = map + indexed, *end = map + map_len; p < end;)
+    {
+        const char *nl = memchr(p, '\n', end - p);
+        if (!nl)
+            break;
+        if (n_entries == offsets_cap)
+        {
+            size_t cap = offsets_cap ? offsets_cap * 2 : 1024;
+            uint32_t *o = realloc(offsets, cap * sizeof(uint32_t));
+            if (!o)
+                return -1;
+            offsets = o;
+            offsets_cap = cap;
+        }
+        offsets[n_entries++] = p - map;
+        p = nl + 1;
+        indexed = p - map;
+    }
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  BUILTIN   **********///////////////////////
+/////////////////////////////////////////////////////////////////////
+
+// "   N  command", the lines of a command of several lines under each other
+static void show(size_t i)
+{
+    size_t len;
+    const char *e = entry(i, &len);
+    printf("%6zu  ", i + 1);
+    for (const char *nl; (nl = memchr(e, HISTORY_NEWLINE, len));)
+    {
+        printf("%.*s\n        ", (int)(nl - e), e);
+        len -= nl + 1 - e;
+        e = nl + 1;
+    }
+    printf("%.*s\n", (int)len, e);
+}
+
+static int found(size_t i, const char *text, size_t text_len, int prefix)
+{
+    size_t len;
+    const char *e = entry(i, &len);
+    if (prefix)
+        return len >= text_len && memcmp(e, text, text_len) == 0;
+    return memmem(e, len, text, text_len) != NULL;
+}
+
+static void search(const char *text, int prefix)
+{
+    size_t text_len = strlen(text);
+    if (text_len < 3 || index_trigrams() != 0)
+    {
+        for (size_t i = 0; i < n_entries; i++)
+        {
+            if (found(i, text, text_len, prefix))
+                show(i);
+        }
+        return;
+    }
+
+    // Every match has all of the text's trigrams: the shortest list has them all
+    struct posting *best = NULL;
+    for (size_t i = 0; i + 3 <= text_len; i++)
+    {
+        struct posting *p = &postings[trigram(text + i)];
+        if (!best || p->count < best->count)
+            best = p;
+    }
+
+    uint32_t id = 0;
+    for (uint32_t k = 0; k < best->len;)
+    {
+        uint32_t delta = 0;
+        for (int shift = 0;; shift += 7)
+        {
+            unsigned char b = best->ids[k++];
+            delta |= (uint32_t)(b & 0x7f) << shift;
+            if (b < 0x80)
+                break;
+        }
+        id += delta; // id is the entry + 1
+        if (found(id - 1, text, text_len, prefix))
+            show(id - 1);
+    }
+}
+
+int handle_history(char *args[])
+{
+    if (refresh() != 0)
+    {
+        fprintf(stderr, "\033[1;31mhistory: no history file (HISTFILE is empty or HOME is not set)\033[0m\n");
+        return 1;
+    }
+
+    if (args[1] && (strcmp(args[1], "-s") == 0 || strcmp(args[1], "-p") == 0))
+    {
+        if (!args[2])
+        {
+            fprintf(stderr, "\033[1;31mhistory: %s: text expected\033[0m\n", args[1]);
+            return 2;
+        }
+        search(args[2], args[1][1] == 'p');
+        return 0;
+    }
+
+    if (args[1] && strcmp(args[1], "-i") == 0)
+    {
+        size_t lists = 0;
+        for (int i = 0; postings && i < TRIGRAM_BUCKETS; i++)
+            lists += postings[i].cap;
+        printf("%s: %zu entries, %.1f KB mapped, offsets %.1f KB, trigram index %.1f KB (%zu entries)\n", path,
+               n_entries, map_len / 1024.0, offsets_cap * sizeof(uint32_t) / 1024.0,
+               (lists + (postings ? TRIGRAM_BUCKETS * sizeof(struct posting) : 0)) / 1024.0, trigram_entries);
+        return 0;
+    }
+
+    size_t first = 0;
+    if (args[1])
+    {
+        char *end;
+        long n = strtol(args[1], &end, 10);
+        if (*end || n < 0)
+        {
+            fprintf(stderr, "\033[1;31musage: history [N | -s text | -p text | -i]\033[0m\n");
+            return 2;
+        }
+        first = ((size_t)n < n_entries) ? n_entries - n : 0;
+    }
+    for (size_t i = first; i < n_entries; i++)
+        show(i);
+    return 0;
+}
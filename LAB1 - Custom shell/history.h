@@ -0,0 +1,26 @@
+/*
+Persistent history: every command typed at the prompt (stdin a terminal) is appended
+to HISTFILE (default ~/.myshell_history, empty = no history) with one write(), once
+it is complete: a command of several lines is one entry (its newlines are stored as
+a \036 byte, so each entry is a line of the file). The file is never read at
+startup: the first history command mmap()s it, and each later one only looks at
+what was appended since (by this shell or another one).
+    history            every entry, numbered
+    history N          the last N entries
+    history -s TEXT    the entries containing TEXT
+    history -p TEXT    the entries starting with TEXT
+    history -i         the number of entries and the size of the index
+    - the entries are found through an array of line offsets into the mapping
+      (4 bytes per entry), extended with memchr() over the new bytes
+    - searches go through a trigram index built the first time one is made and
+      then kept up to date: each of 65536 buckets (trigrams hashed) lists the
+      entries containing one of its trigrams, as delta-encoded varints (about
+      a byte per entry and trigram). A search walks the shortest list among the
+      query's trigrams and checks each candidate with memmem(); queries of
+      fewer than 3 bytes scan every entry
+*/
+
+// Append a command typed at the prompt (blank ones are skipped)
+void history_add(const char *command);
+
+int handle_history(char *args[]);
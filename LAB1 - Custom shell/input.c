@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include "input.h"
+
+#define INPUT_MIN 4096
+
+void input_wait(struct input *in, int event_fd, void (*on_event)(void), void (*on_idle)(void))
+{
+    struct pollfd fds[2] = {{in->fd, POLLIN, 0}, {event_fd, POLLIN, 0}};
+    int n_fds = (event_fd >= 0) ? 2 : 1;
+
+    for (;;)
+    {
+        if (poll(fds, n_fds, -1) < 0 && errno != EINTR)
+            return;
+        if (n_fds == 2 && (fds[1].revents & POLLIN))
+        {
+            on_event();
+            if (on_idle)
+                on_idle();
+        }
+        if (fds[0].revents)
+            return;
+    }
+}
+
+char *input_read_line(struct input *in, int event_fd, void (*on_event)(void), void (*on_idle)(void))
+{
+    size_t scanned = in->start;
+
+    for (;;)
+    {
+        // (nothing new to look at: on the first call buf is still NULL)
+        char *newline = (scanned < in->len) ? memchr(in->buf + scanned, '\n', in->len - scanned) : NULL;
+        if (newline)
+        {
+            char *line = in->buf + in->start;
+            *newline = '\0';
+            in->start = newline - in->buf + 1;
+            return line;
+        }
+        scanned = in->len;
+
+        // Last line without a '\n'
+        if (in->eof)
+        {
+            if (in->start == in->len)
+                return NULL;
+            char *line = in->buf + in->start;
+            in->buf[in->len] = '\0';
+            in->start = in->len;
+            return line;
+        }
+
+        // Move the partial line to the front, grow if it fills the buffer
+        if (in->start > 0)
+        {
+            memmove(in->buf, in->buf + in->start, in->len - in->start);
+            in->len -= in->start;
+            scanned -= in->start;
+            in->start = 0;
+        }
+        if (in->len + 1 >= in->cap)
+        {
+            size_t cap = in->cap ? in->cap * 2 : INPUT_MIN;
+            char *buf = realloc(in->buf, cap);
+            if (!buf)
+                return NULL;
+            in->buf = buf;
+            in->cap = cap;
+        }
+
+        if (on_idle)
+            on_idle();
+        input_wait(in, event_fd, on_event, on_idle);
+
+        ssize_t n = read(in->fd, in->buf + in->len, in->cap - in->len - 1);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+        if (n <= 0)
+            in->eof = 1;
+        else
+            in->len += n;
+    }
+}
+
+void input_free(struct input *in)
+{
+    free(in->buf);
+    in->buf = NULL;
+    in->start = in->len = in->cap = 0;
+}
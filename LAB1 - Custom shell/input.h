@@ -0,0 +1,30 @@
+#include <stddef.h>
+
+/*
+Line reader for the shell's input, built on read() instead of stdio so the shell
+knows when it is about to block: it then waits with poll() on the input and an
+event fd (the job table's epoll fd) and runs 'on_event' whenever the event fd is ready.
+*/
+
+struct input
+{
+    int fd;
+    char *buf;
+    size_t start; // First byte not returned yet
+    size_t len;   // Bytes read into buf
+    size_t cap;
+    int eof;
+};
+
+#define INPUT_INIT(fd) {(fd), NULL, 0, 0, 0, 0}
+
+/*
+Next line without its '\n' (valid until the next call), NULL at end of input.
+'on_idle' runs once before the reader blocks, 'on_event' when 'event_fd' is readable.
+*/
+char *input_read_line(struct input *in, int event_fd, void (*on_event)(void), void (*on_idle)(void));
+
+// Wait until the input is readable, handling events meanwhile (and going idle again after each)
+void input_wait(struct input *in, int event_fd, void (*on_event)(void), void (*on_idle)(void));
+
+void input_free(struct input *in);
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include "joblog.h"
+
+#define JOBLOG_RING 256     // Records buffered before a flush is forced
+#define JOBLOG_LINE_MAX 384 // Longest formatted record
+
+static struct job_record ring[JOBLOG_RING];
+static unsigned int head = 0; // Next record to write out
+static unsigned int count = 0;
+static int log_fd = -1;
+
+int joblog_open(const char *path)
+{
+    log_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    return (log_fd < 0) ? -1 : 0;
+}
+
+void joblog_add(const struct job_record *record)
+{
+    if (count == JOBLOG_RING)
+        joblog_flush();
+    ring[(head + count) % JOBLOG_RING] = *record;
+    count++;
+}
+
+static double seconds(struct timeval tv)
+{
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static const char *const kind_names[] = {"child", "fg", "bg", "time"};
+
+// key=value record for the accounting kinds (the command is quoted, so '"' and newlines become spaces)
+static int format_acct(char *line, const struct job_record *r)
+{
+    char command[sizeof(r->command)];
+    size_t i;
+    for (i = 0; r->command[i] && i < sizeof(command) - 1; i++)
+        command[i] = (r->command[i] == '"' || r->command[i] == '\n') ? ' ' : r->command[i];
+    command[i] = '\0';
+
+    int n = snprintf(line, JOBLOG_LINE_MAX,
+                     "acct kind=%s status=%d real=%.6f user=%.6f sys=%.6f maxrss_kb=%ld minflt=%ld majflt=%ld"
+                     " nvcsw=%ld nivcsw=%ld procs=%d command=\"%s\"\n",
+                     kind_names[r->kind], r->status, r->real.tv_sec + r->real.tv_nsec / 1e9,
+                     seconds(r->usage.ru_utime), seconds(r->usage.ru_stime), r->usage.ru_maxrss,
+                     r->usage.ru_minflt, r->usage.ru_majflt, r->usage.ru_nvcsw, r->usage.ru_nivcsw,
+                     r->n_procs, command);
+    return (n < JOBLOG_LINE_MAX) ? n : JOBLOG_LINE_MAX - 1;
+}
+
+static int format_record(char *line, const struct job_record *r)
+{
+    char how[32];
+    if (r->kind != RECORD_CHILD)
+        return format_acct(line, r);
+
+    if (WIFEXITED(r->status))
+        snprintf(how, sizeof(how), "exit %d", WEXITSTATUS(r->status));
+    else
+        snprintf(how, sizeof(how), "signal %d", WTERMSIG(r->status));
+
+    int n = snprintf(line, JOBLOG_LINE_MAX,
+                     "Child process %d (%s) was terminated: %s, real %.3fs, user %.3fs, sys %.3fs, maxrss %ldKB,"
+                     " faults %ld/%ld, context switches %ld/%ld\n",
+                     r->pid, r->command, how, r->real.tv_sec + r->real.tv_nsec / 1e9,
+                     seconds(r->usage.ru_utime), seconds(r->usage.ru_stime), r->usage.ru_maxrss,
+                     r->usage.ru_minflt, r->usage.ru_majflt, r->usage.ru_nvcsw, r->usage.ru_nivcsw);
+    return (n < JOBLOG_LINE_MAX) ? n : JOBLOG_LINE_MAX - 1;
+}
+
+void joblog_flush(void)
+{
+    static char batch[JOBLOG_RING * JOBLOG_LINE_MAX];
+    size_t len = 0;
+
+    if (count == 0)
+        return;
+
+    // Format the whole ring into one buffer, then one write()
+    for (; count > 0; count--, head = (head + 1) % JOBLOG_RING)
+        len += format_record(batch + len, &ring[head]);
+
+    for (size_t off = 0; log_fd >= 0 && off < len;)
+    {
+        ssize_t w = write(log_fd, batch + off, len - off);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            break;
+        off += w;
+    }
+}
+
+void joblog_close(void)
+{
+    joblog_flush();
+    if (log_fd >= 0)
+        close(log_fd);
+    log_fd = -1;
+}
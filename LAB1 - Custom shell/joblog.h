@@ -0,0 +1,41 @@
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <time.h>
+
+/*
+Log of the children MyShell reaped (myshell.log), and of the accounting
+records (acct.c): "time" and, with ACCOUNTING=1, every foreground and background job.
+Records go into an in-memory ring and the shell writes them out in batches:
+when the ring is full, before it sits waiting for input, and on exit.
+The file stays open, so a batch costs one write() however many jobs it holds.
+*/
+
+enum record_kind
+{
+    RECORD_CHILD, // "Child process ... was terminated: ..."
+    RECORD_FG,    // The rest are "acct kind=... key=value ..." lines
+    RECORD_BG,
+    RECORD_TIME,
+};
+
+struct job_record
+{
+    enum record_kind kind;
+    pid_t pid;
+    int status;            // Children: as returned by wait4(), jobs: the exit status
+    struct timespec real;  // Wall time from launch to reap (0 if the launch wasn't seen)
+    struct rusage usage;
+    int n_procs;           // Processes a job waited for
+    char command[64];      // Children: argv[0], jobs: the command line (truncated)
+};
+
+// Open (append) the log file, returns -1 if it can't be opened (records are then dropped)
+int joblog_open(const char *path);
+
+void joblog_add(const struct job_record *record);
+
+// Write every buffered record
+void joblog_flush(void);
+
+void joblog_close(void);
@@ -0,0 +1,107 @@
+/*
+    Measures the job table (jobs.c): how many background jobs per second the shell
+    can launch and reap, and how long waiting for one quick job takes while
+    thousands of other jobs keep running (it should not depend on their number).
+
+    To build:
+    make jobs-bench
+
+    To run:
+    ./jobs-bench [jobs] [sleepers]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include "spawn.h"
+#include "vars.h"
+#include "jobs.h"
+#include "joblog.h"
+
+#define WAVE 500       // Jobs in flight at once during the throughput run
+#define QUICK_WAITS 200
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Start 'argv' as a one-process background job, returns its id
+static int launch(char *argv[])
+{
+    int id = job_start(argv[0], 1);
+    if (id < 0)
+    {
+        fprintf(stderr, "job_start failed\n");
+        exit(1);
+    }
+    pid_t pid = spawn_command_in_group(argv, -1, -1, -1, 0);
+    if (pid < 0)
+    {
+        perror(argv[0]);
+        exit(1);
+    }
+    job_add_process(id, pid, argv[0]);
+    return id;
+}
+
+// Average microseconds to launch one quick job and wait for it
+static double quick_wait(char *argv[])
+{
+    double start = now_us();
+    for (int i = 0; i < QUICK_WAITS; i++)
+        jobs_wait(launch(argv));
+    return (now_us() - start) / QUICK_WAITS;
+}
+
+int main(int argc, char *argv[])
+{
+    int n_jobs = (argc > 1) ? atoi(argv[1]) : 10000;
+    int n_sleepers = (argc > 2) ? atoi(argv[2]) : 2000;
+    char *quick[] = {"true", NULL};
+    char *slow[] = {"sleep", "60", NULL};
+
+    vars_init();
+    if (jobs_init() < 0)
+    {
+        perror("epoll_create1");
+        return 1;
+    }
+    joblog_open("/dev/null");
+
+    // Throughput: launch in waves, reaping whatever exited as the shell's main loop would
+    double start = now_us();
+    for (int done = 0; done < n_jobs; done += WAVE)
+    {
+        for (int i = done; i < n_jobs && i < done + WAVE; i++)
+            launch(quick);
+        jobs_reap();
+        jobs_wait(0);
+        joblog_flush();
+    }
+    double elapsed = (now_us() - start) / 1e6;
+    printf("%d jobs launched and reaped in %.2fs: %.0f jobs/s\n", n_jobs, elapsed, n_jobs / elapsed);
+
+    // Waiting for one job: alone, then among 'n_sleepers' jobs that don't exit
+    double alone = quick_wait(quick);
+
+    int *sleepers = malloc(n_sleepers * sizeof(int));
+    for (int i = 0; i < n_sleepers; i++)
+        sleepers[i] = launch(slow);
+    double crowded = quick_wait(quick);
+    joblog_flush();
+
+    printf("%8s %16s\n", "running", "launch+wait(us)");
+    printf("%8d %16.1f\n", 0, alone);
+    printf("%8d %16.1f\n", n_sleepers, crowded);
+
+    for (int i = 0; i < n_sleepers; i++)
+        kill(-job_pgid(sleepers[i]), SIGKILL);
+    jobs_wait(0);
+    joblog_close();
+    free(sleepers);
+    return 0;
+}
@@ -0,0 +1,592 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "jobs.h"
+#include "joblog.h"
+#include "acct.h"
+#include "trace.h"
+
+#define JOBS_MIN 64      // Initial size of the job table
+#define REAP_BATCH 256   // Events taken per epoll_wait()
+#define UNTRACKED_POLL_MS 10
+#define STOP_POLL_MS 100 // A stop doesn't wake a pidfd: how long wait sleeps before looking for one
+
+enum job_state
+{
+    JOB_FREE,
+    JOB_RUNNING,
+    JOB_STOPPED,
+};
+
+struct job_proc
+{
+    pid_t pid;   // -1 = couldn't be started
+    int pidfd;   // -1 = no pidfd (polled with WNOHANG instead)
+    int done;
+    char name[24];
+    struct timespec start;
+};
+
+struct job
+{
+    enum job_state state;
+    char command[JOB_COMMAND_MAX];
+    pid_t pgid;
+    int n_procs; // Processes added so far
+    int max_procs;
+    int live;    // Processes not reaped yet
+    int status;  // Exit code of the rightmost process that failed
+    int fail_stage;
+    struct timespec start;   // First process started
+    struct rusage usage;     // Of the processes reaped so far (ACCOUNTING)
+    struct job_proc *procs;
+    int next_free; // Free list link (ids are reused)
+};
+
+static struct job *jobs = NULL; // Indexed by id, jobs[0] is never used
+static int jobs_size = 0;
+static int free_head = 0; // 0 = no free id
+static int highest = 0;   // Highest id in use
+static int n_jobs = 0;
+static int current = 0;   // Most recent job: the default for fg / bg
+static int epoll_fd = -1;
+static int untracked = 0; // Live processes without a pidfd
+static int waiting = 0;   // fg / wait is running: what it reaps counts for the command (time fg)
+static int forgetting = 0; // Script mode: finished jobs are freed unreported
+
+// The job exists and has processes still running or stopped
+#define JOB_LIVE(j) ((j)->state != JOB_FREE && (j)->live > 0)
+
+static int grow_jobs(void)
+{
+    int new_size = jobs_size ? jobs_size * 2 : JOBS_MIN;
+    struct job *table = realloc(jobs, new_size * sizeof(struct job));
+    if (!table)
+        return -1;
+
+    // New ids go on the free list lowest first (id 0 stays unused)
+    for (int id = new_size - 1; id >= (jobs_size ? jobs_size : 1); id--)
+    {
+        memset(&table[id], 0, sizeof(struct job));
+        table[id].next_free = free_head;
+        free_head = id;
+    }
+    jobs = table;
+    jobs_size = new_size;
+    return 0;
+}
+
+static void free_job(int id)
+{
+    struct job *j = &jobs[id];
+    free(j->procs);
+    memset(j, 0, sizeof(struct job));
+    j->next_free = free_head;
+    free_head = id;
+    n_jobs--;
+
+    while (highest > 0 && jobs[highest].state == JOB_FREE)
+        highest--;
+    if (current == id)
+        current = highest;
+}
+
+int jobs_init(void)
+{
+    // Every background process holds a pidfd, so allow as many fds as the hard limit does
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    // fg hands the terminal to a job and takes it back, which a background process group can't do
+    if (isatty(STDIN_FILENO))
+        signal(SIGTTOU, SIG_IGN);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    return epoll_fd;
+}
+
+// Free the jobs whose processes were all reaped (nobody will report them as Done)
+static void forget_finished(void)
+{
+    for (int id = 1; id <= highest; id++)
+    {
+        struct job *j = &jobs[id];
+        if (j->state != JOB_FREE && j->live == 0 && j->n_procs == j->max_procs)
+            free_job(id);
+    }
+}
+
+void jobs_forget_finished(void)
+{
+    forgetting = 1;
+}
+
+int job_start(const char *command, int n_procs)
+{
+    // Reap what exited since the last job: a loop starting jobs doesn't pile up zombies and pidfds
+    jobs_reap();
+    if (forgetting)
+        forget_finished();
+
+    if (!free_head && grow_jobs() != 0)
+        return -1;
+
+    int id = free_head;
+    struct job *j = &jobs[id];
+    free_head = j->next_free;
+
+    memset(j, 0, sizeof(struct job));
+    j->procs = calloc(n_procs, sizeof(struct job_proc));
+    if (!j->procs)
+    {
+        j->next_free = free_head;
+        free_head = id;
+        return -1;
+    }
+    j->state = JOB_RUNNING;
+    j->max_procs = n_procs;
+    j->fail_stage = -1;
+    snprintf(j->command, sizeof(j->command), "%s", command);
+
+    n_jobs++;
+    if (id > highest)
+        highest = id;
+    current = id;
+    return id;
+}
+
+pid_t job_pgid(int id)
+{
+    return jobs[id].pgid;
+}
+
+// pipefail: the rightmost process that failed gives the job its status
+static void record_status(struct job *j, int stage, int code)
+{
+    if (code != 0 && stage > j->fail_stage)
+    {
+        j->status = code;
+        j->fail_stage = stage;
+    }
+}
+
+void job_add_process(int id, pid_t pid, const char *name)
+{
+    struct job *j = &jobs[id];
+    if (j->n_procs == j->max_procs)
+        return;
+
+    int stage = j->n_procs++;
+    struct job_proc *p = &j->procs[stage];
+    p->pid = pid;
+    p->pidfd = -1;
+    snprintf(p->name, sizeof(p->name), "%s", name);
+    clock_gettime(CLOCK_MONOTONIC, &p->start);
+    if (stage == 0)
+        j->start = p->start;
+
+    // A stage that couldn't be started counts as "command not found"
+    if (pid < 0)
+    {
+        p->done = 1;
+        record_status(j, stage, 127);
+        return;
+    }
+
+    j->live++;
+    if (!j->pgid)
+        j->pgid = pid;
+
+    // The pidfd becomes readable when the process exits: epoll hands back (id, stage)
+    p->pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (p->pidfd >= 0)
+    {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = ((unsigned long long)id << 32) | (unsigned int)stage;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, p->pidfd, &ev) == 0)
+            return;
+        close(p->pidfd);
+        p->pidfd = -1;
+    }
+    untracked++;
+}
+
+// ACCOUNTING: one "acct kind=bg" record for the whole job once its last process is reaped
+static void log_job(struct job *j, const struct timespec *now)
+{
+    struct job_record record;
+    long ns = (now->tv_sec - j->start.tv_sec) * 1000000000L + (now->tv_nsec - j->start.tv_nsec);
+
+    memset(&record, 0, sizeof(record));
+    record.kind = RECORD_BG;
+    record.pid = j->pgid;
+    record.status = j->status;
+    record.real.tv_sec = ns / 1000000000L;
+    record.real.tv_nsec = ns % 1000000000L;
+    record.usage = j->usage;
+    record.n_procs = j->n_procs;
+    snprintf(record.command, sizeof(record.command), "%s", j->command);
+    joblog_add(&record);
+}
+
+// The process was reaped: log it and update its job
+static void finish_process(struct job *j, int stage, int status, struct rusage *usage)
+{
+    struct job_proc *p = &j->procs[stage];
+    struct job_record record;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long ns = (now.tv_sec - p->start.tv_sec) * 1000000000L + (now.tv_nsec - p->start.tv_nsec);
+
+    memset(&record, 0, sizeof(record));
+    record.pid = p->pid;
+    record.status = status;
+    record.real.tv_sec = ns / 1000000000L;
+    record.real.tv_nsec = ns % 1000000000L;
+    record.usage = *usage;
+    snprintf(record.command, sizeof(record.command), "%s", p->name);
+    joblog_add(&record);
+
+    /*
+    Take the pidfd out of the epoll set before closing it: closing alone isn't enough
+    when a forked builtin (pipeline stage) inherited a copy of it.
+    */
+    if (p->pidfd >= 0)
+    {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, p->pidfd, NULL);
+        close(p->pidfd);
+    }
+    else
+        untracked--;
+    p->pidfd = -1;
+    p->done = 1;
+    j->live--;
+
+    record_status(j, stage, WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+    if (waiting)
+        acct_child(usage);
+    if (acct_enabled())
+    {
+        acct_add_usage(&j->usage, usage);
+        if (j->live == 0 && j->n_procs == j->max_procs)
+            log_job(j, &now);
+    }
+    if (j->live == 0)
+        j->state = JOB_RUNNING; // Not stopped anymore, just finished
+}
+
+/*
+wait4() one process of a job with 'flags' (WNOHANG, WUNTRACED, ...).
+Returns 1 if it changed state (exited, stopped or continued), 0 otherwise.
+*/
+static int reap_process(int id, int stage, int flags)
+{
+    struct job *j = &jobs[id];
+    struct job_proc *p = &j->procs[stage];
+    struct rusage usage;
+    int status;
+
+    if (p->done)
+        return 0;
+
+    pid_t pid;
+    do
+        pid = wait4(p->pid, &status, flags, &usage);
+    while (pid < 0 && errno == EINTR);
+
+    if (pid == 0)
+        return 0;
+    if (pid < 0)
+    {
+        // Somebody else reaped it, nothing to log
+        memset(&usage, 0, sizeof(usage));
+        status = 0;
+    }
+    else if (WIFSTOPPED(status))
+    {
+        j->state = JOB_STOPPED;
+        return 1;
+    }
+    else if (WIFCONTINUED(status))
+    {
+        j->state = JOB_RUNNING;
+        return 1;
+    }
+    finish_process(j, stage, status, &usage);
+    return 1;
+}
+
+// Processes that got no pidfd are checked one by one (only when there are any)
+static void reap_untracked(void)
+{
+    for (int id = 1; untracked > 0 && id <= highest; id++)
+    {
+        struct job *j = &jobs[id];
+        for (int s = 0; JOB_LIVE(j) && s < j->n_procs; s++)
+        {
+            if (j->procs[s].pidfd < 0)
+                reap_process(id, s, WNOHANG);
+        }
+    }
+}
+
+// Handle up to REAP_BATCH exits, waiting up to 'timeout_ms' for the first one, returns how many
+static int reap_ready(int timeout_ms)
+{
+    struct epoll_event events[REAP_BATCH];
+    int n = epoll_wait(epoll_fd, events, REAP_BATCH, timeout_ms);
+
+    for (int i = 0; i < n; i++)
+    {
+        int id = events[i].data.u64 >> 32;
+        int stage = events[i].data.u64 & 0xffffffffu;
+        if (id <= highest && stage < jobs[id].n_procs)
+            reap_process(id, stage, WNOHANG);
+    }
+    return n;
+}
+
+void jobs_reap(void)
+{
+    long long span = TRACE_BEGIN();
+    while (reap_ready(0) == REAP_BATCH)
+        ;
+    if (untracked > 0)
+        reap_untracked();
+    TRACE_END(TRACE_REAP, span, NULL);
+}
+
+// "[id]  Done ..." / "[id]  Exit N ..." for a finished job, which is then freed
+static void report_finished(int id)
+{
+    struct job *j = &jobs[id];
+    if (j->status == 0)
+        printf("[%d]  Done\t\t%s\n", id, j->command);
+    else
+        printf("[%d]  Exit %d\t\t%s\n", id, j->status, j->command);
+    free_job(id);
+}
+
+void jobs_notify(void)
+{
+    if (untracked > 0)
+        reap_untracked();
+
+    for (int id = 1; id <= highest; id++)
+    {
+        struct job *j = &jobs[id];
+        if (j->state == JOB_FREE || j->live > 0 || j->n_procs < j->max_procs)
+            continue;
+        report_finished(id);
+    }
+}
+
+// Stops and continues don't wake the pidfd: ask wait4() about job 'id' (0 = every job)
+static void check_stops(int id)
+{
+    for (int i = id ? id : 1; i <= (id ? id : highest); i++)
+    {
+        struct job *j = &jobs[i];
+        for (int s = 0; JOB_LIVE(j) && s < j->n_procs; s++)
+            reap_process(i, s, WNOHANG | WUNTRACED | WCONTINUED);
+    }
+}
+
+/*
+Block until 'done' says so, reaping every exit that comes in meanwhile. Stops are
+looked for before the first wait and whenever STOP_POLL_MS go by without an exit,
+not after every batch of exits (that would be a wait4() per job each time).
+*/
+static void wait_until(int (*done)(int), int id)
+{
+    int quiet = 1;
+    while (1)
+    {
+        if (quiet)
+            check_stops(id);
+        if (done(id))
+            break;
+
+        int n = reap_ready(untracked > 0 ? UNTRACKED_POLL_MS : STOP_POLL_MS);
+        if (n < 0 && errno != EINTR)
+            break;
+        quiet = (n == 0);
+        if (untracked > 0)
+            reap_untracked();
+    }
+}
+
+static int job_settled(int id)
+{
+    return !JOB_LIVE(&jobs[id]) || jobs[id].state == JOB_STOPPED;
+}
+
+static int all_settled(int id)
+{
+    for (int i = 1; i <= highest; i++)
+    {
+        if (JOB_LIVE(&jobs[i]) && jobs[i].state != JOB_STOPPED)
+            return 0;
+    }
+    return 1;
+}
+
+int jobs_wait(int id)
+{
+    if (id == 0)
+    {
+        wait_until(all_settled, 0);
+
+        // The caller asked for them, so finished jobs aren't reported as Done later
+        for (int i = 1; i <= highest; i++)
+        {
+            if (jobs[i].state != JOB_FREE && !JOB_LIVE(&jobs[i]))
+                free_job(i);
+        }
+        return 0;
+    }
+
+    wait_until(job_settled, id);
+    if (jobs[id].state == JOB_STOPPED)
+        return 128 + SIGTSTP;
+
+    int status = jobs[id].status;
+    free_job(id);
+    return status;
+}
+
+int jobs_count(void)
+{
+    return n_jobs;
+}
+
+// "%3" -> 3, "" / NULL -> the current job, 0 if there is no such job
+static int parse_job(const char *arg, const char *builtin)
+{
+    int id = current;
+    if (arg)
+        id = atoi(arg[0] == '%' ? arg + 1 : arg);
+
+    if (id <= 0 || id > highest || jobs[id].state == JOB_FREE)
+    {
+        fprintf(stderr, "\033[1;31m%s: %s: no such job\033[0m\n", builtin, arg ? arg : "current");
+        return 0;
+    }
+    return id;
+}
+
+int handle_jobs(char *args[])
+{
+    for (int id = 1; id <= highest; id++)
+    {
+        struct job *j = &jobs[id];
+        if (j->state == JOB_FREE)
+            continue;
+
+        check_stops(id);
+
+        if (j->live == 0)
+            report_finished(id);
+        else
+            printf("[%d]%c %-8s\t%s\n", id, (id == current) ? '+' : ' ',
+                   (j->state == JOB_STOPPED) ? "Stopped" : "Running", j->command);
+    }
+    return 0;
+}
+
+int handle_wait(char *args[])
+{
+    int status = 0;
+    waiting = 1;
+    if (!args[1])
+        status = jobs_wait(0);
+
+    for (int i = 1; args[i]; i++)
+    {
+        int id = 0;
+        if (args[i][0] == '%')
+            id = parse_job(args[i], "wait");
+        else
+        {
+            // A pid: find the job it belongs to
+            pid_t pid = atoi(args[i]);
+            for (int j = 1; !id && j <= highest; j++)
+            {
+                for (int s = 0; jobs[j].state != JOB_FREE && s < jobs[j].n_procs; s++)
+                {
+                    if (jobs[j].procs[s].pid == pid)
+                        id = j;
+                }
+            }
+            if (!id)
+                fprintf(stderr, "\033[1;31mwait: pid %s is not a child of this shell\033[0m\n", args[i]);
+        }
+        status = id ? jobs_wait(id) : 127;
+    }
+    waiting = 0;
+    return status;
+}
+
+int handle_fg(char *args[])
+{
+    int id = parse_job(args[1], "fg");
+    if (!id)
+        return 1;
+
+    struct job *j = &jobs[id];
+    printf("%s\n", j->command);
+    fflush(stdout);
+
+    // Give the job the terminal, wake it up and wait for it like a foreground command
+    int interactive = isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp();
+    if (interactive && j->pgid > 0)
+        tcsetpgrp(STDIN_FILENO, j->pgid);
+    if (j->pgid > 0)
+        kill(-j->pgid, SIGCONT);
+    j->state = JOB_RUNNING;
+
+    waiting = 1;
+    for (int s = 0; s < j->n_procs && j->state != JOB_STOPPED; s++)
+        reap_process(id, s, WUNTRACED);
+    waiting = 0;
+
+    if (interactive)
+        tcsetpgrp(STDIN_FILENO, getpgrp());
+
+    if (j->state == JOB_STOPPED)
+    {
+        printf("\n[%d]+  Stopped\t\t%s\n", id, j->command);
+        return 128 + SIGTSTP;
+    }
+    int status = j->status;
+    free_job(id);
+    return status;
+}
+
+int handle_bg(char *args[])
+{
+    int id = parse_job(args[1], "bg");
+    if (!id)
+        return 1;
+
+    struct job *j = &jobs[id];
+    if (j->pgid > 0)
+        kill(-j->pgid, SIGCONT);
+    j->state = JOB_RUNNING;
+    printf("[%d]+ %s &\n", id, j->command);
+    return 0;
+}
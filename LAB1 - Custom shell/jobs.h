@@ -0,0 +1,57 @@
+#include <sys/types.h>
+
+/*
+Job table: every background command or pipeline is a job with a small id (%1, %2, ...).
+    - each process of a job has a pidfd registered in one epoll set, so reaping
+      and waiting only ever look at the processes that actually exited (O(ready)),
+      whatever the number of jobs running
+    - the epoll fd is what the main loop polls while it waits for input
+    - a job's memory is fixed: a bounded command string and one entry per process;
+      finished jobs are freed once they have been reported
+    - every reaped process is logged (joblog.c)
+*/
+
+#define JOB_COMMAND_MAX 64
+
+// Set up the epoll set, returns its fd (-1 on error)
+int jobs_init(void);
+
+/*
+New job for 'command' with room for 'n_procs' processes, returns its id (-1 on error).
+What exited since the last job is reaped first (without blocking), so a script
+starting jobs in a loop never holds more zombies and pidfds than jobs still running.
+*/
+int job_start(const char *command, int n_procs);
+
+/*
+Script mode: no prompt ever reports "Done", so job_start() frees the jobs that
+finished instead (a "wait %n" for one of them then finds no such job).
+*/
+void jobs_forget_finished(void);
+
+// Process group for the job's next process (0 until its first process is added: lead a new group)
+pid_t job_pgid(int id);
+
+// Add a started process ('name' = its argv[0])
+void job_add_process(int id, pid_t pid, const char *name);
+
+// Reap whatever exited, without blocking (call when the epoll fd is readable)
+void jobs_reap(void);
+
+// Print "[id] Done ..." for the jobs that finished since the last call and free them
+void jobs_notify(void);
+
+/*
+Wait for job 'id' (0 = every job) to finish, reaping the others that finish meanwhile.
+Returns the job's exit status (pipefail: the rightmost failed process decides).
+*/
+int jobs_wait(int id);
+
+// Jobs not reported yet
+int jobs_count(void);
+
+// jobs, wait [%id|pid...], fg [%id], bg [%id]
+int handle_jobs(char *args[]);
+int handle_wait(char *args[]);
+int handle_fg(char *args[]);
+int handle_bg(char *args[]);
@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lexer.h"
+
+#define TOKENS_MIN 16
+
+/*
+Where the lexer is in the line. A word is NUL-terminated right where it ends,
+which can be on top of the operator that follows it ("ls|wc"), so that char is
+kept in 'held' until it has been read.
+*/
+struct lexer
+{
+    char *p;
+    char held;
+};
+
+static char current(struct lexer *lx)
+{
+    return lx->held ? lx->held : *lx->p;
+}
+
+static void advance(struct lexer *lx, int n)
+{
+    lx->held = 0;
+    lx->p += n;
+}
+
+static int is_blank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static int is_operator(char c)
+{
+    return c == '|' || c == '&' || c == ';' || c == '<' || c == '>' || c == '(' || c == ')' || c == '\n';
+}
+
+// Read the operator at the current position into 't'
+static void lex_operator(struct lexer *lx, struct token *t)
+{
+    char c = current(lx), next = lx->p[1];
+
+    switch (c)
+    {
+    case '|':
+        t->type = (next == '|') ? TOK_OR : TOK_PIPE;
+        break;
+    case '&':
+        t->type = (next == '&') ? TOK_AND : TOK_AMP;
+        break;
+    case ';':
+        t->type = TOK_SEMI;
+        break;
+    case '\n':
+        t->type = TOK_NEWLINE;
+        break;
+    case '(':
+        t->type = TOK_LPAREN;
+        break;
+    case ')':
+        t->type = TOK_RPAREN;
+        break;
+    case '<':
+        t->type = TOK_LESS;
+        if (t->fd < 0)
+            t->fd = 0;
+        break;
+    default: // '>'
+        t->type = (next == '>') ? TOK_DGREAT : TOK_GREAT;
+        if (t->fd < 0)
+            t->fd = 1;
+        break;
+    }
+    advance(lx, (t->type == TOK_OR || t->type == TOK_AND || t->type == TOK_DGREAT) ? 2 : 1);
+}
+
+size_t command_subst_length(const char *s)
+{
+    const char *p = s + 2;
+    int depth = 1;
+    char quote = 0;
+
+    for (; *p; p++)
+    {
+        if (quote == '\'')
+        {
+            if (*p == '\'')
+                quote = 0;
+            continue;
+        }
+        if (*p == '\\')
+        {
+            if (!p[1])
+                return 0;
+            p++;
+            continue;
+        }
+        if (quote == '"')
+        {
+            if (*p == '"')
+                quote = 0;
+            else if (*p == '$' && p[1] == '(')
+            {
+                // "...$(...)..." inside: its own quotes don't end ours
+                size_t n = command_subst_length(p);
+                if (n == 0)
+                    return 0;
+                p += n - 1;
+            }
+            continue;
+        }
+
+        if (*p == '\'' || *p == '"')
+            quote = *p;
+        else if (*p == '(')
+            depth++;
+        else if (*p == ')' && --depth == 0)
+            return p + 1 - s;
+    }
+    return 0;
+}
+
+/*
+Read a word, removing quotes and backslashes as it goes. The reader (r) is always
+at or ahead of the writer (w), so the word is rewritten in place.
+*/
+static int lex_word(struct lexer *lx, struct token *t)
+{
+    char *start = lx->p, *r = lx->p, *w = lx->p;
+    char quote = 0;
+
+    for (;;)
+    {
+        char c = *r;
+
+        if (c == '\0' && quote)
+        {
+            fprintf(stderr, "\033[1;31mMyShell: syntax error: unterminated %c\033[0m\n", quote);
+            return -1;
+        }
+
+        // '...': everything is literal up to the closing quote
+        if (quote == '\'')
+        {
+            if (c == '\'')
+                quote = 0;
+            else if (c == '$')
+            {
+                *w++ = LITERAL_DOLLAR;
+                t->flags |= WORD_LITERAL;
+            }
+            else
+                *w++ = c;
+            r++;
+            continue;
+        }
+
+        // Unquoted, a blank or an operator ends the word
+        if (!quote && (c == '\0' || is_blank(c) || is_operator(c)))
+            break;
+
+        if (c == quote || (!quote && (c == '\'' || c == '"')))
+        {
+            quote = (c == quote) ? 0 : c;
+            r++;
+            continue;
+        }
+
+        // Outside quotes '\' escapes anything, in "..." only $ " \ ` and newline
+        if (c == '\\' && r[1] && (!quote || strchr("$\"\\`\n", r[1])))
+        {
+            if (r[1] == '$')
+            {
+                *w++ = LITERAL_DOLLAR;
+                t->flags |= WORD_LITERAL;
+            }
+            else if (r[1] != '\n') // Backslash-newline joins the lines
+                *w++ = r[1];
+            r += 2;
+            continue;
+        }
+
+        // $(command) is kept as it is written: it is lexed again when it runs
+        if (c == '$' && r[1] == '(')
+        {
+            size_t n = command_subst_length(r);
+            if (n == 0)
+            {
+                fprintf(stderr, "\033[1;31mMyShell: syntax error: unterminated $(\033[0m\n");
+                return -1;
+            }
+            memmove(w, r, n);
+            w += n;
+            r += n;
+            t->flags |= WORD_EXPAND;
+            continue;
+        }
+
+        // $? $* ${?} are parameters, not wildcards
+        int parameter = (w > start && w[-1] == '$') || (w - start >= 2 && w[-1] == '{' && w[-2] == '$');
+        if (!quote && (c == '*' || c == '?' || c == '[') && !(parameter && c != '['))
+        {
+            *w++ = (c == '*') ? GLOB_STAR : (c == '?') ? GLOB_ANY : GLOB_BRACKET;
+            t->flags |= WORD_GLOB;
+            r++;
+            continue;
+        }
+
+        if (c == '$')
+            t->flags |= WORD_EXPAND;
+        *w++ = c;
+        r++;
+    }
+
+    t->type = TOK_WORD;
+    t->text = start;
+    t->len = w - start;
+
+    lx->p = r;
+    lx->held = *r;
+    *w = '\0';
+    return 0;
+}
+
+int lex(struct arena *a, char *input, struct token **tokens)
+{
+    struct lexer lx = {input, 0};
+    size_t cap = TOKENS_MIN;
+    int n = 0;
+    struct token *toks = arena_alloc(a, cap * sizeof(struct token));
+
+    for (;;)
+    {
+        while (is_blank(current(&lx)))
+            advance(&lx, 1);
+
+        // Comment up to the end of the line
+        if (current(&lx) == '#')
+        {
+            char *eol = strchr(lx.p, '\n');
+            advance(&lx, eol ? eol - lx.p : (long)strlen(lx.p));
+        }
+        if (current(&lx) == '\0')
+            break;
+
+        // Room for this token and TOK_END (words don't allocate, so this grows in place)
+        if ((size_t)n + 2 > cap)
+        {
+            toks = arena_grow(a, toks, cap * sizeof(struct token), cap * 2 * sizeof(struct token));
+            cap *= 2;
+        }
+
+        struct token *t = &toks[n++];
+        memset(t, 0, sizeof(struct token));
+        t->fd = -1;
+
+        // "2>" / "10<": a number glued to a redirection is the fd it redirects
+        char *q = lx.p;
+        while (!lx.held && *q >= '0' && *q <= '9')
+            q++;
+        if (q > lx.p && (*q == '<' || *q == '>'))
+        {
+            t->fd = atoi(lx.p);
+            advance(&lx, q - lx.p);
+        }
+
+        if (is_operator(current(&lx)))
+            lex_operator(&lx, t);
+        else if (lex_word(&lx, t) != 0)
+            return -1;
+    }
+
+    memset(&toks[n], 0, sizeof(struct token));
+    toks[n].type = TOK_END;
+    toks[n].fd = -1;
+    *tokens = toks;
+    return n;
+}
+
+const char *token_name(const struct token *t)
+{
+    static const char *names[] = {"word", "|", "||", "&", "&&", ";", "(", ")", "<", ">", ">>", "newline", "newline"};
+    return (t->type == TOK_WORD) ? t->text : names[t->type];
+}
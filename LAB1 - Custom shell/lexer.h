@@ -0,0 +1,66 @@
+#include <stddef.h>
+#include "arena.h"
+
+/*
+Single-pass lexer for one command line or a whole script.
+    - words are slices of the input: quotes and escapes are removed in place
+      (the unquoted word is never longer than the quoted one) and the word is
+      NUL-terminated where it ends, so no word is ever copied
+    - the token array comes from the arena, nothing is malloc()ed per token
+    - a '$' that must stay literal ('$x', "\$x", \$x) is stored as LITERAL_DOLLAR,
+      expand_variables() turns it back into '$' (so the word keeps its length)
+    - a $(command) inside a word is left exactly as written, quotes and all
+    - an unquoted * ? [ is stored as GLOB_STAR / GLOB_ANY / GLOB_BRACKET, so a
+      pattern can tell it from a quoted one (expand_variables() puts it back too)
+*/
+
+#define LITERAL_DOLLAR '\001'
+#define GLOB_STAR '\002'
+#define GLOB_ANY '\003'
+#define GLOB_BRACKET '\004'
+
+enum token_type
+{
+    TOK_WORD,
+    TOK_PIPE,   // |
+    TOK_OR,     // ||
+    TOK_AMP,    // &
+    TOK_AND,    // &&
+    TOK_SEMI,   // ;
+    TOK_LPAREN, // (
+    TOK_RPAREN, // )
+    TOK_LESS,   // [n]<
+    TOK_GREAT,  // [n]>
+    TOK_DGREAT, // [n]>>
+    TOK_NEWLINE, // Ends a command in a script (or a line joined to an unfinished one)
+    TOK_END     // End of the input (always the last token)
+};
+
+#define WORD_EXPAND 1  // Has a '$' to expand
+#define WORD_LITERAL 2 // Has a LITERAL_DOLLAR to put back
+#define WORD_GLOB 4    // Has a GLOB_* wildcard: a file name pattern
+
+struct token
+{
+    enum token_type type;
+    int flags; // WORD_* for words
+    int fd;    // Redirected fd for TOK_LESS / TOK_GREAT / TOK_DGREAT ("2>" = 2)
+    char *text; // Words: the NUL-terminated word, operators: NULL
+    size_t len;
+};
+
+/*
+Split 'input' (modified in place) into tokens ending with TOK_END.
+Returns the number of tokens before TOK_END, or -1 (after printing why) on an
+unterminated quote.
+*/
+int lex(struct arena *a, char *input, struct token **tokens);
+
+/*
+Length of the "$(...)" at 's', up to and including the ')' that closes it (0 if none does).
+Quotes, escapes and nested parentheses inside are skipped over, not removed.
+*/
+size_t command_subst_length(const char *s);
+
+// How an operator is written ("|", ">>", ...) for error messages
+const char *token_name(const struct token *t);
@@ -0,0 +1,464 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include "lineedit.h"
+#include "input.h"
+#include "complete.h"
+#include "arena.h"
+
+#define ESCAPE_WAIT_MS 50 // How long the rest of an escape sequence may take to arrive
+#define KEYS_BUF 4096     // Bytes read from the terminal at once (a paste comes in big reads)
+
+#define CTRL_KEY(c) ((c) & 0x1f)
+#define KEY_DELETE 256 // Not a byte: the Delete key's escape sequence
+
+// The line being edited (its bytes are the input's buffer, so it is returned as it is)
+struct edit
+{
+    struct input *in;
+    size_t len;
+    size_t pos; // Cursor
+    const char *prompt;
+    size_t prompt_width;
+};
+
+// What was read from the terminal and not used yet (a paste of several lines, the rest of a sequence)
+static char keys[KEYS_BUF];
+static size_t keys_start = 0, keys_len = 0;
+
+// Screen update being put together
+static char *out = NULL;
+static size_t out_len = 0, out_cap = 0;
+
+int lineedit_usable(int fd)
+{
+    const char *term = getenv("TERM");
+    return isatty(fd) && isatty(STDOUT_FILENO) && !(term && strcmp(term, "dumb") == 0);
+}
+
+static void put(const char *s, size_t n)
+{
+    if (out_len + n > out_cap)
+    {
+        size_t cap = out_cap ? out_cap : 1024;
+        while (cap < out_len + n)
+            cap *= 2;
+        char *buf = realloc(out, cap);
+        if (!buf)
+            return;
+        out = buf;
+        out_cap = cap;
+    }
+    memcpy(out + out_len, s, n);
+    out_len += n;
+}
+
+static void put_str(const char *s)
+{
+    put(s, strlen(s));
+}
+
+static void flush_screen(void)
+{
+    for (size_t done = 0; done < out_len;)
+    {
+        ssize_t n = write(STDOUT_FILENO, out + done, out_len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    out_len = 0;
+}
+
+// Columns 's' takes: UTF-8 continuation bytes and escape sequences take none
+static size_t width(const char *s, size_t n)
+{
+    size_t w = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (s[i] == '\033' && i + 1 < n && s[i + 1] == '[')
+        {
+            for (i += 2; i < n && !(s[i] >= '@' && s[i] <= '~'); i++)
+                ;
+            continue;
+        }
+        if (((unsigned char)s[i] & 0xc0) != 0x80)
+            w++;
+    }
+    return w;
+}
+
+static int columns(void)
+{
+    struct winsize ws;
+    return (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) ? ws.ws_col : 80;
+}
+
+// Draw the prompt and the part of the line around the cursor, leave the cursor where it is in the line
+static void refresh(struct edit *e)
+{
+    const char *buf = e->in->buf;
+    size_t cols = columns();
+    size_t room = (cols > e->prompt_width + 1) ? cols - e->prompt_width - 1 : 1;
+
+    // Scroll so the cursor stays on screen
+    size_t first = 0;
+    size_t cursor_width = width(buf, e->pos);
+    for (size_t skip = (cursor_width >= room) ? cursor_width - room + 1 : 0; skip > 0; skip--)
+    {
+        do
+            first++;
+        while (first < e->pos && ((unsigned char)buf[first] & 0xc0) == 0x80);
+    }
+    size_t last = first;
+    for (size_t w = 0; last < e->len; last++)
+    {
+        if (((unsigned char)buf[last] & 0xc0) != 0x80 && ++w > room)
+            break;
+    }
+
+    char move[32];
+    size_t cursor = e->prompt_width + width(buf + first, e->pos - first);
+    put_str("\r");
+    put_str(e->prompt);
+    put(buf + first, last - first);
+    put_str("\033[K\r");
+    snprintf(move, sizeof(move), "\033[%zuC", cursor);
+    if (cursor > 0)
+        put_str(move);
+    flush_screen();
+}
+
+static int reserve(struct edit *e, size_t n)
+{
+    struct input *in = e->in;
+    if (e->len + n + 1 <= in->cap)
+        return 0;
+    size_t cap = in->cap ? in->cap : 4096;
+    while (cap < e->len + n + 1)
+        cap *= 2;
+    char *buf = realloc(in->buf, cap);
+    if (!buf)
+        return -1;
+    in->buf = buf;
+    in->cap = cap;
+    return 0;
+}
+
+static void insert(struct edit *e, const char *text, size_t n)
+{
+    if (reserve(e, n) != 0)
+        return;
+    char *buf = e->in->buf;
+    memmove(buf + e->pos + n, buf + e->pos, e->len - e->pos);
+    memcpy(buf + e->pos, text, n);
+    e->pos += n;
+    e->len += n;
+    buf[e->len] = '\0';
+}
+
+// Remove [from, to) from the line, the cursor goes to 'from'
+static void delete(struct edit *e, size_t from, size_t to)
+{
+    char *buf = e->in->buf;
+    memmove(buf + from, buf + to, e->len - to);
+    e->len -= to - from;
+    e->pos = from;
+    buf[e->len] = '\0';
+}
+
+// Start of the character before / after 'pos' (whole UTF-8 sequences)
+static size_t char_before(struct edit *e, size_t pos)
+{
+    while (pos > 0 && (((unsigned char)e->in->buf[--pos]) & 0xc0) == 0x80)
+        ;
+    return pos;
+}
+
+static size_t char_after(struct edit *e, size_t pos)
+{
+    while (pos < e->len && (((unsigned char)e->in->buf[++pos]) & 0xc0) == 0x80)
+        ;
+    return pos;
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  COMPLETION   **********////////////////////
+/////////////////////////////////////////////////////////////////////
+
+// The matches in columns under the line, then the line again
+static void list(struct edit *e, struct completion *c)
+{
+    size_t widest = 0;
+    int n = 0;
+    for (; c->matches[n]; n++)
+    {
+        size_t w = width(c->matches[n], strlen(c->matches[n]));
+        if (w > widest)
+            widest = w;
+    }
+    size_t per_row = columns() / (widest + 2);
+    if (per_row == 0)
+        per_row = 1;
+    size_t rows = (n + per_row - 1) / per_row;
+
+    put_str("\n");
+    for (size_t r = 0; r < rows; r++)
+    {
+        // Down the columns, like ls
+        for (size_t col = 0; col < per_row && r + col * rows < (size_t)n; col++)
+        {
+            const char *m = c->matches[r + col * rows];
+            put_str(m);
+            for (size_t w = width(m, strlen(m)); w < widest + 2 && r + (col + 1) * rows < (size_t)n; w++)
+                put_str(" ");
+        }
+        put_str("\n");
+    }
+    if (c->n > n)
+    {
+        char more[64];
+        snprintf(more, sizeof(more), "... and %d more\n", c->n - n);
+        put_str(more);
+    }
+    refresh(e);
+}
+
+// Tab ('again': the key before was a Tab too)
+static void tab(struct edit *e, int again)
+{
+    static struct arena a = ARENA_INIT;
+    struct completion c;
+
+    arena_reset(&a);
+    if (complete(&a, e->in->buf, e->pos, &c) == 0)
+    {
+        put_str("\a");
+        flush_screen();
+        return;
+    }
+
+    size_t word_len = e->pos - c.start;
+    size_t common_len = strlen(c.common);
+    if (common_len != word_len || memcmp(c.common, e->in->buf + c.start, word_len) != 0)
+    {
+        delete(e, c.start, e->pos);
+        insert(e, c.common, common_len);
+    }
+    else if (c.n > 1)
+    {
+        if (again)
+            list(e, &c);
+        else
+        {
+            put_str("\a");
+            flush_screen();
+        }
+        return;
+    }
+    if (c.done && (e->pos == e->len || e->in->buf[e->pos] != ' '))
+        insert(e, " ", 1);
+    refresh(e);
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  KEYS   **********//////////////////////////
+/////////////////////////////////////////////////////////////////////
+
+/*
+Next byte typed: -1 at the end of input. With 'wait_ms' >= 0 (the rest of an
+escape sequence) -2 if nothing came by then, otherwise it waits as long as it
+takes, handling the events.
+*/
+static int next_key(struct edit *e, int wait_ms, int event_fd, void (*on_event)(void), void (*on_idle)(void))
+{
+    while (keys_start == keys_len)
+    {
+        if (wait_ms >= 0)
+        {
+            struct pollfd p = {e->in->fd, POLLIN, 0};
+            if (poll(&p, 1, wait_ms) <= 0)
+                return -2;
+        }
+        else
+        {
+            if (on_idle)
+                on_idle();
+            input_wait(e->in, event_fd, on_event, on_idle);
+        }
+
+        ssize_t n = read(e->in->fd, keys, sizeof(keys));
+        if (n < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+        if (n <= 0)
+            return -1;
+        keys_start = 0;
+        keys_len = n;
+    }
+    return (unsigned char)keys[keys_start++];
+}
+
+// ESC [ ... / ESC O ...: the key it stands for as the control key that does the same, 0 if unknown
+static int escape_sequence(struct edit *e)
+{
+    int c = next_key(e, ESCAPE_WAIT_MS, -1, NULL, NULL);
+    if (c != '[' && c != 'O')
+        return 0;
+    int number = 0;
+    while ((c = next_key(e, ESCAPE_WAIT_MS, -1, NULL, NULL)) >= '0' && c <= '9')
+        number = number * 10 + c - '0';
+
+    switch (c)
+    {
+    case 'C':
+        return CTRL_KEY('F');
+    case 'D':
+        return CTRL_KEY('B');
+    case 'H':
+        return CTRL_KEY('A');
+    case 'F':
+        return CTRL_KEY('E');
+    case '~':
+        if (number == 1 || number == 7)
+            return CTRL_KEY('A');
+        if (number == 4 || number == 8)
+            return CTRL_KEY('E');
+        if (number == 3)
+            return KEY_DELETE;
+        return 0;
+    default:
+        return 0;
+    }
+}
+
+char *lineedit_read_line(struct input *in, const char *prompt, int event_fd, void (*on_event)(void),
+                         void (*on_idle)(void))
+{
+    struct termios saved, raw;
+    if (in->eof)
+        return NULL;
+    if (tcgetattr(in->fd, &saved) != 0)
+        return input_read_line(in, event_fd, on_event, on_idle);
+
+    // Raw: every key as it is typed, no echo, ctrl+C is a key (output processing stays: "\n" is "\r\n")
+    raw = saved;
+    raw.c_iflag &= ~(ICRNL | IXON | BRKINT | INPCK | ISTRIP);
+    raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(in->fd, TCSADRAIN, &raw);
+
+    struct edit e = {in, 0, 0, prompt, width(prompt, strlen(prompt))};
+    char *line = NULL;
+    int last = 0;
+    if (reserve(&e, 0) != 0)
+        goto done;
+    in->buf[0] = '\0';
+    in->start = in->len = 0;
+
+    for (;;)
+    {
+        int c = next_key(&e, -1, event_fd, on_event, on_idle);
+        if (c == '\033')
+            c = escape_sequence(&e);
+
+        switch (c)
+        {
+        case -1:
+            in->eof = 1;
+            line = e.len ? in->buf : NULL;
+            put_str("\n");
+            goto done;
+        case '\r':
+        case '\n':
+            e.pos = e.len;
+            refresh(&e);
+            put_str("\n");
+            line = in->buf;
+            goto done;
+        case CTRL_KEY('C'):
+            e.pos = e.len;
+            refresh(&e);
+            put_str("^C\n");
+            in->buf[0] = '\0';
+            line = in->buf;
+            goto done;
+        case CTRL_KEY('D'):
+            if (e.len == 0)
+            {
+                in->eof = 1;
+                put_str("\n");
+                goto done;
+            }
+            /* fall through: delete the character under the cursor */
+        case KEY_DELETE:
+            if (e.pos < e.len)
+                delete(&e, e.pos, char_after(&e, e.pos));
+            break;
+        case 127:
+        case CTRL_KEY('H'):
+            if (e.pos > 0)
+                delete(&e, char_before(&e, e.pos), e.pos);
+            break;
+        case CTRL_KEY('A'):
+            e.pos = 0;
+            break;
+        case CTRL_KEY('E'):
+            e.pos = e.len;
+            break;
+        case CTRL_KEY('B'):
+            e.pos = char_before(&e, e.pos);
+            break;
+        case CTRL_KEY('F'):
+            e.pos = char_after(&e, e.pos);
+            break;
+        case CTRL_KEY('U'):
+            delete(&e, 0, e.pos);
+            break;
+        case CTRL_KEY('K'):
+            delete(&e, e.pos, e.len);
+            break;
+        case CTRL_KEY('W'):
+        {
+            size_t from = e.pos;
+            while (from > 0 && in->buf[from - 1] == ' ')
+                from--;
+            while (from > 0 && in->buf[from - 1] != ' ')
+                from--;
+            delete(&e, from, e.pos);
+            break;
+        }
+        case CTRL_KEY('L'):
+            put_str("\033[H\033[2J");
+            break;
+        case '\t':
+            tab(&e, last == '\t');
+            last = c;
+            continue;
+        default:
+            if (c >= ' ' && c != 127)
+            {
+                char ch = c;
+                insert(&e, &ch, 1);
+            }
+            break;
+        }
+        last = c;
+
+        // A paste: draw once the keys read so far are all in
+        if (keys_start == keys_len)
+            refresh(&e);
+    }
+
+done:
+    flush_screen();
+    tcsetattr(in->fd, TCSADRAIN, &saved);
+    return line;
+}
@@ -0,0 +1,24 @@
+/*
+Line editor for an interactive terminal (used instead of input_read_line() when
+stdin and stdout are both a terminal and TERM isn't "dumb"). The terminal is in raw
+mode only while a line is being edited, commands run with it as it was.
+    - Left/Right, Home/End, ctrl+A/E/B/F move, Backspace/Delete, ctrl+U/K/W delete
+      to the start / to the end / the word before the cursor, ctrl+L clears the screen
+    - ctrl+C drops the line, ctrl+D on an empty line is the end of input
+    - Tab completes the word under the cursor (complete.c): to the text every match
+      shares, plus a space once it is a single whole word. A second Tab lists the matches
+    - a line wider than the terminal scrolls sideways around the cursor; every change
+      is redrawn with a single write()
+*/
+
+struct input;
+
+// Can 'fd' be edited on (with the terminal on stdout)?
+int lineedit_usable(int fd);
+
+/*
+input_read_line() with editing: 'prompt' is what was printed before the line
+(drawn again after a listing or when the line scrolls).
+*/
+char *lineedit_read_line(struct input *in, const char *prompt, int event_fd, void (*on_event)(void),
+                         void (*on_idle)(void));
@@ -0,0 +1,637 @@
+#define _GNU_SOURCE // pipe2()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include "memo.h"
+#include "arena.h"
+#include "builtins.h"
+#include "pathcache.h"
+#include "spawn.h"
+#include "vars.h"
+#include "acct.h"
+
+#define MEMO_MAGIC "MSMEMO1"
+#define STATS_MAGIC "MSSTAT1"
+#define STATS_FILE "stats"
+#define MEMO_SIZE_DEFAULT (64LL << 20)
+#define MEMO_ENV_DEFAULT "PATH HOME LANG LC_ALL"
+#define PRUNE_TO_PERCENT 90 // An over-full cache is pruned down to this much of MEMO_SIZE
+#define HASH_DIGITS 16
+#define READ_CHUNK 65536
+
+// Start of an entry file, followed by the key, the stdout and the stderr
+struct memo_header
+{
+    char magic[8];
+    uint32_t key_len;
+    int32_t status;
+    uint64_t out_len;
+    uint64_t err_len;
+    uint64_t run_ns; // How long the command took: what a hit saves
+};
+
+// The counters of every memo run on the cache (kept in STATS_FILE: pipeline stages are forked shells)
+struct memo_stats
+{
+    char magic[8];
+    uint64_t hits, misses, stored;
+    uint64_t saved_ns;
+    uint64_t replayed; // Bytes
+};
+
+// What a file the command reads adds to the key
+struct file_id
+{
+    uint32_t arg; // Which argument it was named by (ARG_* for the others)
+    uint32_t mode;
+    uint64_t dev, ino, size;
+    int64_t mtime_sec, mtime_nsec;
+};
+
+#define ARG_STDIN 0xffffffffu
+#define ARG_EXECUTABLE 0xfffffffeu
+
+// A buffer that grows by doubling in the memo arena
+struct buffer
+{
+    char *buf;
+    size_t len, cap;
+};
+
+// One cache file, for pruning
+struct entry
+{
+    char name[HASH_DIGITS + 1];
+    struct timespec mtime; // Last use
+    long long size;
+};
+
+static struct arena arena = ARENA_INIT; // Key, paths and output of one memo call
+static long long cache_bytes = -1;      // Bytes in the cache directory (-1 = not counted yet)
+
+static void add(struct buffer *b, const void *data, size_t len)
+{
+    if (b->len + len > b->cap)
+    {
+        size_t cap = b->cap ? b->cap : 256;
+        while (b->len + len > cap)
+            cap *= 2;
+        b->buf = arena_grow(&arena, b->buf, b->cap, cap);
+        b->cap = cap;
+    }
+    memcpy(b->buf + b->len, data, len);
+    b->len += len;
+}
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long long memo_size(void)
+{
+    const char *size = var_lookup("MEMO_SIZE", 9, NULL);
+    long long bytes = size ? atoll(size) : 0;
+    return (bytes > 0) ? bytes : MEMO_SIZE_DEFAULT;
+}
+
+// MEMO_DIR, or myshell-memo in $XDG_CACHE_HOME / ~/.cache (created if needed), NULL if there is none
+static char *memo_dir(void)
+{
+    const char *dir = var_lookup("MEMO_DIR", 8, NULL);
+    char path[PATH_MAX];
+
+    if (dir && *dir)
+        snprintf(path, sizeof(path), "%s", dir);
+    else if ((dir = var_lookup("XDG_CACHE_HOME", 14, NULL)) && *dir)
+        snprintf(path, sizeof(path), "%s/myshell-memo", dir);
+    else if ((dir = var_lookup("HOME", 4, NULL)) && *dir)
+        snprintf(path, sizeof(path), "%s/.cache/myshell-memo", dir);
+    else
+        return NULL;
+
+    // mkdir -p
+    for (char *p = path + 1;; p++)
+    {
+        if (*p != '/' && *p != '\0')
+            continue;
+        char c = *p;
+        *p = '\0';
+        if (mkdir(path, 0755) != 0 && errno != EEXIST)
+            return NULL;
+        *p = c;
+        if (!c)
+            break;
+    }
+    return arena_strndup(&arena, path, strlen(path));
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  KEY   **********///////////////////////////
+/////////////////////////////////////////////////////////////////////
+
+static void add_file(struct buffer *key, const struct stat *st, uint32_t arg)
+{
+    struct file_id id;
+    memset(&id, 0, sizeof(id)); // No padding bytes in the key
+    id.arg = arg;
+    id.mode = st->st_mode;
+    id.dev = st->st_dev;
+    id.ino = st->st_ino;
+    id.size = st->st_size;
+    id.mtime_sec = st->st_mtim.tv_sec;
+    id.mtime_nsec = st->st_mtim.tv_nsec;
+    add(key, &id, sizeof(id));
+}
+
+// Is stdin something the key can stand for: a regular file (by its identity) or /dev/null?
+static int stdin_keyable(struct stat *st)
+{
+    struct stat null;
+    if (fstat(STDIN_FILENO, st) != 0)
+        return 1; // Closed: nothing to read
+    if (S_ISREG(st->st_mode))
+        return 1;
+    return S_ISCHR(st->st_mode) && stat("/dev/null", &null) == 0 && st->st_rdev == null.st_rdev;
+}
+
+/*
+Everything the output depends on, as far as the shell can tell. -1 if it can't
+be known: the command isn't found, or it reads a pipe or a terminal (whose bytes
+aren't part of any key)
+*/
+static int build_key(char *args[], struct buffer *key)
+{
+    struct stat st;
+    char cwd[PATH_MAX];
+
+    if (!stdin_keyable(&st))
+        return -1;
+    int regular_stdin = S_ISREG(st.st_mode);
+    struct stat in = st;
+
+    for (int i = 0; args[i]; i++)
+        add(key, args[i], strlen(args[i]) + 1);
+    add(key, "", 1);
+
+    if (!getcwd(cwd, sizeof(cwd)))
+        cwd[0] = '\0';
+    add(key, cwd, strlen(cwd) + 1);
+
+    // The variables named in MEMO_ENV, as NAME=value (or NAME alone when unset)
+    const char *names = var_lookup("MEMO_ENV", 8, NULL);
+    for (const char *p = names ? names : MEMO_ENV_DEFAULT; *p;)
+    {
+        size_t len = strcspn(p, " :");
+        size_t value_len = 0;
+        const char *value = len ? var_lookup(p, len, &value_len) : NULL;
+        add(key, p, len);
+        if (value)
+        {
+            add(key, "=", 1);
+            add(key, value, value_len);
+        }
+        add(key, "", 1);
+        p += len + (p[len] != '\0');
+    }
+
+    const char *exe = path_lookup(args[0]);
+    if (!exe || stat(exe, &st) != 0)
+        return -1;
+    add(key, exe, strlen(exe) + 1);
+    add_file(key, &st, ARG_EXECUTABLE);
+
+    // Arguments that name files ("--input=file" too)
+    for (int i = 1; args[i]; i++)
+    {
+        const char *name = args[i];
+        const char *eq = (name[0] == '-') ? strchr(name, '=') : NULL;
+        if (eq)
+            name = eq + 1;
+        if (*name && stat(name, &st) == 0)
+            add_file(key, &st, i);
+    }
+
+    if (regular_stdin)
+        add_file(key, &in, ARG_STDIN);
+    return 0;
+}
+
+// FNV-1a
+static uint64_t hash_key(const struct buffer *key)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < key->len; i++)
+        h = (h ^ (unsigned char)key->buf[i]) * 1099511628211ULL;
+    return h;
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  HIT   **********///////////////////////////
+/////////////////////////////////////////////////////////////////////
+
+static void write_all(int fd, const char *buf, size_t len)
+{
+    for (size_t off = 0; off < len;)
+    {
+        ssize_t w = write(fd, buf + off, len - off);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return;
+        off += w;
+    }
+}
+
+// 'len' bytes of the file 'in' from 'offset' to 'out': sendfile(), or read/write where it can't be used
+static void copy_out(int in, off_t offset, size_t len, int out)
+{
+    while (len > 0)
+    {
+        ssize_t n = sendfile(out, in, &offset, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EINVAL || errno == ENOSYS))
+            break;
+        if (n <= 0)
+            return;
+        len -= n;
+    }
+
+    char buf[READ_CHUNK];
+    while (len > 0)
+    {
+        ssize_t n = pread(in, buf, (len < sizeof(buf)) ? len : sizeof(buf), offset);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        write_all(out, buf, n);
+        offset += n;
+        len -= n;
+    }
+}
+
+// If 'path' holds the output for exactly 'key', write it out, set *status and count the hit in 'stats'
+static int replay(const char *path, const struct buffer *key, int *status, struct memo_stats *stats)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+
+    struct memo_header h;
+    struct stat st;
+    char *stored = arena_alloc(&arena, key->len);
+    int hit = pread(fd, &h, sizeof(h), 0) == sizeof(h) && memcmp(h.magic, MEMO_MAGIC, sizeof(h.magic)) == 0
+              && h.key_len == key->len && fstat(fd, &st) == 0
+              && (uint64_t)st.st_size == sizeof(h) + h.key_len + h.out_len + h.err_len
+              && pread(fd, stored, key->len, sizeof(h)) == (ssize_t)key->len
+              && memcmp(stored, key->buf, key->len) == 0;
+
+    if (hit)
+    {
+        off_t offset = sizeof(h) + h.key_len;
+        copy_out(fd, offset, h.out_len, STDOUT_FILENO);
+        copy_out(fd, offset + h.out_len, h.err_len, STDERR_FILENO);
+        futimens(fd, NULL); // Most recently used
+        *status = h.status;
+        stats->hits++;
+        stats->saved_ns += h.run_ns;
+        stats->replayed += h.out_len + h.err_len;
+    }
+    close(fd);
+    return hit;
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  MISS   **********//////////////////////////
+/////////////////////////////////////////////////////////////////////
+
+/*
+Run the command with its stdout and stderr on pipes, passing what it writes
+through and keeping it in out / err while both fit in 'limit' bytes.
+Returns the exit status; *keep is cleared if the result must not be stored.
+*/
+static int run(char *args[], struct buffer *out, struct buffer *err, size_t limit, int *keep)
+{
+    int pipes[2][2];
+    if (pipe2(pipes[0], O_CLOEXEC) != 0)
+    {
+        perror("memo: pipe2");
+        return 1;
+    }
+    if (pipe2(pipes[1], O_CLOEXEC) != 0)
+    {
+        perror("memo: pipe2");
+        close(pipes[0][0]);
+        close(pipes[0][1]);
+        return 1;
+    }
+
+    pid_t pid = spawn_command_in_group(args, -1, pipes[0][1], pipes[1][1], -1);
+    int spawn_errno = errno;
+    close(pipes[0][1]);
+    close(pipes[1][1]);
+
+    struct pollfd fds[2] = {{pipes[0][0], POLLIN, 0}, {pipes[1][0], POLLIN, 0}};
+    struct buffer *bufs[2] = {out, err};
+    int open_fds = 2;
+    char chunk[READ_CHUNK];
+    while (pid > 0 && open_fds > 0)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            if (fds[i].fd < 0 || !fds[i].revents)
+                continue;
+            ssize_t n = read(fds[i].fd, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                open_fds--;
+                continue;
+            }
+            write_all(i ? STDERR_FILENO : STDOUT_FILENO, chunk, n);
+            if (*keep && out->len + err->len + n > limit)
+                *keep = 0; // Too big to be worth storing: just pass it through
+            if (*keep)
+                add(bufs[i], chunk, n);
+        }
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (fds[i].fd >= 0)
+            close(fds[i].fd);
+    }
+
+    if (pid < 0)
+    {
+        fprintf(stderr, "\033[1;31m%s: %s\033[0m\n", args[0], strerror(spawn_errno));
+        *keep = 0;
+        return 127;
+    }
+
+    int status;
+    struct rusage usage;
+    pid_t waited;
+    do
+        waited = wait4(pid, &status, 0, &usage);
+    while (waited < 0 && errno == EINTR);
+    if (waited < 0)
+    {
+        *keep = 0;
+        return 1;
+    }
+    acct_child(&usage);
+    if (!WIFEXITED(status))
+    {
+        *keep = 0; // Killed: the output is not the command's answer
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+static int by_mtime(const void *a, const void *b)
+{
+    const struct entry *x = a, *y = b;
+    if (x->mtime.tv_sec != y->mtime.tv_sec)
+        return (x->mtime.tv_sec > y->mtime.tv_sec) - (x->mtime.tv_sec < y->mtime.tv_sec);
+    return (x->mtime.tv_nsec > y->mtime.tv_nsec) - (x->mtime.tv_nsec < y->mtime.tv_nsec);
+}
+
+static int is_entry_name(const char *name)
+{
+    return strlen(name) == HASH_DIGITS && strspn(name, "0123456789abcdef") == HASH_DIGITS;
+}
+
+/*
+Count the entries of the cache directory; if they take more than 'limit' bytes,
+delete the least recently used ones until they take PRUNE_TO_PERCENT of it.
+Returns the bytes left (*n_entries = entries left).
+*/
+static long long prune(const char *dir, long long limit, int *n_entries)
+{
+    DIR *d = opendir(dir);
+    if (!d)
+        return 0;
+
+    struct buffer list = {NULL, 0, 0};
+    long long total = 0;
+    struct dirent *de;
+    while ((de = readdir(d)))
+    {
+        struct stat st;
+        struct entry e;
+        if (!is_entry_name(de->d_name) || fstatat(dirfd(d), de->d_name, &st, 0) != 0)
+            continue;
+        memcpy(e.name, de->d_name, sizeof(e.name));
+        e.mtime = st.st_mtim;
+        e.size = st.st_size;
+        total += e.size;
+        add(&list, &e, sizeof(e));
+    }
+
+    struct entry *entries = (struct entry *)list.buf;
+    size_t n = list.len / sizeof(struct entry), i = 0;
+    if (total > limit)
+    {
+        qsort(entries, n, sizeof(struct entry), by_mtime);
+        for (; i < n && total > limit / 100 * PRUNE_TO_PERCENT; i++)
+        {
+            if (unlinkat(dirfd(d), entries[i].name, 0) == 0)
+                total -= entries[i].size;
+        }
+    }
+    closedir(d);
+    *n_entries = n - i;
+    return total;
+}
+
+// Write the entry to a temporary file and rename it into place, returns 1 if it was stored
+static int store(const char *dir, const char *path, const struct buffer *key, const struct buffer *out,
+                  const struct buffer *err, int status, long long run_ns)
+{
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s/.tmp-%d", dir, (int)getpid());
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return 0;
+
+    struct memo_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MEMO_MAGIC, sizeof(h.magic));
+    h.key_len = key->len;
+    h.status = status;
+    h.out_len = out->len;
+    h.err_len = err->len;
+    h.run_ns = run_ns;
+
+    struct stat old;
+    long long old_size = (stat(path, &old) == 0) ? old.st_size : 0;
+    write_all(fd, (const char *)&h, sizeof(h));
+    write_all(fd, key->buf, key->len);
+    write_all(fd, out->buf, out->len);
+    write_all(fd, err->buf, err->len);
+
+    long long size = sizeof(h) + key->len + out->len + err->len;
+    struct stat st;
+    int complete = fstat(fd, &st) == 0 && st.st_size == size;
+    close(fd);
+    if (!complete || rename(tmp, path) != 0)
+    {
+        unlink(tmp); // Disk full: no half entries
+        return 0;
+    }
+
+    // Counting the directory once per shell, then keeping the count up to date, so most inserts don't scan it
+    long long limit = memo_size();
+    int n_entries;
+    if (cache_bytes >= 0)
+        cache_bytes += size - old_size;
+    if (cache_bytes < 0 || cache_bytes > limit)
+        cache_bytes = prune(dir, limit, &n_entries);
+    return 1;
+}
+
+/*
+Add 'delta' to the counters in the cache directory ('delta' = NULL: just read them
+into *total). The file is locked while it is updated: shells share the cache.
+*/
+static void update_stats(const char *dir, const struct memo_stats *delta, struct memo_stats *total)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, STATS_FILE);
+    memset(total, 0, sizeof(*total));
+    int fd = open(path, (delta ? O_RDWR | O_CREAT : O_RDONLY) | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return;
+
+    flock(fd, delta ? LOCK_EX : LOCK_SH);
+    if (pread(fd, total, sizeof(*total), 0) != sizeof(*total) || memcmp(total->magic, STATS_MAGIC, 8) != 0)
+        memset(total, 0, sizeof(*total));
+    if (delta)
+    {
+        memcpy(total->magic, STATS_MAGIC, 8);
+        total->hits += delta->hits;
+        total->misses += delta->misses;
+        total->stored += delta->stored;
+        total->saved_ns += delta->saved_ns;
+        total->replayed += delta->replayed;
+        if (pwrite(fd, total, sizeof(*total), 0) != sizeof(*total))
+            perror("memo: stats");
+    }
+    close(fd); // Unlocks
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  BUILTIN   **********///////////////////////
+/////////////////////////////////////////////////////////////////////
+
+static int show_stats(const char *dir)
+{
+    int n_entries = 0;
+    struct memo_stats stats;
+    long long bytes = dir ? prune(dir, LLONG_MAX, &n_entries) : 0;
+    if (dir)
+        update_stats(dir, NULL, &stats);
+    else
+        memset(&stats, 0, sizeof(stats));
+    printf("memo: %llu hits, %llu misses (%llu stored), %.3f s saved, %.1f KB replayed\n",
+           (unsigned long long)stats.hits, (unsigned long long)stats.misses, (unsigned long long)stats.stored,
+           stats.saved_ns / 1e9, stats.replayed / 1024.0);
+    printf("cache: %s, %d entries, %.1f KB of %.1f KB\n", dir ? dir : "(none)", n_entries, bytes / 1024.0,
+           memo_size() / 1024.0);
+    return 0;
+}
+
+static int clear(const char *dir)
+{
+    int n_entries;
+    char path[PATH_MAX];
+    if (dir)
+    {
+        prune(dir, 0, &n_entries);
+        snprintf(path, sizeof(path), "%s/%s", dir, STATS_FILE);
+        unlink(path);
+    }
+    cache_bytes = 0;
+    return 0;
+}
+
+int handle_memo(char *args[])
+{
+    arena_reset(&arena);
+    int first = (args[1] && strcmp(args[1], "--") == 0) ? 2 : 1;
+    if (!args[first])
+    {
+        fprintf(stderr, "\033[1;31musage: memo [-s | -c | command [args...]]\033[0m\n");
+        return 2;
+    }
+    if (first == 1 && strcmp(args[1], "-s") == 0)
+        return show_stats(memo_dir());
+    if (first == 1 && strcmp(args[1], "-c") == 0)
+        return clear(memo_dir());
+
+    // A builtin that only prints costs less than the lookup; the others would change the shell
+    char **command = args + first;
+    const struct builtin *b = builtin_find(command[0]);
+    if (b && (b->utility || b->fn == handle_echo))
+        return b->fn(command);
+    if (b)
+    {
+        fprintf(stderr, "\033[1;31mmemo: %s: not a command whose output can be kept\033[0m\n", command[0]);
+        return 2;
+    }
+
+    struct buffer key = {NULL, 0, 0}, out = {NULL, 0, 0}, err = {NULL, 0, 0};
+    struct memo_stats delta, total;
+    char *dir = memo_dir();
+    int keep = (dir != NULL && build_key(command, &key) == 0);
+    char path[PATH_MAX];
+    int status;
+    memset(&delta, 0, sizeof(delta));
+    if (keep)
+    {
+        snprintf(path, sizeof(path), "%s/%016llx", dir, (unsigned long long)hash_key(&key));
+        if (replay(path, &key, &status, &delta))
+        {
+            update_stats(dir, &delta, &total);
+            return status;
+        }
+    }
+
+    // Nothing to key it by (no cache directory, stdin a pipe or a terminal): just run it, uncounted
+    if (!keep)
+        return run(command, &out, &err, 0, &keep);
+
+    long long start = now_ns();
+    status = run(command, &out, &err, memo_size() / 4, &keep);
+    delta.misses = 1;
+    if (keep)
+        delta.stored = store(dir, path, &key, &out, &err, status, now_ns() - start);
+    update_stats(dir, &delta, &total);
+    return status;
+}
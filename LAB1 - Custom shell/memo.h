@@ -0,0 +1,29 @@
+/*
+memo: run a deterministic command once, replay its output after that (opt-in).
+    memo command [args...]   run it, or replay what it printed the last time
+    memo -s                  hits, misses, time saved and the size of the cache
+                             (counted in the cache directory, by every shell using it)
+    memo -c                  empty the cache and its counters
+The key is the argv, the working directory, the variables named in MEMO_ENV
+(default "PATH HOME LANG LC_ALL"), the executable, and every argument (or the
+value of --opt=value) that names an existing file: its device, inode, size and
+mtime. A regular file on stdin is part of the key too, and so is /dev/null; any
+other stdin (a pipe, a terminal) can't be keyed, so the command just runs, uncached:
+at the prompt, give it "< /dev/null" or a file.
+    - on a hit nothing is started: the stored stdout and stderr are copied to fd 1
+      and 2 with sendfile() and the stored exit status is returned
+    - on a miss the command runs with its stdout and stderr on pipes, what it
+      writes is passed through as it comes and kept, then written to a temporary
+      file that is rename()d into place (never half an entry)
+    - entries are files in MEMO_DIR (default ~/.cache/myshell-memo) named by a
+      64-bit hash of the key; the whole key is stored and compared on a hit
+    - the cache is an LRU of at most MEMO_SIZE bytes (default 64 MB): a hit
+      touches the entry's mtime, and an insert that goes over the limit deletes
+      the least recently used entries
+    - a command killed by a signal, or whose output is over a quarter of
+      MEMO_SIZE, is not stored; echo and the utility builtins run as they are,
+      the other builtins (cd, export, ...) are refused
+The replay writes stdout then stderr: how they were interleaved is not kept.
+*/
+
+int handle_memo(char *args[]);
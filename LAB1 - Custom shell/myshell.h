@@ -0,0 +1,40 @@
+/*
+Declarations shared by the MyShell modules.
+*/
+
+// Redirections of one command: "< in", "> out" / ">> out", "2> err" / "2>> err" (NULL = none)
+struct redirs
+{
+    char *in;
+    char *out;
+    int append; // ">>" instead of ">"
+    char *err;
+    int err_append;
+};
+
+// One command of a pipeline, everything in it lives in the line's arena
+struct command
+{
+    char **args; // NULL-terminated, expanded
+    struct redirs redirs;
+};
+
+struct arena;
+struct token;
+
+#define EXPANSION_FAILED -2 // parse_pipeline(): a word couldn't be expanded ($((1/0))), the error was printed
+
+// Expand the words of "cmd1 | cmd2 | ... [&]" (tokens up to a TOK_END) into commands (MyShell.c)
+int parse_pipeline(struct arena *a, struct token *tokens, struct command **commands, char *background_flag);
+
+// The words up to a TOK_END, expanded, as a NULL-terminated array
+char **expand_words(struct arena *a, struct token *tokens);
+
+// Run expanded commands: a pipeline, or one assignment, builtin or program. Returns the status
+int run_pipeline(struct command commands[], int n_stages, char background_flag);
+
+// "cmd args | cmd args" into buf (JOB_COMMAND_MAX bytes), for the job table and accounting records
+void job_text(char *buf, struct command commands[], int n_stages);
+
+int open_redirections(struct redirs *r, int fds[3]);
+void close_redirections(int fds[3]);
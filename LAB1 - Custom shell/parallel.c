@@ -0,0 +1,388 @@
+#define _GNU_SOURCE // pipe2()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "parallel.h"
+#include "spawn.h"
+#include "lexer.h"
+#include "vars.h"
+#include "input.h"
+#include "acct.h"
+
+#define MAX_FAILED_STATUS 101 // Status when at least that many commands failed
+#define OUTPUT_MIN 4096       // First size of a command's output buffer
+#define EVENT_BATCH 256
+
+// One running command
+struct slot
+{
+    pid_t pid;   // 0 = free
+    int pidfd;   // -1 once it exited (or if there is no pidfd: the exit is noticed at EOF)
+    int out_fd;  // Read end of its stdout/stderr pipe, -1 at EOF
+    int exited;
+    int status;
+    char *buf;   // Output so far (the buffer is kept for the slot's next command)
+    size_t len;
+    size_t cap;
+};
+
+// Where the commands come from
+struct source
+{
+    char **template; // command [args...], NULL = every item is a whole command
+    char **items;    // The ::: items, NULL = the lines of stdin
+    struct input in;
+    int count;       // Items read so far (for error messages)
+};
+
+// Next item (an argument after ::: or a line of stdin), NULL when there are none left
+static char *next_item(struct source *src)
+{
+    char *item;
+    do
+    {
+        if (src->items)
+            item = *src->items ? *src->items++ : NULL;
+        else
+            item = input_read_line(&src->in, -1, NULL, NULL);
+        if (item)
+            src->count++;
+    } while (item && item[0] == '\0');
+    return item;
+}
+
+// 'arg' with every "{}" replaced by 'item' (NULL if there is no "{}")
+static char *substitute(struct arena *a, const char *arg, const char *item)
+{
+    const char *mark = strstr(arg, "{}");
+    if (!mark)
+        return NULL;
+
+    size_t item_len = strlen(item);
+    size_t cap = strlen(arg) + 1;
+    for (const char *p = mark; p; p = strstr(p + 2, "{}"))
+        cap += item_len;
+
+    char *out = arena_alloc(a, cap);
+    char *w = out;
+    for (const char *p = arg; (mark = strstr(p, "{}")); p = mark + 2)
+    {
+        memcpy(w, p, mark - p);
+        w += mark - p;
+        memcpy(w, item, item_len);
+        w += item_len;
+        arg = mark + 2;
+    }
+    strcpy(w, arg);
+    return out;
+}
+
+/*
+argv for the next command, built in the arena: the template applied to the next item,
+or the item itself split into words. Returns 1, 0 when there are no more commands,
+-1 (after printing why) if the item isn't a simple command.
+*/
+static int next_command(struct source *src, struct arena *a, char ***argv)
+{
+    char *item = next_item(src);
+    if (!item)
+        return 0;
+
+    if (src->template)
+    {
+        int n = 0, replaced = 0;
+        while (src->template[n])
+            n++;
+
+        char **out = arena_alloc(a, (n + 2) * sizeof(char *));
+        for (int i = 0; i < n; i++)
+        {
+            out[i] = substitute(a, src->template[i], item);
+            replaced |= (out[i] != NULL);
+            if (!out[i])
+                out[i] = src->template[i];
+        }
+        if (!replaced)
+            out[n++] = item;
+        out[n] = NULL;
+        *argv = out;
+        return 1;
+    }
+
+    struct token *tokens;
+    int n = lex(a, item, &tokens);
+    if (n < 0)
+        return -1;
+
+    char **out = arena_alloc(a, (n + 1) * sizeof(char *));
+    for (int i = 0; i < n; i++)
+    {
+        if (tokens[i].type != TOK_WORD)
+        {
+            fprintf(stderr, "\033[1;31mparallel: command %d: '%s': only simple commands run in parallel\033[0m\n",
+                    src->count, token_name(&tokens[i]));
+            return -1;
+        }
+        out[i] = (tokens[i].flags & (WORD_EXPAND | WORD_LITERAL | WORD_GLOB)) ? expand_variables(a, tokens[i].text)
+                                                                              : tokens[i].text;
+    }
+    out[n] = NULL;
+    *argv = out;
+    return (n > 0) ? 1 : next_command(src, a, argv); // A comment: take the next one
+}
+
+static void watch(int epoll_fd, int fd, unsigned long long data)
+{
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = data;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static void unwatch(int epoll_fd, int *fd)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, *fd, NULL);
+    close(*fd);
+    *fd = -1;
+}
+
+// Start 'argv' in slot 'index' with its output going to a pipe, returns -1 if it couldn't start
+static int start(struct slot *s, int index, char *argv[], int null_fd, int epoll_fd)
+{
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) < 0)
+    {
+        perror("parallel: pipe");
+        return -1;
+    }
+
+    pid_t pid = spawn_command(argv, null_fd, pipe_fds[1], pipe_fds[1]);
+    close(pipe_fds[1]);
+    if (pid < 0)
+    {
+        fprintf(stderr, "\033[1;31mparallel: %s: %s\033[0m\n", argv[0], strerror(errno));
+        close(pipe_fds[0]);
+        return -1;
+    }
+
+    // Event data: the slot, and whether the pidfd (1) or the output (0) is ready
+    s->pid = pid;
+    s->exited = 0;
+    s->len = 0;
+    s->out_fd = pipe_fds[0];
+    watch(epoll_fd, s->out_fd, (unsigned long long)index << 1);
+    s->pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (s->pidfd >= 0)
+        watch(epoll_fd, s->pidfd, ((unsigned long long)index << 1) | 1);
+    return 0;
+}
+
+static void reap(struct slot *s, int flags)
+{
+    struct rusage usage;
+    int status;
+    pid_t pid;
+    do
+        pid = wait4(s->pid, &status, flags, &usage);
+    while (pid < 0 && errno == EINTR);
+
+    if (pid == 0)
+        return;
+    if (pid > 0)
+        acct_child(&usage);
+    s->exited = 1;
+    s->status = (pid < 0) ? 0 : WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+// Read what the command wrote (the output pipe is readable)
+static void collect(struct slot *s, int epoll_fd)
+{
+    if (s->len == s->cap)
+    {
+        size_t cap = s->cap ? s->cap * 2 : OUTPUT_MIN;
+        char *buf = realloc(s->buf, cap);
+        if (!buf)
+        {
+            perror("parallel");
+            s->len = 0; // Drop the output rather than the command
+        }
+        else
+        {
+            s->buf = buf;
+            s->cap = cap;
+        }
+    }
+
+    ssize_t n = read(s->out_fd, s->buf + s->len, s->cap - s->len);
+    if (n > 0)
+        s->len += n;
+    else if (n == 0 || errno != EINTR)
+    {
+        unwatch(epoll_fd, &s->out_fd);
+        // Without a pidfd, the end of the output is the sign it's exiting
+        if (s->pidfd < 0 && !s->exited)
+            reap(s, 0);
+    }
+}
+
+static void write_all(int fd, const char *buf, size_t len)
+{
+    for (size_t off = 0; off < len;)
+    {
+        ssize_t w = write(fd, buf + off, len - off);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return;
+        off += w;
+    }
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int handle_parallel(char *args[])
+{
+    long n_slots = sysconf(_SC_NPROCESSORS_ONLN);
+    int i = 1;
+
+    // -j N / -jN
+    if (args[i] && strncmp(args[i], "-j", 2) == 0)
+    {
+        const char *value = args[i][2] ? args[i] + 2 : args[++i];
+        n_slots = value ? strtol(value, NULL, 10) : 0;
+        if (n_slots < 1)
+        {
+            fprintf(stderr, "\033[1;31mparallel: usage: parallel [-j N] [command [args...]] [::: items...]\033[0m\n");
+            return 2;
+        }
+        i++;
+    }
+    if (n_slots < 1)
+        n_slots = 1;
+
+    struct source src = {NULL, NULL, INPUT_INIT(STDIN_FILENO), 0};
+    if (args[i] && strcmp(args[i], ":::") != 0)
+        src.template = &args[i];
+    for (; args[i]; i++)
+    {
+        if (strcmp(args[i], ":::") == 0)
+        {
+            args[i] = NULL; // Ends the template
+            src.items = &args[i + 1];
+            break;
+        }
+    }
+
+    struct slot *slots = calloc(n_slots, sizeof(struct slot));
+    int *free_slots = malloc(n_slots * sizeof(int));
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (!slots || !free_slots || epoll_fd < 0)
+    {
+        perror("parallel");
+        free(slots);
+        free(free_slots);
+        if (epoll_fd >= 0)
+            close(epoll_fd);
+        if (null_fd >= 0)
+            close(null_fd);
+        return 1;
+    }
+    for (int s = 0; s < n_slots; s++)
+        free_slots[s] = n_slots - 1 - s;
+
+    struct arena arena = ARENA_INIT;
+    int n_free = n_slots, started = 0, failed = 0, more = 1;
+    double start_time = now_seconds();
+
+    while (more || n_free < n_slots)
+    {
+        // Fill the free slots
+        while (more && n_free > 0)
+        {
+            char **argv;
+            int r = next_command(&src, &arena, &argv);
+            if (r == 0)
+                more = 0;
+            else if (r < 0 || start(&slots[free_slots[n_free - 1]], free_slots[n_free - 1], argv, null_fd, epoll_fd) < 0)
+            {
+                started++;
+                failed++;
+            }
+            else
+            {
+                started++;
+                n_free--;
+            }
+            arena_reset(&arena);
+        }
+        if (n_free == n_slots)
+            continue;
+
+        // Wait for output or exits: only the commands that did something are looked at
+        struct epoll_event events[EVENT_BATCH];
+        int n = epoll_wait(epoll_fd, events, EVENT_BATCH, -1);
+        if (n < 0 && errno != EINTR)
+        {
+            perror("parallel: epoll_wait");
+            break;
+        }
+
+        for (int e = 0; e < n; e++)
+        {
+            int index = events[e].data.u64 >> 1;
+            struct slot *s = &slots[index];
+            if (!s->pid)
+                continue;
+
+            if (events[e].data.u64 & 1)
+            {
+                if (s->pidfd < 0)
+                    continue;
+                reap(s, WNOHANG);
+                if (s->exited)
+                    unwatch(epoll_fd, &s->pidfd);
+            }
+            else if (s->out_fd >= 0)
+                collect(s, epoll_fd);
+
+            // Done once it exited and its output is complete: write it out in one piece
+            if (s->exited && s->out_fd < 0)
+            {
+                write_all(STDOUT_FILENO, s->buf, s->len);
+                if (s->status != 0)
+                    failed++;
+                s->pid = 0;
+                free_slots[n_free++] = index;
+            }
+        }
+    }
+
+    double elapsed = now_seconds() - start_time;
+    fprintf(stderr, "parallel: %d commands, %d failed, %.3fs, %.1f commands/s (-j %ld)\n",
+            started, failed, elapsed, (elapsed > 0) ? started / elapsed : 0.0, n_slots);
+
+    for (int s = 0; s < n_slots; s++)
+        free(slots[s].buf);
+    free(slots);
+    free(free_slots);
+    arena_free(&arena);
+    input_free(&src.in);
+    close(epoll_fd);
+    if (null_fd >= 0)
+        close(null_fd);
+    return (failed < MAX_FAILED_STATUS) ? failed : MAX_FAILED_STATUS;
+}
@@ -0,0 +1,16 @@
+/*
+parallel: run a batch of independent commands with at most N running at once.
+    parallel [-j N] command [args...] ::: item...   run "command args... item" for each item
+    parallel [-j N] command [args...] < items       same, one item per line of stdin
+    parallel [-j N] < commands                      each line of stdin is a simple command
+A '{}' in the arguments is replaced by the item instead of appending it.
+
+    - the next command starts as soon as one exits: the children are watched
+      through pidfds and their output pipes in one epoll set, in the shell process
+    - each command's stdout and stderr go to a buffer that is written out in one
+      piece when it finishes, so the outputs of parallel commands never interleave
+    - prints the number of commands, failures and commands per second on stderr;
+      the status is the number of failed commands (at most 101)
+*/
+
+int handle_parallel(char *args[]);
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pathcache.h"
+#include "vars.h"
+
+#define PATH_CACHE_MIN 64 // Initial number of slots (always a power of 2)
+#define MAX_PATH_DIRS 128
+
+struct path_entry
+{
+    char *name;      // NULL = empty slot
+    char *path;      // Absolute path of the executable
+    int dir;         // Index of the PATH directory it was found in
+    unsigned long hits;
+};
+
+// The parsed PATH, with each directory's mtime when it was searched
+struct path_dir
+{
+    char *dir;
+    struct timespec mtime;
+};
+
+static struct path_entry *table = NULL;
+static unsigned int table_size = 0; // Slots
+static unsigned int table_used = 0; // Entries
+
+static struct path_dir dirs[MAX_PATH_DIRS];
+static int n_dirs = -1; // -1 = PATH not parsed yet
+
+static unsigned long stat_hits = 0;
+static unsigned long stat_misses = 0;
+
+// FNV-1a
+static unsigned int hash_name(const char *name)
+{
+    unsigned int h = 2166136261u;
+    while (*name)
+        h = (h ^ (unsigned char)*name++) * 16777619u;
+    return h;
+}
+
+// Slot holding 'name', or the empty slot where it would go (open addressing, linear probing)
+static struct path_entry *find_slot(struct path_entry *slots, unsigned int size, const char *name)
+{
+    unsigned int i = hash_name(name) & (size - 1);
+    while (slots[i].name && strcmp(slots[i].name, name) != 0)
+        i = (i + 1) & (size - 1);
+    return &slots[i];
+}
+
+static int grow_table(void)
+{
+    unsigned int new_size = table_size ? table_size * 2 : PATH_CACHE_MIN;
+    struct path_entry *slots = calloc(new_size, sizeof(struct path_entry));
+    if (!slots)
+        return -1;
+
+    for (unsigned int i = 0; i < table_size; i++)
+    {
+        if (table[i].name)
+            *find_slot(slots, new_size, table[i].name) = table[i];
+    }
+    free(table);
+    table = slots;
+    table_size = new_size;
+    return 0;
+}
+
+// Split PATH like execvp(): an empty component ("a::b", or a ':' at either end) is the current directory
+static void parse_path(void)
+{
+    const char *path = var_lookup("PATH", 4, NULL);
+    if (!path)
+        path = "/usr/local/bin:/usr/bin:/bin";
+
+    n_dirs = 0;
+    for (const char *p = path; n_dirs < MAX_PATH_DIRS; p++)
+    {
+        size_t len = strcspn(p, ":");
+        struct stat st;
+        char *dir = len ? strndup(p, len) : strdup(".");
+        if (!dir)
+            break;
+        dirs[n_dirs].dir = dir;
+        if (stat(dir, &st) == 0)
+            dirs[n_dirs].mtime = st.st_mtim;
+        else
+            memset(&dirs[n_dirs].mtime, 0, sizeof(struct timespec));
+        n_dirs++;
+
+        p += len;
+        if (*p == '\0')
+            break;
+    }
+}
+
+// Did any PATH directory searched to find this entry change since?
+static int entry_stale(struct path_entry *entry)
+{
+    for (int i = 0; i <= entry->dir; i++)
+    {
+        struct stat st;
+        struct timespec then = dirs[i].mtime;
+        if (stat(dirs[i].dir, &st) != 0)
+            memset(&st.st_mtim, 0, sizeof(struct timespec));
+        if (st.st_mtim.tv_sec != then.tv_sec || st.st_mtim.tv_nsec != then.tv_nsec)
+            return 1;
+    }
+    return 0;
+}
+
+// Walk PATH like execvp would, but with stat() instead of failed execve() calls
+static struct path_entry *search_path(const char *name)
+{
+    char candidate[4096];
+
+    for (int i = 0; i < n_dirs; i++)
+    {
+        struct stat st;
+        snprintf(candidate, sizeof(candidate), "%s/%s", dirs[i].dir, name);
+        if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode) && access(candidate, X_OK) == 0)
+        {
+            if (table_used * 10 >= table_size * 7 && grow_table() != 0)
+                return NULL;
+
+            struct path_entry *entry = find_slot(table, table_size, name);
+            entry->name = strdup(name);
+            entry->path = strdup(candidate);
+            entry->dir = i;
+            entry->hits = 0;
+            table_used++;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+const char *path_lookup(const char *name)
+{
+    if (strchr(name, '/'))
+        return name;
+
+    if (n_dirs < 0)
+        parse_path();
+    if (!table && grow_table() != 0)
+        return NULL;
+
+    struct path_entry *entry = find_slot(table, table_size, name);
+    if (entry->name && var_lookup("HASHCHECK", 9, NULL) && entry_stale(entry))
+    {
+        // Something changed in PATH, search everything again
+        path_cache_clear();
+        parse_path();
+        if (grow_table() != 0)
+            return NULL;
+        entry = find_slot(table, table_size, name);
+    }
+
+    if (entry->name)
+        stat_hits++;
+    else
+    {
+        stat_misses++;
+        entry = search_path(name);
+        if (!entry)
+            return NULL;
+    }
+
+    entry->hits++;
+    return entry->path;
+}
+
+void path_cache_clear(void)
+{
+    for (unsigned int i = 0; i < table_size; i++)
+    {
+        free(table[i].name);
+        free(table[i].path);
+    }
+    free(table);
+    table = NULL;
+    table_size = table_used = 0;
+
+    for (int i = 0; i < n_dirs; i++)
+        free(dirs[i].dir);
+    n_dirs = -1;
+}
+
+int handle_hash(char *args[])
+{
+    // hash -r: forget everything
+    if (args[1] && strcmp(args[1], "-r") == 0)
+    {
+        path_cache_clear();
+        return 0;
+    }
+
+    // hash name...: look the names up now
+    if (args[1])
+    {
+        int status = 0;
+        for (int i = 1; args[i]; i++)
+        {
+            if (!path_lookup(args[i]))
+            {
+                fprintf(stderr, "\033[1;31mhash: %s: not found\033[0m\n", args[i]);
+                status = 1;
+            }
+        }
+        return status;
+    }
+
+    // hash: list the table and the hit rate
+    if (table_used == 0)
+        printf("hash: hash table empty\n");
+    else
+    {
+        printf("hits\tcommand\n");
+        for (unsigned int i = 0; i < table_size; i++)
+        {
+            if (table[i].name)
+                printf("%4lu\t%s\n", table[i].hits, table[i].path);
+        }
+    }
+
+    unsigned long lookups = stat_hits + stat_misses;
+    printf("lookups: %lu, hits: %lu, misses: %lu, hit rate: %.1f%%\n",
+           lookups, stat_hits, stat_misses, lookups ? 100.0 * stat_hits / lookups : 0.0);
+    return 0;
+}
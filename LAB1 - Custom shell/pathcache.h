@@ -0,0 +1,16 @@
+/*
+Command hash table (like bash's "hash"): command name -> absolute path.
+    - filled lazily: the first lookup of a name searches PATH, the next ones don't
+    - path_cache_clear() forgets everything (export PATH=..., hash -r)
+    - with HASHCHECK set, a hit is only trusted while the PATH directories up to the
+      one it was found in keep their mtime (a new or removed file changes it)
+*/
+
+// Absolute path to run for 'name' (names with a '/' are returned as is), NULL if not found
+const char *path_lookup(const char *name);
+
+// Forget every cached path (and the parsed PATH)
+void path_cache_clear(void);
+
+// hash builtin: "hash" lists the table, "hash -r" clears it, "hash name..." adds names
+int handle_hash(char *args[]);
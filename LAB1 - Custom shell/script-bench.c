@@ -0,0 +1,137 @@
+/*
+    Measures how many script lines per second MyShell runs (script mode, script.c)
+    on loop-heavy scripts. Loop bodies and functions are parsed once and run from
+    their tree, so an iteration only expands words and runs commands. The last
+    script has the same commands written out one per line, each parsed once and
+    run once, to show what the per-line parsing costs.
+    Every command is a builtin or an assignment, so no process is started.
+
+    To build:
+    make script-bench
+
+    To run:
+    ./script-bench [iterations]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// "1 2 3 ... n"
+static void write_list(FILE *f, int n)
+{
+    for (int i = 1; i <= n; i++)
+        fprintf(f, " %d", i);
+}
+
+// Write one of the scripts to 'path', returns how many commands it runs
+static long write_script(const char *path, const char *kind, int n)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+    {
+        perror(path);
+        exit(1);
+    }
+
+    long lines = 3L * n;
+    if (strcmp(kind, "for") == 0)
+    {
+        fprintf(f, "for i in");
+        write_list(f, n);
+        fprintf(f, "\ndo\n    x=$i\n    y=$x\n    true\ndone\n");
+    }
+    else if (strcmp(kind, "while") == 0)
+    {
+        fprintf(f, "for i in");
+        write_list(f, n);
+        fprintf(f, "\ndo\n    while true\n    do\n        x=$i\n        break\n    done\ndone\n");
+    }
+    else if (strcmp(kind, "if") == 0)
+    {
+        lines = 2L * n;
+        fprintf(f, "for i in");
+        write_list(f, n);
+        fprintf(f, "\ndo\n    if test $i = 0\n    then\n        echo never\n    elif [ $i = x ]\n"
+                   "    then\n        echo never\n    fi\ndone\n");
+    }
+    else if (strcmp(kind, "function") == 0)
+    {
+        fprintf(f, "f() {\n    x=$1\n    true\n}\nfor i in");
+        write_list(f, n);
+        fprintf(f, "\ndo\n    f $i\ndone\n");
+    }
+    else
+    {
+        // The "for" script unrolled: every command on its own line
+        for (int i = 1; i <= n; i++)
+            fprintf(f, "x=%d\ny=$x\ntrue\n", i);
+    }
+    fclose(f);
+    return lines;
+}
+
+// Seconds MyShell takes to run the script (output thrown away)
+static double run(const char *shell, const char *path)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+    char *argv[] = {(char *)shell, (char *)path, NULL};
+    double start = now_s();
+    pid_t pid;
+    if (posix_spawn(&pid, shell, &actions, NULL, argv, environ) != 0)
+    {
+        perror(shell);
+        exit(1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    double elapsed = now_s() - start;
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        fprintf(stderr, "%s %s: exit status %d\n", shell, path, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    return elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    int n = (argc > 1) ? atoi(argv[1]) : 100000;
+    const char *shell = "./MyShell";
+    const char *kinds[] = {"for", "while", "if", "function", "unrolled"};
+    char path[] = "/tmp/script-bench-XXXXXX";
+
+    int fd = mkstemp(path);
+    if (fd < 0)
+    {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    printf("%10s %10s %10s %14s\n", "script", "lines", "seconds", "lines/s");
+    for (int i = 0; i < (int)(sizeof(kinds) / sizeof(kinds[0])); i++)
+    {
+        long lines = write_script(path, kinds[i], n);
+        double elapsed = run(shell, path);
+        printf("%10s %10ld %10.3f %14.0f\n", kinds[i], lines, elapsed, lines / elapsed);
+    }
+    unlink(path);
+    return 0;
+}
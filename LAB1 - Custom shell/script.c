@@ -0,0 +1,611 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "myshell.h"
+#include "ast.h"
+#include "script.h"
+#include "builtins.h"
+#include "vars.h"
+#include "jobs.h"
+#include "joblog.h"
+#include "acct.h"
+#include "trace.h"
+
+#define FUNCTIONS_SIZE 256       // Buckets of the function table (a power of 2)
+#define FUNCTION_DEPTH_MAX 1000  // Deeper recursion is an error, not a stack overflow
+
+struct function
+{
+    char *name;
+    struct node *body;  // NULL once unset (the entry stays for the next definition)
+    struct arena arena; // The body's nodes and words, copied from the line or script it was defined in
+    struct function *next; // Same bucket
+};
+
+static struct function *functions[FUNCTIONS_SIZE];
+
+// Bodies replaced or unset while a function ran (maybe the one doing it): freed when no function runs
+struct retired_body
+{
+    struct arena arena;
+    struct retired_body *next;
+};
+
+static struct retired_body *retired = NULL;
+
+// Expanded words of the commands being run (rewound after each one)
+static struct arena words = ARENA_INIT;
+
+/*
+break / continue / return / exit set these and every list and loop on the way
+back up stops running commands until the one they are aimed at is reached.
+*/
+static int loop_depth = 0;
+static int function_depth = 0;
+static int breaking = 0;   // Loops still to leave
+static int continuing = 0; // Loops still to leave, the last one goes on with its next iteration
+static int returning = 0;
+static int exiting = 0;
+static int exit_status = 0;
+static int last_status = 0;
+
+#define UNWINDING() (breaking || continuing || returning || exiting)
+
+static int run_node(struct node *n);
+
+static unsigned int hash_name(const char *name)
+{
+    unsigned int h = 2166136261u;
+    for (; *name; name++)
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    return h & (FUNCTIONS_SIZE - 1);
+}
+
+// The table entry for 'name', defined or not
+static struct function *function_entry(const char *name)
+{
+    struct function *f = functions[hash_name(name)];
+    while (f && strcmp(f->name, name) != 0)
+        f = f->next;
+    return f;
+}
+
+static struct function *function_find(const char *name)
+{
+    struct function *f = function_entry(name);
+    return (f && f->body) ? f : NULL;
+}
+
+// The words of a node, up to and including their TOK_END
+static struct token *copy_words(struct arena *a, const struct token *tokens)
+{
+    if (!tokens)
+        return NULL;
+    size_t n = 1;
+    while (tokens[n - 1].type != TOK_END)
+        n++;
+    struct token *copy = arena_alloc(a, n * sizeof(struct token));
+    memcpy(copy, tokens, n * sizeof(struct token));
+    for (size_t i = 0; i < n; i++)
+    {
+        if (copy[i].text)
+            copy[i].text = arena_strndup(a, copy[i].text, copy[i].len);
+    }
+    return copy;
+}
+
+// A list of commands and everything under them (the next ones are copied in a loop, long bodies don't recurse)
+static struct node *copy_tree(struct arena *a, const struct node *n)
+{
+    struct node *first = NULL;
+    struct node **link = &first;
+    for (; n; n = n->next)
+    {
+        struct node *copy = arena_alloc(a, sizeof(struct node));
+        *copy = *n;
+        copy->next = NULL;
+        copy->tokens = copy_words(a, n->tokens);
+        copy->name = n->name ? arena_strndup(a, n->name, strlen(n->name)) : NULL;
+        copy->a = copy_tree(a, n->a);
+        copy->b = copy_tree(a, n->b);
+        copy->c = copy_tree(a, n->c);
+        *link = copy;
+        link = &copy->next;
+    }
+    return first;
+}
+
+static void function_drop_body(struct function *f)
+{
+    struct retired_body *r;
+    if (function_depth == 0)
+        arena_free(&f->arena);
+    else if ((r = malloc(sizeof(struct retired_body))))
+    {
+        r->arena = f->arena;
+        r->next = retired;
+        retired = r;
+    }
+    // (out of memory: the old body is left allocated, it may still be running)
+    f->arena = (struct arena)ARENA_INIT;
+    f->body = NULL;
+}
+
+static void free_retired(void)
+{
+    while (retired)
+    {
+        struct retired_body *r = retired;
+        retired = r->next;
+        arena_free(&r->arena);
+        free(r);
+    }
+}
+
+/*
+The body is copied into the function's own arena: the line or script it was
+parsed from can then be freed, and redefining the function frees the old body.
+*/
+static void function_define(struct node *n)
+{
+    struct function *f = function_entry(n->name);
+    if (!f)
+    {
+        unsigned int bucket = hash_name(n->name);
+        f = malloc(sizeof(struct function));
+        if (!f)
+        {
+            perror("MyShell: function");
+            return;
+        }
+        f->name = strdup(n->name);
+        f->body = NULL;
+        f->arena = (struct arena)ARENA_INIT;
+        f->next = functions[bucket];
+        functions[bucket] = f;
+    }
+    function_drop_body(f);
+    f->body = copy_tree(&f->arena, n->a);
+}
+
+// unset [-f | -v] NAME...: a name that isn't a variable is a function (as in bash)
+static int unset_names(char *args[])
+{
+    int functions_only = 0, variables_only = 0;
+    int i = 1;
+    for (; args[i] && (strcmp(args[i], "-f") == 0 || strcmp(args[i], "-v") == 0); i++)
+    {
+        if (args[i][1] == 'f')
+            functions_only = 1;
+        else
+            variables_only = 1;
+    }
+
+    for (; args[i]; i++)
+    {
+        struct function *f = function_find(args[i]);
+        if (!functions_only && (variables_only || !f || var_lookup(args[i], strlen(args[i]), NULL)))
+            var_unset(args[i]);
+        else if (f)
+            function_drop_body(f);
+    }
+    return 0;
+}
+
+int script_handles(const char *name)
+{
+    return strcmp(name, "break") == 0 || strcmp(name, "continue") == 0 || strcmp(name, "return") == 0
+           || function_find(name) != NULL;
+}
+
+int script_exit_status(void)
+{
+    return exit_status;
+}
+
+static void set_status(int status)
+{
+    last_status = status;
+    vars_set_status(status);
+}
+
+static int run_list(struct node *n)
+{
+    int status = 0;
+    for (; n && !UNWINDING(); n = n->next)
+    {
+        status = run_node(n);
+        if (exiting)
+            return BUILTIN_EXIT;
+        set_status(status);
+    }
+    return status;
+}
+
+// break [n] / continue [n]
+static int loop_control(char *args[])
+{
+    int n = args[1] ? atoi(args[1]) : 1;
+    if (loop_depth == 0)
+    {
+        fprintf(stderr, "\033[1;31m%s: only meaningful in a loop\033[0m\n", args[0]);
+        return 1;
+    }
+    if (n < 1)
+    {
+        fprintf(stderr, "\033[1;31m%s: %s: loop count out of range\033[0m\n", args[0], args[1]);
+        return 1;
+    }
+    if (n > loop_depth)
+        n = loop_depth;
+
+    if (args[0][0] == 'b')
+        breaking = n;
+    else
+        continuing = n;
+    return 0;
+}
+
+// return [n]
+static int function_return(char *args[])
+{
+    if (function_depth == 0)
+    {
+        fprintf(stderr, "\033[1;31mreturn: can only return from a function\033[0m\n");
+        return 1;
+    }
+    returning = 1;
+    return args[1] ? atoi(args[1]) : last_status;
+}
+
+// The function call_function() is starting (run_function() has the builtin signature)
+static struct function *calling;
+
+static int run_function(char *args[])
+{
+    struct function *f = calling;
+
+    // $1... are the call's arguments, and the caller's loops are out of reach
+    char **saved_args = vars_set_args(args + 1);
+    int saved_loops = loop_depth;
+    loop_depth = 0;
+    function_depth++;
+
+    int status = run_node(f->body);
+
+    function_depth--;
+    if (function_depth == 0)
+        free_retired();
+    loop_depth = saved_loops;
+    returning = 0;
+    vars_set_args(saved_args);
+    return status;
+}
+
+// A function runs like a builtin: in the shell, with its redirections applied for the call
+static int call_function(struct function *f, struct command *command)
+{
+    if (function_depth >= FUNCTION_DEPTH_MAX)
+    {
+        fprintf(stderr, "\033[1;31m%s: maximum function nesting level exceeded (%d)\033[0m\n",
+                f->name, FUNCTION_DEPTH_MAX);
+        return 1;
+    }
+
+    int fds[3];
+    if (open_redirections(&command->redirs, fds) != 0)
+        return 1;
+
+    struct builtin call = {f->name, run_function, 0};
+    calling = f;
+    int status = builtin_run(&call, command->args, fds);
+    close_redirections(fds);
+    return status;
+}
+
+// A pipeline node: expand its words (they may have changed since the last time), then run it
+static int run_commands(struct node *n)
+{
+    struct arena_mark mark = arena_save(&words);
+    struct command *commands;
+    char background_flag;
+    int status = 0;
+
+    long long span = TRACE_BEGIN();
+    int n_stages = parse_pipeline(&words, n->tokens, &commands, &background_flag);
+    TRACE_END(TRACE_EXPAND, span, (n->tokens->type == TOK_WORD) ? n->tokens->text : NULL);
+    char **args = (n_stages == 1) ? commands[0].args : NULL;
+
+    // ACCOUNTING=1: every foreground command gets an "acct kind=fg" record (background jobs: jobs.c)
+    struct acct acct;
+    int accounting = (n_stages > 0 && !background_flag && acct_enabled());
+    if (accounting)
+        acct_begin(&acct);
+
+    if (n_stages < 0)
+        status = (n_stages == EXPANSION_FAILED) ? 1 : 2;
+    else if (args && args[0] && !background_flag)
+    {
+        struct function *f;
+        if (strcmp(args[0], "break") == 0 || strcmp(args[0], "continue") == 0)
+            status = loop_control(args);
+        else if (strcmp(args[0], "return") == 0)
+            status = function_return(args);
+        else if ((f = function_find(args[0])))
+            status = call_function(f, &commands[0]);
+        else if (strcmp(args[0], "unset") == 0)
+            status = unset_names(args);
+        else
+        {
+            status = run_pipeline(commands, 1, 0);
+            if (status == BUILTIN_EXIT)
+            {
+                exiting = 1;
+                exit_status = args[1] ? atoi(args[1]) : last_status;
+            }
+        }
+    }
+    else if (n_stages > 0)
+        status = run_pipeline(commands, n_stages, background_flag);
+
+    if (accounting)
+    {
+        struct job_record record;
+        char text[JOB_COMMAND_MAX];
+        job_text(text, commands, n_stages);
+        acct_end(&acct, exiting ? exit_status : status, text, &record);
+        joblog_add(&record);
+    }
+
+    arena_restore(&words, mark);
+    return status;
+}
+
+// What a timed command was, for its record: a pipeline's words, a compound command's keyword
+static void node_text(char *buf, struct node *n)
+{
+    static const char *const keywords[] = {"", "&&", "||", "if ...", "while ...", "until ...", "for ...",
+                                           "{ ... }", "function", "time"};
+    size_t len = 0;
+    buf[0] = '\0';
+    if (!n)
+        return;
+    if (n->type != NODE_PIPELINE)
+    {
+        snprintf(buf, JOB_COMMAND_MAX, "%s", keywords[n->type]);
+        return;
+    }
+    for (struct token *t = n->tokens; t->type != TOK_END && len < JOB_COMMAND_MAX; t++)
+        len += snprintf(buf + len, JOB_COMMAND_MAX - len, "%s%s", len ? " " : "", token_name(t));
+}
+
+// time command: measure it, print the result and log it ("acct kind=time")
+static int run_time(struct node *n)
+{
+    struct acct acct;
+    struct job_record record;
+    char text[JOB_COMMAND_MAX];
+
+    acct_begin(&acct);
+    int status = n->a ? run_node(n->a) : 0;
+    node_text(text, n->a);
+    acct_end(&acct, exiting ? exit_status : status, text, &record);
+    record.kind = RECORD_TIME;
+
+    acct_print(&record);
+    joblog_add(&record);
+    return status;
+}
+
+// After a loop's body: does this loop stop? (break n / continue n unwind n loops)
+static int loop_ended(void)
+{
+    if (breaking)
+    {
+        breaking--;
+        return 1;
+    }
+    if (continuing)
+        return --continuing > 0;
+    return returning || exiting;
+}
+
+static int run_loop(struct node *n)
+{
+    int status = 0;
+    loop_depth++;
+    for (;;)
+    {
+        int condition = run_list(n->a);
+        if (UNWINDING())
+        {
+            if (loop_ended())
+                break;
+            continue;
+        }
+        if ((condition == 0) != (n->type == NODE_WHILE))
+            break;
+
+        status = run_list(n->b);
+        if (UNWINDING() && loop_ended())
+            break;
+    }
+    loop_depth--;
+    return exiting ? BUILTIN_EXIT : status;
+}
+
+static int run_for(struct node *n)
+{
+    struct arena_mark mark = arena_save(&words);
+    long long span = TRACE_BEGIN();
+    char **list = n->tokens ? expand_words(&words, n->tokens) : vars_args();
+    TRACE_END(TRACE_EXPAND, span, "for");
+    int status = 0;
+
+    loop_depth++;
+    for (int i = 0; list[i]; i++)
+    {
+        var_set(n->name, list[i], 0);
+        status = run_list(n->a);
+        if (UNWINDING() && loop_ended())
+            break;
+    }
+    loop_depth--;
+
+    arena_restore(&words, mark);
+    return exiting ? BUILTIN_EXIT : status;
+}
+
+static int run_node(struct node *n)
+{
+    int status;
+
+    switch (n->type)
+    {
+    case NODE_PIPELINE:
+        return run_commands(n);
+    case NODE_AND:
+    case NODE_OR:
+        status = run_node(n->a);
+        if (UNWINDING())
+            return status;
+        set_status(status);
+        if ((status == 0) == (n->type == NODE_AND))
+            status = run_node(n->b);
+        return status;
+    case NODE_IF:
+        status = run_list(n->a);
+        if (UNWINDING())
+            return status;
+        set_status(status);
+        if (status == 0)
+            return run_list(n->b);
+        return n->c ? run_list(n->c) : 0;
+    case NODE_WHILE:
+    case NODE_UNTIL:
+        return run_loop(n);
+    case NODE_FOR:
+        return run_for(n);
+    case NODE_GROUP:
+        return run_list(n->a);
+    case NODE_FUNCTION:
+        function_define(n);
+        return 0;
+    case NODE_TIME:
+        return run_time(n);
+    }
+    return 0;
+}
+
+int script_run(struct node *n)
+{
+    long long span = TRACE_BEGIN();
+    int status = run_list(n);
+    TRACE_END(TRACE_COMMAND, span, (n->type == NODE_PIPELINE && n->tokens->type == TOK_WORD) ? n->tokens->text : NULL);
+    return exiting ? BUILTIN_EXIT : status;
+}
+
+// Lex the whole text at once, then parse and run it one complete command at a time
+static int run_text(char *text, const char *source)
+{
+    struct arena script = ARENA_INIT;
+    struct token *tokens;
+
+    long long span = TRACE_BEGIN();
+    int lexed = lex(&script, text, &tokens);
+    TRACE_END(TRACE_LEX, span, source);
+    if (lexed < 0)
+    {
+        arena_free(&script);
+        return 2;
+    }
+
+    struct parser p = PARSER_INIT(&script, tokens, source);
+    int status = 0;
+    while (p.t->type != TOK_END)
+    {
+        struct node *node;
+        span = TRACE_BEGIN();
+        enum parse_result r = parse_command(&p, &node);
+        TRACE_END(TRACE_PARSE, span, NULL);
+        if (r == PARSE_INCOMPLETE)
+            fprintf(stderr, "\033[1;31m%s: line %d: syntax error: unexpected end of file\033[0m\n", source, p.line);
+        if (r != PARSE_OK)
+        {
+            status = 2;
+            break;
+        }
+
+        if (node)
+        {
+            status = script_run(node);
+            if (status == BUILTIN_EXIT)
+            {
+                status = exit_status;
+                break;
+            }
+        }
+    }
+    arena_free(&script);
+    return status;
+}
+
+int script_run_file(const char *path, char *args[])
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0 || S_ISDIR(st.st_mode))
+    {
+        fprintf(stderr, "\033[1;31mMyShell: %s: %s\033[0m\n", path, (fd < 0) ? strerror(errno) : "Is a directory");
+        if (fd >= 0)
+            close(fd);
+        return 127;
+    }
+
+    /*
+    Map the script privately: the lexer unquotes words in place (on copy-on-write
+    pages), and the tokens point into the text for as long as the script runs.
+    One zero-filled anonymous page past the end NUL-terminates the text.
+    */
+    long page = sysconf(_SC_PAGESIZE);
+    size_t size = st.st_size;
+    size_t mapped = (size / page + 1) * page;
+    char *text = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (text != MAP_FAILED && size > 0
+        && mmap(text, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        munmap(text, mapped);
+        text = MAP_FAILED;
+    }
+    close(fd);
+    if (text == MAP_FAILED)
+    {
+        fprintf(stderr, "\033[1;31mMyShell: %s: %s\033[0m\n", path, strerror(errno));
+        return 126;
+    }
+
+    vars_set_name(path);
+    vars_set_args(args);
+    int status = run_text(text, path);
+    munmap(text, mapped);
+    return status;
+}
+
+int script_run_string(const char *text, char *args[])
+{
+    char *copy = strdup(text);
+    if (!copy)
+    {
+        perror("MyShell");
+        return 1;
+    }
+    vars_set_args(args);
+    int status = run_text(copy, "MyShell");
+    free(copy);
+    return status;
+}
@@ -0,0 +1,27 @@
+/*
+Runs the commands the parser (ast.c) built: lists, && / ||, if, while / until,
+for, { ... }, functions, break / continue / return, for the terminal and for
+scripts alike. The words of a command are expanded when it runs, into an
+arena that is rewound right after, so a loop doing a million iterations
+allocates nothing per iteration once its arena has grown.
+*/
+
+struct node;
+
+// Run one complete command, returns its status (BUILTIN_EXIT once "exit" ran)
+int script_run(struct node *n);
+
+// Is 'name' run here rather than as a builtin or a program (a function, break, continue, return)?
+int script_handles(const char *name);
+
+// Status "exit" asked for (exit N, or the last status)
+int script_exit_status(void);
+
+/*
+MyShell file [args...]: the script is mmap()ed, lexed in one pass and run one
+complete command at a time. Returns the shell's exit status.
+*/
+int script_run_file(const char *path, char *args[]);
+
+// MyShell -c 'commands' [args...]
+int script_run_string(const char *text, char *args[]);
@@ -0,0 +1,426 @@
+/*
+    Benchmark suite for MyShell. The first benchmarks call the shell's own
+    functions directly, the rest run ./MyShell on generated scripts:
+        lex        lex() on a typical command line              lines/s
+        expand     expand_variables() on a word with 3 variables  words/s
+        dispatch   builtin_find() + builtin_run() of "true"     calls/s
+        spawn      spawn_command() + wait of /bin/true          spawns/s
+        glob       "*.txt" in a directory of 20000 files (cached) globs/s
+        history    "history -s" in 1000000 entries (indexed)  searches/s
+        complete   Tab after "gi" (PATH commands and builtins)   tabs/s
+        loop       "true" in a for loop (in-process builtin)    commands/s
+        external   "/bin/true" in a for loop                    commands/s
+        pipeline   head -c 256M /dev/zero | cat > /dev/null     MB/s
+        background "/bin/true &" in a for loop, then wait       jobs/s
+    Every benchmark is run once to warm up, then 'runs' times. The median is
+    reported with the min and max, so noisy results stand out. The in-process
+    ones grow their iteration count until a run lasts at least MIN_RUN_S.
+    With -c the results are printed as CSV (the label column tells builds apart),
+    so two builds can be compared by concatenating their files.
+
+    To build:
+    make shell-bench
+
+    To run:
+    ./shell-bench [-r runs] [-c] [-l label]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include "spawn.h"
+#include "builtins.h"
+#include "vars.h"
+#include "lexer.h"
+#include "wildcard.h"
+#include "complete.h"
+
+#define MIN_RUN_S 0.2
+#define RUNS_MAX 100
+#define LOOP_COMMANDS 200000
+#define EXTERNAL_COMMANDS 2000
+#define BACKGROUND_JOBS 2000
+#define PIPELINE_MB 256
+#define GLOB_FILES 20000
+#define HISTORY_ENTRIES 1000000
+
+extern char **environ;
+
+struct bench
+{
+    const char *name;
+    const char *unit;
+    double (*run)(void); // One run, returns the rate
+};
+
+static const char *shell = "./MyShell";
+static char script_path[] = "/tmp/shell-bench-XXXXXX";
+static char glob_dir[] = "/tmp/shell-bench-glob-XXXXXX";
+static char history_path[] = "/tmp/shell-bench-history-XXXXXX";
+static int devnull;
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Calls 'op' with growing batch sizes until a batch lasts MIN_RUN_S, returns operations per second
+static double rate(void (*op)(long))
+{
+    for (long n = 64;; n *= 2)
+    {
+        double start = now_s();
+        op(n);
+        double elapsed = now_s() - start;
+        if (elapsed >= MIN_RUN_S)
+            return n / elapsed;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  IN-PROCESS   **********////////////////////
+/////////////////////////////////////////////////////////////////////
+
+static void lex_lines(long n)
+{
+    static const char line[] = "grep -n \"$PATTERN\" 'file name.txt' src/*.c | sort -u > out.txt 2> err.log &";
+    static struct arena a = ARENA_INIT;
+    char buf[sizeof(line)];
+    struct token *tokens;
+
+    for (long i = 0; i < n; i++)
+    {
+        memcpy(buf, line, sizeof(line)); // lex() unquotes in place
+        lex(&a, buf, &tokens);
+        arena_reset(&a);
+    }
+}
+
+static double bench_lex(void)
+{
+    return rate(lex_lines);
+}
+
+static void expand_word(long n)
+{
+    static struct arena a = ARENA_INIT;
+    for (long i = 0; i < n; i++)
+    {
+        expand_variables(&a, "$BENCH_DIR/${BENCH_NAME}_$BENCH_N.log");
+        arena_reset(&a);
+    }
+}
+
+static double bench_expand(void)
+{
+    return rate(expand_word);
+}
+
+static void dispatch_true(long n)
+{
+    char *argv[] = {"true", NULL};
+    int fds[3] = {-1, -1, -1};
+    for (long i = 0; i < n; i++)
+        builtin_run(builtin_find(argv[0]), argv, fds);
+}
+
+static double bench_dispatch(void)
+{
+    return rate(dispatch_true);
+}
+
+static void spawn_true(long n)
+{
+    char *argv[] = {"/bin/true", NULL};
+    for (long i = 0; i < n; i++)
+    {
+        int status;
+        pid_t pid = spawn_command(argv, -1, devnull, devnull);
+        if (pid < 0)
+        {
+            perror(argv[0]);
+            exit(1);
+        }
+        waitpid(pid, &status, 0);
+    }
+}
+
+static double bench_spawn(void)
+{
+    return rate(spawn_true);
+}
+
+static void glob_txt(long n)
+{
+    static struct arena a = ARENA_INIT;
+    char pattern[PATH_MAX];
+    int count;
+    snprintf(pattern, sizeof(pattern), "%s/%c.txt", glob_dir, GLOB_STAR);
+    for (long i = 0; i < n; i++)
+    {
+        glob_expand(&a, pattern, &count);
+        arena_reset(&a);
+    }
+}
+
+static double bench_glob(void)
+{
+    return rate(glob_txt);
+}
+
+// GLOB_FILES files, half of them *.txt, in a directory dated back so the cache trusts it at once
+static void make_glob_dir(void)
+{
+    char path[PATH_MAX];
+    if (!mkdtemp(glob_dir))
+    {
+        perror(glob_dir);
+        exit(1);
+    }
+    for (int i = 0; i < GLOB_FILES; i++)
+    {
+        snprintf(path, sizeof(path), "%s/file%05d.%s", glob_dir, (i * 7919) % GLOB_FILES, (i % 2) ? "txt" : "log");
+        int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd >= 0)
+            close(fd);
+    }
+    struct timespec times[2] = {{0, UTIME_OMIT}, {time(NULL) - 10, 0}};
+    utimensat(AT_FDCWD, glob_dir, times, 0);
+}
+
+static void remove_glob_dir(void)
+{
+    char path[PATH_MAX];
+    for (int i = 0; i < GLOB_FILES; i++)
+    {
+        snprintf(path, sizeof(path), "%s/file%05d.%s", glob_dir, (i * 7919) % GLOB_FILES, (i % 2) ? "txt" : "log");
+        unlink(path);
+    }
+    rmdir(glob_dir);
+}
+
+static void search_history(long n)
+{
+    char *argv[] = {"history", "-s", "fix 12345", NULL};
+    int fds[3] = {-1, devnull, -1};
+    for (long i = 0; i < n; i++)
+        builtin_run(builtin_find(argv[0]), argv, fds);
+}
+
+static double bench_history(void)
+{
+    return rate(search_history);
+}
+
+static void complete_command(long n)
+{
+    static struct arena a = ARENA_INIT;
+    struct completion c;
+    for (long i = 0; i < n; i++)
+    {
+        complete(&a, "gi", 2, &c);
+        arena_reset(&a);
+    }
+}
+
+static double bench_complete(void)
+{
+    return rate(complete_command);
+}
+
+// HISTORY_ENTRIES lines as HISTFILE (the warm-up run maps it and builds the index)
+static void make_history(void)
+{
+    static const char *commands[] = {"git commit -m 'fix %d'", "make -j8 test%d", "cd src/module%d", "ls -la build/%d",
+                                     "grep -rn pattern%d ."};
+    int fd = mkstemp(history_path);
+    FILE *f = (fd >= 0) ? fdopen(fd, "w") : NULL;
+    if (!f)
+    {
+        perror(history_path);
+        exit(1);
+    }
+    for (int i = 0; i < HISTORY_ENTRIES; i++)
+    {
+        fprintf(f, commands[i % 5], i / 5);
+        fputc('\n', f);
+    }
+    fclose(f);
+    var_set("HISTFILE", history_path, 0);
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  END TO END   **********////////////////////
+/////////////////////////////////////////////////////////////////////
+
+// Write "for i in 1 ... n; do <body>; done<tail>" as the script
+static void write_loop(int n, const char *body, const char *tail)
+{
+    FILE *f = fopen(script_path, "w");
+    if (!f)
+    {
+        perror(script_path);
+        exit(1);
+    }
+    fprintf(f, "for i in");
+    for (int i = 1; i <= n; i++)
+        fprintf(f, " %d", i);
+    fprintf(f, "\ndo\n    %s\ndone\n%s", body, tail);
+    fclose(f);
+}
+
+// Seconds ./MyShell takes to run the script (or "-c command"), output thrown away
+static double run_shell(const char *command)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, devnull, STDOUT_FILENO);
+
+    char *argv[] = {(char *)shell, command ? "-c" : script_path, (char *)command, NULL};
+    double start = now_s();
+    pid_t pid;
+    if (posix_spawn(&pid, shell, &actions, NULL, argv, environ) != 0)
+    {
+        perror(shell);
+        exit(1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    double elapsed = now_s() - start;
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        fprintf(stderr, "%s: exit status %d\n", shell, WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    return elapsed;
+}
+
+static double bench_loop(void)
+{
+    return LOOP_COMMANDS / run_shell(NULL);
+}
+
+static double bench_external(void)
+{
+    return EXTERNAL_COMMANDS / run_shell(NULL);
+}
+
+static double bench_pipeline(void)
+{
+    char command[64];
+    snprintf(command, sizeof(command), "head -c %dM /dev/zero | cat > /dev/null", PIPELINE_MB);
+    return PIPELINE_MB / run_shell(command);
+}
+
+static double bench_background(void)
+{
+    return BACKGROUND_JOBS / run_shell(NULL);
+}
+
+// The end-to-end benchmarks share one script file, written before their runs
+static void prepare(const char *name)
+{
+    if (strcmp(name, "loop") == 0)
+        write_loop(LOOP_COMMANDS, "true", "");
+    else if (strcmp(name, "external") == 0)
+        write_loop(EXTERNAL_COMMANDS, "/bin/true", "");
+    else if (strcmp(name, "background") == 0)
+        write_loop(BACKGROUND_JOBS, "/bin/true &", "wait\n");
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench benches[] = {
+        {"lex", "lines/s", bench_lex},
+        {"expand", "words/s", bench_expand},
+        {"dispatch", "calls/s", bench_dispatch},
+        {"spawn", "spawns/s", bench_spawn},
+        {"glob", "globs/s", bench_glob},
+        {"history", "searches/s", bench_history},
+        {"complete", "tabs/s", bench_complete},
+        {"loop", "commands/s", bench_loop},
+        {"external", "commands/s", bench_external},
+        {"pipeline", "MB/s", bench_pipeline},
+        {"background", "jobs/s", bench_background},
+    };
+    int runs = 5, csv = 0;
+    const char *label = "MyShell";
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+            label = argv[++i];
+        else if (strcmp(argv[i], "-c") == 0)
+            csv = 1;
+        else
+        {
+            fprintf(stderr, "usage: %s [-r runs] [-c] [-l label]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (runs < 1 || runs > RUNS_MAX)
+        runs = 5;
+
+    builtins_init();
+    vars_init();
+    var_set("BENCH_DIR", "/var/tmp/bench", 0);
+    var_set("BENCH_NAME", "shell", 0);
+    var_set("BENCH_N", "42", 0);
+
+    devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    int fd = mkstemp(script_path);
+    if (devnull < 0 || fd < 0)
+    {
+        perror("shell-bench");
+        return 1;
+    }
+    close(fd);
+    make_glob_dir();
+    make_history();
+
+    if (csv)
+        printf("label,benchmark,unit,median,min,max,runs\n");
+    else
+        printf("%-10s %-12s %14s %14s %14s %7s\n", "benchmark", "unit", "median", "min", "max", "spread");
+
+    for (int b = 0; b < (int)(sizeof(benches) / sizeof(benches[0])); b++)
+    {
+        double results[RUNS_MAX];
+        prepare(benches[b].name);
+        benches[b].run(); // Warm-up: caches, page faults, the command hash table
+        for (int r = 0; r < runs; r++)
+            results[r] = benches[b].run();
+        qsort(results, runs, sizeof(double), compare_doubles);
+
+        double median = (runs % 2) ? results[runs / 2] : (results[runs / 2 - 1] + results[runs / 2]) / 2;
+        if (csv)
+            printf("%s,%s,%s,%.1f,%.1f,%.1f,%d\n", label, benches[b].name, benches[b].unit, median, results[0],
+                   results[runs - 1], runs);
+        else
+            printf("%-10s %-12s %14.1f %14.1f %14.1f %6.1f%%\n", benches[b].name, benches[b].unit, median, results[0],
+                   results[runs - 1], 100 * (results[runs - 1] - results[0]) / median);
+        fflush(stdout);
+    }
+
+    unlink(script_path);
+    remove_glob_dir();
+    unlink(history_path);
+    close(devnull);
+    return 0;
+}
@@ -0,0 +1,299 @@
+/*
+    End-to-end checks for MyShell: each one runs ./MyShell on a generated script
+    and looks at what the shell left behind, for the regressions a benchmark
+    would run right through:
+        background  "true &" 2000 times in a loop: finished jobs are reaped as
+                    new ones start, so the shell holds a few zombies and pidfds,
+                    not one per job
+        trace       TRACE set around 1500 "$(...)" that run in forked subshells:
+                    the trace must parse as JSON with every span in it once
+                    (a subshell inherits the spans the shell hasn't written yet)
+    Each check prints "ok" or "FAIL" and why, the exit status is 1 if any failed.
+
+    To build:
+    make shell-check
+
+    To run:
+    ./shell-check
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#define BACKGROUND_JOBS 2000
+#define BACKGROUND_MAX 100 // Fds or children the shell may still hold after the loop
+#define OUTPUT_MAX (1 << 20)
+#define TRACE_SUBSTITUTIONS 1500 // More spans than the shell buffers before a write
+
+extern char **environ;
+
+static const char *shell = "./MyShell";
+static char script_path[] = "/tmp/shell-check-XXXXXX";
+
+// Run the script, returns its stdout (NUL-terminated, cut at OUTPUT_MAX) and sets *status, stderr is thrown away
+static char *run_shell(int *status)
+{
+    static char output[OUTPUT_MAX + 1];
+    int out[2];
+    if (pipe(out) != 0)
+    {
+        perror("pipe");
+        exit(1);
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, out[0]);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0); // (the trace summary)
+
+    char *argv[] = {(char *)shell, script_path, NULL};
+    pid_t pid;
+    if (posix_spawn(&pid, shell, &actions, NULL, argv, environ) != 0)
+    {
+        perror(shell);
+        exit(1);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    close(out[1]);
+
+    // Keep reading past OUTPUT_MAX so the shell never blocks on a full pipe
+    size_t len = 0;
+    char discard[4096];
+    ssize_t n;
+    while ((n = (len < OUTPUT_MAX) ? read(out[0], output + len, OUTPUT_MAX - len)
+                                   : read(out[0], discard, sizeof(discard))) > 0)
+        len += (len < OUTPUT_MAX) ? (size_t)n : 0;
+    output[len] = '\0';
+    close(out[0]);
+
+    waitpid(pid, status, 0);
+    return output;
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  JSON   **********//////////////////////////
+/////////////////////////////////////////////////////////////////////
+
+// Just enough of a JSON parser to tell valid text from invalid: each function skips one element
+static const char *json_value(const char *p);
+
+static const char *json_space(const char *p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+        p++;
+    return p;
+}
+
+static const char *json_string(const char *p)
+{
+    if (*p++ != '"')
+        return NULL;
+    for (; *p != '"'; p++)
+    {
+        if ((unsigned char)*p < ' ')
+            return NULL; // The end of the text too
+        if (*p == '\\' && !*++p)
+            return NULL;
+    }
+    return p + 1;
+}
+
+// An object or an array: values (after a "key": in an object) separated by commas
+static const char *json_list(const char *p, char close, int keys)
+{
+    p = json_space(p + 1);
+    if (*p == close)
+        return p + 1;
+    while (1)
+    {
+        if (keys)
+        {
+            p = json_string(p);
+            if (!p || *(p = json_space(p)) != ':')
+                return NULL;
+            p++;
+        }
+        p = json_value(p);
+        if (!p)
+            return NULL;
+        p = json_space(p);
+        if (*p == close)
+            return p + 1;
+        if (*p != ',')
+            return NULL;
+        p = json_space(p + 1);
+    }
+}
+
+static const char *json_value(const char *p)
+{
+    static const char *const words[] = {"true", "false", "null"};
+
+    p = json_space(p);
+    if (*p == '{')
+        return json_list(p, '}', 1);
+    if (*p == '[')
+        return json_list(p, ']', 0);
+    if (*p == '"')
+        return json_string(p);
+    if (*p == '-' || isdigit((unsigned char)*p))
+    {
+        char *end;
+        strtod(p, &end);
+        return end;
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        if (strncmp(p, words[i], strlen(words[i])) == 0)
+            return p + strlen(words[i]);
+    }
+    return NULL;
+}
+
+static int json_valid(const char *text)
+{
+    const char *end = json_value(text);
+    return end && *json_space(end) == '\0';
+}
+
+static int compare_lines(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// How many lines of 'text' repeat an earlier one (the text is cut into lines)
+static int duplicate_lines(char *text)
+{
+    size_t n = 0, cap = 1024;
+    char **lines = malloc(cap * sizeof(char *));
+    for (char *line = strtok(text, "\n"); line; line = strtok(NULL, "\n"))
+    {
+        if (n == cap)
+            lines = realloc(lines, (cap *= 2) * sizeof(char *));
+        lines[n++] = line;
+    }
+    qsort(lines, n, sizeof(char *), compare_lines);
+
+    int duplicates = 0;
+    for (size_t i = 1; i < n; i++)
+        duplicates += (strcmp(lines[i - 1], lines[i]) == 0);
+    free(lines);
+    return duplicates;
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  CHECKS   **********////////////////////////
+/////////////////////////////////////////////////////////////////////
+
+static int check_background(void)
+{
+    // The loop, then a child of the shell counts the shell's fds and children (zombies included)
+    FILE *f = fopen(script_path, "w");
+    if (!f)
+    {
+        perror(script_path);
+        exit(1);
+    }
+    fprintf(f, "for i in");
+    for (int i = 1; i <= BACKGROUND_JOBS; i++)
+        fprintf(f, " %d", i);
+    fprintf(f, "\ndo\n    true &\ndone\n"
+               "/bin/sh -c 'echo held: $(ls /proc/$PPID/fd | wc -l) $(wc -w < /proc/$PPID/task/$PPID/children)'\n"
+               "wait\n");
+    fclose(f);
+
+    int status;
+    char *held = strstr(run_shell(&status), "held:");
+    int fds, children;
+    if (!held || sscanf(held, "held: %d %d", &fds, &children) != 2)
+    {
+        printf("FAIL background: no count in the output\n");
+        return 1;
+    }
+    if (fds > BACKGROUND_MAX || children > BACKGROUND_MAX)
+    {
+        printf("FAIL background: %d fds and %d children held after %d jobs\n", fds, children, BACKGROUND_JOBS);
+        return 1;
+    }
+    printf("ok   background: %d fds and %d children held after %d jobs\n", fds, children, BACKGROUND_JOBS);
+    return 0;
+}
+
+static int check_trace(void)
+{
+    char trace_path[sizeof(script_path) + 8];
+    snprintf(trace_path, sizeof(trace_path), "%s.json", script_path);
+
+    // Each "$(true; echo $i)" is a list: it runs in a fork of the shell
+    FILE *f = fopen(script_path, "w");
+    if (!f)
+    {
+        perror(script_path);
+        exit(1);
+    }
+    fprintf(f, "TRACE=%s\nfor i in", trace_path);
+    for (int i = 1; i <= TRACE_SUBSTITUTIONS; i++)
+        fprintf(f, " %d", i);
+    fprintf(f, "\ndo\n    x=$(true; echo $i)\ndone\nunset TRACE\n");
+    fclose(f);
+
+    int status;
+    run_shell(&status);
+
+    char *text = NULL;
+    size_t len = 0;
+    f = fopen(trace_path, "r");
+    if (f)
+    {
+        fseek(f, 0, SEEK_END);
+        len = ftell(f);
+        rewind(f);
+        text = malloc(len + 1);
+        len = fread(text, 1, len, f);
+        text[len] = '\0';
+        fclose(f);
+    }
+    unlink(trace_path);
+
+    int failed = 1;
+    if (!text)
+        printf("FAIL trace: %s wasn't written\n", trace_path);
+    else if (!json_valid(text))
+        printf("FAIL trace: the %zu bytes written aren't valid JSON\n", len);
+    else
+    {
+        int duplicates = duplicate_lines(text);
+        if (duplicates)
+            printf("FAIL trace: %d spans written twice\n", duplicates);
+        else
+            printf("ok   trace: %zu bytes of valid JSON, no span written twice\n", len);
+        failed = (duplicates != 0);
+    }
+    free(text);
+    return failed;
+}
+
+int main(void)
+{
+    int fd = mkstemp(script_path);
+    if (fd < 0)
+    {
+        perror("shell-check");
+        return 1;
+    }
+    close(fd);
+
+    int failed = 0;
+    failed += check_background();
+    failed += check_trace();
+
+    unlink(script_path);
+    return failed ? 1 : 0;
+}
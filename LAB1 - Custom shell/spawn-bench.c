@@ -0,0 +1,86 @@
+/*
+    Compares the launch latency of fork() + execve() with posix_spawn (spawn.c)
+    while the process holds more and more memory, like a shell with a long history.
+    Both start the command from the same path (looked up once in the PATH cache)
+    and the same environment, so only the launch itself differs.
+
+    To build:
+    make spawn-bench
+
+    To run:
+    ./spawn-bench [iterations] [command]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "spawn.h"
+#include "vars.h"
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Average microseconds to launch 'argv' and reap it
+static double measure(pid_t (*launch)(char *[], int, int, int), char *argv[], int iterations)
+{
+    double start = now_us();
+    for (int i = 0; i < iterations; i++)
+    {
+        int status;
+        pid_t pid = launch(argv, -1, -1, -1);
+        if (pid < 0)
+        {
+            perror(argv[0]);
+            exit(1);
+        }
+        waitpid(pid, &status, 0);
+    }
+    return (now_us() - start) / iterations;
+}
+
+int main(int argc, char *argv[])
+{
+    int iterations = (argc > 1) ? atoi(argv[1]) : 200;
+    char *command[] = {(argc > 2) ? argv[2] : "true", NULL};
+    const int rss_mb[] = {0, 64, 256, 1024};
+
+    // Commands get the environment through the shell's variable table
+    vars_init();
+
+    printf("%8s %14s %14s %8s\n", "rss_mb", "fork+exec(us)", "spawn(us)", "speedup");
+    for (int i = 0; i < (int)(sizeof(rss_mb) / sizeof(rss_mb[0])); i++)
+    {
+        /*
+        Grow the RSS: touch every page so fork() has page tables to copy.
+        A shell heap is made of small pages, so don't let huge pages hide the cost.
+        */
+        size_t size = (size_t)rss_mb[i] << 20;
+        char *ballast = NULL;
+        if (size)
+        {
+            ballast = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ballast == MAP_FAILED)
+            {
+                fprintf(stderr, "Skipping %d MB: out of memory\n", rss_mb[i]);
+                continue;
+            }
+            madvise(ballast, size, MADV_NOHUGEPAGE);
+            memset(ballast, 1, size);
+        }
+
+        double forked = measure(fork_command, command, iterations);
+        double spawned = measure(spawn_command, command, iterations);
+        printf("%8d %14.1f %14.1f %7.1fx\n", rss_mb[i], forked, spawned, forked / spawned);
+
+        if (ballast)
+            munmap(ballast, size);
+    }
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include <spawn.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include "spawn.h"
+#include "pathcache.h"
+#include "vars.h"
+
+pid_t spawn_command_in_group(char *argv[], int in_fd, int out_fd, int err_fd, pid_t pgid)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t mask, defaults;
+    pid_t pid;
+
+    // Resolve the command through the hash table, so PATH isn't walked on every launch
+    const char *path = path_lookup(argv[0]);
+    if (!path)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    // Wire up stdin/stdout/stderr (pipe ends and files are O_CLOEXEC, dup2 clears it on the copy)
+    posix_spawn_file_actions_init(&actions);
+    if (in_fd >= 0)
+        posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+    if (out_fd >= 0)
+        posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+    if (err_fd >= 0)
+        posix_spawn_file_actions_adddup2(&actions, err_fd, STDERR_FILENO);
+
+    /*
+    Signal setup the shell needs:
+        - the child starts with nothing blocked
+        - the signals the shell catches or ignores go back to their default action
+    */
+    posix_spawnattr_init(&attr);
+    sigemptyset(&mask);
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGCHLD);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGQUIT);
+    sigaddset(&defaults, SIGPIPE);
+    sigaddset(&defaults, SIGTSTP);
+    sigaddset(&defaults, SIGTTIN);
+    sigaddset(&defaults, SIGTTOU);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+
+    // Background jobs get their own process group (0 = the child leads a new one)
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    if (pgid >= 0)
+    {
+        posix_spawnattr_setpgroup(&attr, pgid);
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    // The cached envp: the environment is only repacked after an export/unset
+    int err = posix_spawn(&pid, path, &actions, &attr, argv, vars_environ());
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (err != 0)
+    {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+pid_t spawn_command(char *argv[], int in_fd, int out_fd, int err_fd)
+{
+    return spawn_command_in_group(argv, in_fd, out_fd, err_fd, -1);
+}
+
+pid_t fork_command(char *argv[], int in_fd, int out_fd, int err_fd)
+{
+    // Same path and environment as spawn_command, so only the launch itself differs
+    const char *path = path_lookup(argv[0]);
+    char **env = vars_environ();
+    if (!path)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+
+        if (in_fd >= 0)
+            dup2(in_fd, STDIN_FILENO);
+        if (out_fd >= 0)
+            dup2(out_fd, STDOUT_FILENO);
+        if (err_fd >= 0)
+            dup2(err_fd, STDERR_FILENO);
+
+        execve(path, argv, env);
+        _exit(127);
+    }
+    return pid;
+}
@@ -0,0 +1,20 @@
+#include <sys/types.h>
+
+/*
+Process launch for MyShell.
+	spawn_command: posix_spawn(), which glibc runs with clone(CLONE_VM|CLONE_VFORK),
+	               so the cost doesn't grow with the shell's memory (no page table copy).
+	               The path comes from the command hash table (pathcache.c).
+	fork_command:  the classic fork() + execve(), kept for comparison (spawn-bench)
+Both pass the shell's cached environment (vars_environ() in vars.c).
+
+in_fd / out_fd / err_fd become the child's stdin / stdout / stderr (-1 = inherit the shell's).
+Both return the child's pid, or -1 with errno set if it couldn't be started.
+*/
+
+pid_t spawn_command(char *argv[], int in_fd, int out_fd, int err_fd);
+
+// spawn_command() into process group 'pgid' (0 = a new group led by the child, -1 = the shell's)
+pid_t spawn_command_in_group(char *argv[], int in_fd, int out_fd, int err_fd, pid_t pgid);
+
+pid_t fork_command(char *argv[], int in_fd, int out_fd, int err_fd);
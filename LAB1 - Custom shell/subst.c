@@ -0,0 +1,274 @@
+#define _GNU_SOURCE // memfd_create(), pipe2()
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "myshell.h"
+#include "ast.h"
+#include "script.h"
+#include "subst.h"
+#include "builtins.h"
+#include "spawn.h"
+#include "vars.h"
+#include "acct.h"
+#include "memo.h"
+#include "joblog.h"
+#include "trace.h"
+
+#define READ_MIN 65536 // Smallest read from a pipe: the buffer doubles before it gets below that
+
+enum how
+{
+    IN_SHELL, // A builtin that only prints, run by the shell itself
+    SPAWN,    // One external command, posix_spawn()ed onto a pipe
+    SUBSHELL, // Anything else, in a fork() of the shell
+};
+
+static int capture_fd = -1; // memfd the in-shell builtins write to (truncated after each use)
+static int capturing = 0;   // capture_fd is in use
+
+// Drop the trailing newlines (in place) and NUL-terminate
+static char *trim(char *buf, size_t len, size_t *out_len)
+{
+    while (len > 0 && buf[len - 1] == '\n')
+        len--;
+    buf[len] = '\0';
+    *out_len = len;
+    return buf;
+}
+
+// Everything up to EOF, read in chunks as large as the room left in a buffer that doubles
+static char *read_all(struct arena *a, int fd, size_t *out_len)
+{
+    size_t cap = 2 * READ_MIN, len = 0;
+    char *buf = arena_alloc(a, cap);
+
+    for (;;)
+    {
+        if (cap - len - 1 < READ_MIN)
+        {
+            buf = arena_grow(a, buf, cap, cap * 2);
+            cap *= 2;
+        }
+        ssize_t n = read(fd, buf + len, cap - len - 1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        len += n;
+    }
+    return trim(buf, len, out_len);
+}
+
+static int wait_child(pid_t pid)
+{
+    struct rusage usage;
+    int status;
+    pid_t waited;
+    do
+        waited = wait4(pid, &status, 0, &usage);
+    while (waited < 0 && errno == EINTR);
+
+    if (waited < 0)
+        return 1;
+    acct_child(&usage);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+/*
+A single simple command whose name is written out (not expanded) can skip the
+fork: decided from the tokens, before anything is expanded (expanding twice would
+run nested substitutions twice).
+*/
+static enum how choose(struct node *n, const struct builtin **builtin)
+{
+    if (n->next || n->type != NODE_PIPELINE)
+        return SUBSHELL;
+
+    struct token *t = n->tokens;
+    if (t->type != TOK_WORD || (t->flags & (WORD_EXPAND | WORD_LITERAL | WORD_GLOB)) || is_assignment(t->text)
+        || script_handles(t->text))
+        return SUBSHELL;
+    for (struct token *u = t; u->type != TOK_END; u++)
+    {
+        if (u->type == TOK_PIPE || u->type == TOK_AMP)
+            return SUBSHELL;
+    }
+
+    *builtin = builtin_find(t->text);
+    if (!*builtin)
+        return SPAWN;
+    // echo, memo and the utilities only print: cd, exit, export, ... must not touch this shell
+    if (((*builtin)->utility || (*builtin)->fn == handle_echo || (*builtin)->fn == handle_memo) && !capturing)
+        return IN_SHELL;
+    return SUBSHELL;
+}
+
+static char *run_in_shell(struct arena *a, const struct builtin *builtin, struct command *command,
+                          size_t *out_len, int *status)
+{
+    int fds[3];
+    if (capture_fd < 0)
+        capture_fd = memfd_create("MyShell-subst", MFD_CLOEXEC);
+    if (capture_fd < 0 || open_redirections(&command->redirs, fds) != 0)
+    {
+        if (capture_fd < 0)
+            perror("MyShell: memfd_create");
+        *status = 1;
+        *out_len = 0;
+        return "";
+    }
+
+    // The builtin's stdout shares the memfd's offset, which ends up at the size of what it wrote
+    int captured = (fds[1] < 0);
+    if (captured)
+        fds[1] = capture_fd;
+    capturing = 1;
+    *status = builtin_run(builtin, command->args, fds);
+    capturing = 0;
+    if (captured)
+        fds[1] = -1;
+    close_redirections(fds);
+
+    off_t size = lseek(capture_fd, 0, SEEK_CUR);
+    char *buf = arena_alloc(a, (size > 0 ? size : 0) + 1);
+    size_t len = 0;
+    while (size > 0 && len < (size_t)size)
+    {
+        ssize_t n = pread(capture_fd, buf + len, size - len, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        len += n;
+    }
+    if (ftruncate(capture_fd, 0) != 0 || lseek(capture_fd, 0, SEEK_SET) != 0)
+    {
+        close(capture_fd); // A fresh one next time
+        capture_fd = -1;
+    }
+    return trim(buf, len, out_len);
+}
+
+static char *run_spawned(struct arena *a, struct command *command, int out[2], size_t *out_len, int *status)
+{
+    int fds[3];
+    *out_len = 0;
+    if (open_redirections(&command->redirs, fds) != 0)
+    {
+        close(out[1]);
+        *status = 1;
+        return "";
+    }
+
+    pid_t pid = spawn_command_in_group(command->args, fds[0], (fds[1] >= 0) ? fds[1] : out[1], fds[2], -1);
+    int spawn_errno = errno;
+    close(out[1]);
+    close_redirections(fds);
+    if (pid < 0)
+    {
+        fprintf(stderr, "\033[1;31m%s: %s\033[0m\n", command->args[0], strerror(spawn_errno));
+        *status = 127;
+        return "";
+    }
+
+    char *output = read_all(a, out[0], out_len);
+    *status = wait_child(pid);
+    return output;
+}
+
+static char *run_subshell(struct arena *a, struct node *n, int out[2], size_t *out_len, int *status)
+{
+    // Nothing buffered may be written twice: by the shell and by its copy
+    fflush(stdout);
+    fflush(stderr);
+    joblog_flush();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        trace_forked();
+        dup2(out[1], STDOUT_FILENO);
+        int s = script_run(n);
+        if (s == BUILTIN_EXIT)
+            s = script_exit_status();
+        fflush(stdout);
+        joblog_flush(); // The records of what the subshell ran itself
+        _exit(s & 0xff);
+    }
+    close(out[1]);
+    if (pid < 0)
+    {
+        perror("MyShell: fork");
+        *status = 1;
+        *out_len = 0;
+        return "";
+    }
+
+    char *output = read_all(a, out[0], out_len);
+    *status = wait_child(pid);
+    return output;
+}
+
+char *command_substitute(struct arena *a, const char *text, size_t len, size_t *out_len, int *status)
+{
+    // Lexing unquotes in place, and the word may be run again (a loop): work on a copy
+    char *copy = arena_strndup(a, text, len);
+    struct token *tokens;
+    *out_len = 0;
+    *status = 2;
+    if (lex(a, copy, &tokens) < 0)
+        return "";
+
+    struct parser p = PARSER_INIT(a, tokens, NULL);
+    struct node *head = NULL, **tail = &head;
+    while (p.t->type != TOK_END)
+    {
+        struct node *node;
+        enum parse_result r = parse_command(&p, &node);
+        if (r == PARSE_INCOMPLETE)
+            fprintf(stderr, "\033[1;31mMyShell: syntax error: unexpected end of $(...)\033[0m\n");
+        if (r != PARSE_OK)
+            return "";
+        *tail = node;
+        while (*tail)
+            tail = &(*tail)->next;
+    }
+    *status = 0;
+    if (!head)
+        return "";
+
+    const struct builtin *builtin = NULL;
+    struct command *commands = NULL;
+    enum how how = choose(head, &builtin);
+    if (how == IN_SHELL || how == SPAWN)
+    {
+        char background_flag;
+        int n_stages = parse_pipeline(a, head->tokens, &commands, &background_flag);
+        if (n_stages != 1)
+        {
+            *status = (n_stages == EXPANSION_FAILED) ? 1 : 2;
+            return "";
+        }
+        if (how == IN_SHELL)
+            return run_in_shell(a, builtin, &commands[0], out_len, status);
+    }
+
+    int out[2];
+    if (pipe2(out, O_CLOEXEC) != 0)
+    {
+        perror("MyShell: pipe2");
+        *status = 1;
+        return "";
+    }
+    char *output;
+    if (how == SPAWN)
+        output = run_spawned(a, &commands[0], out, out_len, status);
+    else
+        output = run_subshell(a, head, out, out_len, status);
+    close(out[0]);
+    return output;
+}
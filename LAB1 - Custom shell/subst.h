@@ -0,0 +1,19 @@
+#include <stddef.h>
+
+/*
+Command substitution: $(command) expands to what the command writes on stdout,
+trailing newlines removed. The text is lexed and parsed when the word is expanded.
+    - a single builtin that only prints (echo, printf, pwd, test, memo ...) runs in the
+      shell itself, no process is created: its output goes to an in-memory file
+      (memfd) that is read back in one pread()
+    - a single external command is started with posix_spawn() straight onto a pipe
+    - anything else (pipelines, lists, loops, functions, cd, assignments, exit)
+      runs in a forked copy of the shell, so it can't change the shell's state
+Output is read from the pipe with large reads into a buffer that doubles in the
+arena (in place while it is the arena's last allocation).
+*/
+
+struct arena;
+
+// The vars_set_substitution() hook: run 'text' (its 'len' bytes), return its output in 'a'
+char *command_substitute(struct arena *a, const char *text, size_t len, size_t *out_len, int *status);
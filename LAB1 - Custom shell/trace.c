@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include "trace.h"
+#include "vars.h"
+
+#define TRACE_EVENTS 1024    // Spans buffered before a write is forced
+#define TRACE_EVENT_MAX 256  // Longest formatted span
+#define TRACE_BUCKETS 40     // Histogram bucket i: [2^i, 2^(i+1)) ns
+#define TRACE_BAR 40         // Width of the longest histogram bar
+
+struct span
+{
+    enum trace_phase phase;
+    long long start;
+    long long duration;
+    char detail[32];
+};
+
+struct histogram
+{
+    long long count;
+    long long total;
+    long long max;
+    long long buckets[TRACE_BUCKETS];
+};
+
+static const char *const phase_names[TRACE_PHASES] = {"prompt", "read", "lex", "parse", "expand",
+                                                      "builtin", "spawn", "wait", "reap", "command"};
+
+int trace_on = 0;
+
+static struct span spans[TRACE_EVENTS];
+static int n_spans = 0;
+static long long n_written = 0;
+static struct histogram histograms[TRACE_PHASES];
+static int trace_fd = -1;
+static char *trace_path = NULL;
+static long long origin; // Timestamps in the file count from here
+static pid_t trace_pid;
+
+long long trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void write_all(const char *buf, size_t len)
+{
+    for (size_t off = 0; off < len;)
+    {
+        ssize_t w = write(trace_fd, buf + off, len - off);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            break;
+        off += w;
+    }
+}
+
+static int bucket_of(long long ns)
+{
+    int b = 0;
+    while (ns > 1 && b < TRACE_BUCKETS - 1)
+    {
+        ns >>= 1;
+        b++;
+    }
+    return b;
+}
+
+void trace_event(enum trace_phase phase, long long start, const char *detail)
+{
+    // (a span that began before this trace did: TRACE was set while it ran)
+    if (trace_fd < 0 || start < origin)
+        return;
+
+    long long duration = trace_now() - start;
+    struct histogram *h = &histograms[phase];
+    h->count++;
+    h->total += duration;
+    if (duration > h->max)
+        h->max = duration;
+    h->buckets[bucket_of(duration)]++;
+
+    if (n_spans == TRACE_EVENTS)
+        trace_flush();
+    struct span *s = &spans[n_spans++];
+    s->phase = phase;
+    s->start = start;
+    s->duration = duration;
+    snprintf(s->detail, sizeof(s->detail), "%s", detail ? detail : "");
+}
+
+// The detail is a command name: keep it valid inside a JSON string
+static void json_text(char *out, size_t size, const char *text)
+{
+    size_t len = 0;
+    for (; *text && len + 2 < size; text++)
+    {
+        if (*text == '"' || *text == '\\')
+            out[len++] = '\\';
+        out[len++] = ((unsigned char)*text < ' ') ? ' ' : *text;
+    }
+    out[len] = '\0';
+}
+
+void trace_flush(void)
+{
+    static char batch[TRACE_EVENTS * TRACE_EVENT_MAX];
+    size_t len = 0;
+
+    for (int i = 0; i < n_spans; i++)
+    {
+        struct span *s = &spans[i];
+        char detail[2 * sizeof(s->detail)];
+        json_text(detail, sizeof(detail), s->detail);
+
+        // "X" = a complete span, times in microseconds
+        int n = snprintf(batch + len, TRACE_EVENT_MAX,
+                         "%s{\"name\":\"%s\",\"cat\":\"myshell\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                         "\"pid\":%d,\"tid\":%d,\"args\":{\"detail\":\"%s\"}}",
+                         n_written ? ",\n" : "", phase_names[s->phase], (s->start - origin) / 1e3,
+                         s->duration / 1e3, trace_pid, trace_pid, detail);
+        len += (n < TRACE_EVENT_MAX) ? n : TRACE_EVENT_MAX - 1;
+        n_written++;
+    }
+    n_spans = 0;
+    if (len > 0)
+        write_all(batch, len);
+}
+
+// "512ns", "3.2us", "41.0ms", "2.50s"
+static void format_duration(char *buf, size_t size, long long ns)
+{
+    if (ns < 1000)
+        snprintf(buf, size, "%lldns", ns);
+    else if (ns < 1000000)
+        snprintf(buf, size, "%.1fus", ns / 1e3);
+    else if (ns < 1000000000)
+        snprintf(buf, size, "%.1fms", ns / 1e6);
+    else
+        snprintf(buf, size, "%.2fs", ns / 1e9);
+}
+
+// Upper bound of the bucket holding the q-th quantile (at most the largest duration seen)
+static long long quantile(const struct histogram *h, double q)
+{
+    long long rank = (long long)(q * h->count), seen = 0;
+    for (int b = 0; b < TRACE_BUCKETS - 1; b++)
+    {
+        seen += h->buckets[b];
+        if (seen > rank)
+            return ((2LL << b) < h->max) ? (2LL << b) : h->max;
+    }
+    return h->max;
+}
+
+static void print_histograms(void)
+{
+    char total[32], mean[32], p50[32], p99[32], max[32], low[32], high[32];
+
+    fprintf(stderr, "trace: %lld spans written to %s\n", n_written, trace_path);
+    fprintf(stderr, "%-8s %9s %10s %10s %10s %10s %10s\n", "phase", "count", "total", "mean", "p50", "p99", "max");
+    for (int p = 0; p < TRACE_PHASES; p++)
+    {
+        struct histogram *h = &histograms[p];
+        if (h->count == 0)
+            continue;
+        format_duration(total, sizeof(total), h->total);
+        format_duration(mean, sizeof(mean), h->total / h->count);
+        format_duration(p50, sizeof(p50), quantile(h, 0.5));
+        format_duration(p99, sizeof(p99), quantile(h, 0.99));
+        format_duration(max, sizeof(max), h->max);
+        fprintf(stderr, "%-8s %9lld %10s %10s %10s %10s %10s\n", phase_names[p], h->count, total, mean, p50, p99, max);
+    }
+
+    // One log2 histogram per phase
+    for (int p = 0; p < TRACE_PHASES; p++)
+    {
+        struct histogram *h = &histograms[p];
+        long long most = 0;
+        for (int b = 0; b < TRACE_BUCKETS; b++)
+            most = (h->buckets[b] > most) ? h->buckets[b] : most;
+        if (most == 0)
+            continue;
+
+        fprintf(stderr, "\n%s\n", phase_names[p]);
+        for (int b = 0; b < TRACE_BUCKETS; b++)
+        {
+            if (h->buckets[b] == 0)
+                continue;
+            int width = (int)((h->buckets[b] * TRACE_BAR + most - 1) / most);
+            format_duration(low, sizeof(low), 1LL << b);
+            format_duration(high, sizeof(high), 2LL << b);
+            fprintf(stderr, "  %8s - %-8s |%-*.*s %lld\n", low, high, TRACE_BAR, width,
+                    "########################################", h->buckets[b]);
+        }
+    }
+}
+
+void trace_close(void)
+{
+    if (trace_fd < 0)
+        return;
+
+    trace_flush();
+    write_all("\n]\n", 3);
+    close(trace_fd);
+    print_histograms();
+
+    trace_fd = -1;
+    trace_on = 0;
+    free(trace_path);
+    trace_path = NULL;
+}
+
+static void trace_open(const char *path)
+{
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (trace_fd < 0)
+    {
+        fprintf(stderr, "\033[1;31mtrace: %s: %s\033[0m\n", path, strerror(errno));
+        return;
+    }
+    trace_path = strdup(path);
+    trace_pid = getpid();
+    origin = trace_now();
+    n_spans = 0;
+    n_written = 0;
+    memset(histograms, 0, sizeof(histograms));
+    write_all("[\n", 2);
+    trace_on = 1;
+}
+void trace_forked(void)
+{
+    if (trace_fd < 0)
+        return;
+
+    // Its copy of the fd only: the shell keeps writing to the file
+    close(trace_fd);
+    trace_fd = -1;
+    trace_on = 0;
+    n_spans = 0;
+    free(trace_path);
+    trace_path = NULL;
+}
+
+void trace_update(void)
+{
+    const char *path = var_lookup("TRACE", 5, NULL);
+    if (path && !*path)
+        path = NULL;
+
+    if (trace_path && (!path || strcmp(path, trace_path) != 0))
+        trace_close();
+    if (path && !trace_path && trace_fd < 0)
+    {
+        static char *failed = NULL; // Don't report the same unwritable file before every command
+        if (failed && strcmp(failed, path) == 0)
+            return;
+        trace_open(path);
+        free(failed);
+        failed = (trace_fd < 0) ? strdup(path) : NULL;
+    }
+}
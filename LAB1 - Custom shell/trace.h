@@ -0,0 +1,69 @@
+/*
+Latency tracing: with TRACE=<file> (in the environment, or set by any command)
+the shell times each phase of running a command and writes the spans to <file>
+as a Chrome trace (Trace Event Format: load it in chrome://tracing or Perfetto).
+When tracing stops (TRACE unset, another file, or the shell exits) a histogram
+of each phase's durations is printed on stderr.
+    prompt   getcwd() and printing the prompt
+    read     waiting for the line and reading it
+    lex      splitting the text into tokens
+    parse    building the command tree
+    expand   expanding a command's words
+    builtin  a builtin running in the shell
+    spawn    posix_spawn(): fork and exec, the child has exec'd when it returns
+    wait     waiting for a foreground command
+    reap     reaping background processes that exited
+    command  one complete command, from its first phase to its last
+Spans are buffered and written in batches. When tracing is off a phase
+costs one test of trace_on.
+*/
+
+enum trace_phase
+{
+    TRACE_PROMPT,
+    TRACE_READ,
+    TRACE_LEX,
+    TRACE_PARSE,
+    TRACE_EXPAND,
+    TRACE_BUILTIN,
+    TRACE_SPAWN,
+    TRACE_WAIT,
+    TRACE_REAP,
+    TRACE_COMMAND,
+    TRACE_PHASES
+};
+
+extern int trace_on;
+
+// CLOCK_MONOTONIC in nanoseconds
+long long trace_now(void);
+
+// Record a span of 'phase' from 'start' to now ('detail': a command name, or NULL)
+void trace_event(enum trace_phase phase, long long start, const char *detail);
+
+#define TRACE_BEGIN() (trace_on ? trace_now() : 0)
+#define TRACE_END(phase, start, detail)              \
+    do                                               \
+    {                                                \
+        if (start)                                   \
+            trace_event((phase), (start), (detail)); \
+    } while (0)
+
+/*
+Start, switch or stop tracing to follow the TRACE variable: vars.c calls it whenever
+TRACE is set or unset (at the prompt, in a script, in a loop), the shell once at startup.
+*/
+void trace_update(void);
+
+// Write the buffered spans
+void trace_flush(void);
+
+// Finish the trace file and print the histograms
+void trace_close(void);
+
+/*
+In a forked copy of the shell (a subshell, a builtin in a pipeline): stop tracing
+without writing anything. The spans it inherited are the shell's to write, and its
+own would go to the same file with the shell's pid.
+*/
+void trace_forked(void);
@@ -0,0 +1,519 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "lexer.h"
+#include "vars.h"
+#include "pathcache.h"
+#include "arith.h"
+#include "trace.h"
+
+#define VARS_MIN 64 // Initial number of slots (always a power of 2)
+
+extern char **environ;
+
+struct var
+{
+    char *name; // NULL = empty slot
+    char *value;
+    size_t value_len;
+    int exported;
+};
+
+static struct var *table = NULL;
+static unsigned int table_size = 0; // Slots
+static unsigned int table_used = 0; // Variables
+
+/*
+The environment handed to execve(), packed in one block (pointers then strings).
+env_generation moves on whenever an exported variable changes, the block is only
+rebuilt when it was built for an older generation.
+*/
+static char **envp = NULL;
+static unsigned long env_generation = 1;
+static unsigned long envp_generation = 0;
+
+// Special parameters
+static int last_status = 0;
+static const char *shell_name = "MyShell";
+static char *no_args[] = {NULL};
+static char **positional = no_args;
+
+// $(...)
+static char *(*substitute)(struct arena *a, const char *text, size_t len, size_t *out_len, int *status) = NULL;
+static int substitution_status = -1;
+static int expansion_failed = 0; // A $((...)) couldn't be evaluated
+
+// FNV-1a over the first 'len' bytes
+static unsigned int hash_name(const char *name, size_t len)
+{
+    unsigned int h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    return h;
+}
+
+// Slot holding the variable, or the empty slot where it would go
+static struct var *find_slot(struct var *slots, unsigned int size, const char *name, size_t len)
+{
+    unsigned int i = hash_name(name, len) & (size - 1);
+    while (slots[i].name && (strncmp(slots[i].name, name, len) != 0 || slots[i].name[len] != '\0'))
+        i = (i + 1) & (size - 1);
+    return &slots[i];
+}
+
+static void grow_table(void)
+{
+    unsigned int new_size = table_size ? table_size * 2 : VARS_MIN;
+    struct var *slots = calloc(new_size, sizeof(struct var));
+    if (!slots)
+    {
+        perror("MyShell: variables");
+        exit(1);
+    }
+
+    for (unsigned int i = 0; i < table_size; i++)
+    {
+        if (table[i].name)
+            *find_slot(slots, new_size, table[i].name, strlen(table[i].name)) = table[i];
+    }
+    free(table);
+    table = slots;
+    table_size = new_size;
+}
+
+// vars_init() is reading the environment: TRACE from there is picked up once the shell is set up
+static int importing = 0;
+
+void vars_init(void)
+{
+    importing = 1;
+    for (char **env = environ; *env; env++)
+    {
+        char *equals = strchr(*env, '=');
+        if (!equals)
+            continue;
+
+        char *name = strndup(*env, equals - *env);
+        var_set(name, equals + 1, 1);
+        free(name);
+    }
+    importing = 0;
+}
+
+const char *var_lookup(const char *name, size_t len, size_t *value_len)
+{
+    if (!table)
+        return NULL;
+
+    struct var *v = find_slot(table, table_size, name, len);
+    if (!v->name)
+        return NULL;
+    if (value_len)
+        *value_len = v->value_len;
+    return v->value;
+}
+
+void vars_each(void (*fn)(const char *name, void *data), void *data)
+{
+    for (unsigned int i = 0; i < table_size; i++)
+    {
+        if (table[i].name)
+            fn(table[i].name, data);
+    }
+}
+
+// var_set() for a name that is the first 'len' bytes of 'name'
+static void set_variable(const char *name, size_t len, const char *value, int export)
+{
+    // Keep the table at most half full so probe chains stay short
+    if (table_used * 2 >= table_size)
+        grow_table();
+
+    // Copy first: 'value' may be the variable's current value (var_export)
+    char *copy = strdup(value);
+    struct var *v = find_slot(table, table_size, name, len);
+    if (!v->name)
+    {
+        v->name = strndup(name, len);
+        v->exported = 0;
+        table_used++;
+    }
+    else
+        free(v->value);
+
+    v->value = copy;
+    v->value_len = strlen(copy);
+    v->exported |= export;
+
+    // Only exported variables reach the environment commands are started with
+    if (v->exported)
+        env_generation++;
+
+    // Commands may now resolve to different paths
+    if (len == 4 && strncmp(name, "PATH", 4) == 0)
+        path_cache_clear();
+
+    // Start, switch or stop tracing now, even in the middle of a loop or a script
+    if (len == 5 && strncmp(name, "TRACE", 5) == 0 && !importing)
+        trace_update();
+}
+
+void var_set(const char *name, const char *value, int export)
+{
+    set_variable(name, strlen(name), value, export);
+}
+
+void var_assign(const char *word, int export)
+{
+    size_t len = var_name_length(word);
+    set_variable(word, len, word + len + 1, export);
+}
+
+void vars_set_status(int status)
+{
+    last_status = status;
+}
+
+void vars_set_name(const char *name)
+{
+    shell_name = name;
+}
+
+char **vars_set_args(char **args)
+{
+    char **previous = positional;
+    positional = args ? args : no_args;
+    return previous;
+}
+
+char **vars_args(void)
+{
+    return positional;
+}
+
+int is_all_args(const struct token *t)
+{
+    return (t->flags & WORD_EXPAND) && strcmp(t->text, "$@") == 0;
+}
+
+int var_export(const char *name)
+{
+    const char *value = var_lookup(name, strlen(name), NULL);
+    var_set(name, value ? value : "", 1);
+    return 0;
+}
+
+void var_unset(const char *name)
+{
+    if (!table)
+        return;
+
+    struct var *v = find_slot(table, table_size, name, strlen(name));
+    if (!v->name)
+        return;
+    if (v->exported)
+        env_generation++;
+    free(v->name);
+    free(v->value);
+    v->name = NULL;
+    table_used--;
+
+    // Backward shift: pull later entries of the probe chain into the hole (no tombstones)
+    unsigned int hole = v - table;
+    for (unsigned int i = (hole + 1) & (table_size - 1); table[i].name; i = (i + 1) & (table_size - 1))
+    {
+        unsigned int home = hash_name(table[i].name, strlen(table[i].name)) & (table_size - 1);
+
+        // Move it if its home slot isn't in (hole, i] (cyclically)
+        if (((i - home) & (table_size - 1)) >= ((i - hole) & (table_size - 1)))
+        {
+            table[hole] = table[i];
+            table[i].name = NULL;
+            hole = i;
+        }
+    }
+
+    if (strcmp(name, "PATH") == 0)
+        path_cache_clear();
+    else if (strcmp(name, "TRACE") == 0)
+        trace_update();
+}
+
+char **vars_environ(void)
+{
+    if (envp && envp_generation == env_generation)
+        return envp;
+
+    // One pass to size the block, one to fill it
+    size_t n = 0, bytes = 0;
+    for (unsigned int i = 0; i < table_size; i++)
+    {
+        if (table[i].name && table[i].exported)
+        {
+            n++;
+            bytes += strlen(table[i].name) + table[i].value_len + 2;
+        }
+    }
+
+    char **block = malloc((n + 1) * sizeof(char *) + bytes);
+    if (!block)
+        return envp; // Keep using the old one
+    char *strings = (char *)(block + n + 1);
+
+    n = 0;
+    for (unsigned int i = 0; i < table_size; i++)
+    {
+        if (table[i].name && table[i].exported)
+        {
+            block[n++] = strings;
+            strings = stpcpy(strings, table[i].name);
+            *strings++ = '=';
+            memcpy(strings, table[i].value, table[i].value_len + 1);
+            strings += table[i].value_len + 1;
+        }
+    }
+    block[n] = NULL;
+
+    free(envp);
+    envp = block;
+    envp_generation = env_generation;
+    return envp;
+}
+
+size_t var_name_length(const char *s)
+{
+    size_t n = 0;
+    if (!isalpha((unsigned char)s[0]) && s[0] != '_')
+        return 0;
+    while (isalnum((unsigned char)s[n]) || s[n] == '_')
+        n++;
+    return n;
+}
+
+// Output of an expansion: grows by doubling at the end of the arena (in place while it's the last allocation)
+struct expansion
+{
+    struct arena *a;
+    char *buf;
+    size_t len;
+    size_t cap;
+};
+
+static void append(struct expansion *e, const char *s, size_t n)
+{
+    if (e->len + n + 1 > e->cap)
+    {
+        size_t cap = e->cap * 2;
+        while (cap < e->len + n + 1)
+            cap *= 2;
+        e->buf = arena_grow(e->a, e->buf, e->cap, cap);
+        e->cap = cap;
+    }
+    memcpy(e->buf + e->len, s, n);
+    e->len += n;
+}
+
+// $? $# $0 $1..$9 $@ $*
+static void expand_special(struct expansion *e, char c)
+{
+    char number[16];
+    int n_args = 0;
+    while (positional[n_args])
+        n_args++;
+
+    if (c == '?' || c == '#')
+    {
+        int n = snprintf(number, sizeof(number), "%d", (c == '?') ? last_status : n_args);
+        append(e, number, n);
+    }
+    else if (c == '0')
+        append(e, shell_name, strlen(shell_name));
+    else if (c >= '1' && c <= '9')
+    {
+        if (c - '1' < n_args)
+            append(e, positional[c - '1'], strlen(positional[c - '1']));
+    }
+    else
+    {
+        // $@ / $* inside a word: the arguments joined by spaces
+        for (int i = 0; i < n_args; i++)
+        {
+            if (i)
+                append(e, " ", 1);
+            append(e, positional[i], strlen(positional[i]));
+        }
+    }
+}
+
+void vars_set_substitution(char *(*run)(struct arena *a, const char *text, size_t len, size_t *out_len, int *status))
+{
+    substitute = run;
+}
+
+int vars_substitution_status(void)
+{
+    int status = substitution_status;
+    substitution_status = -1;
+    return status;
+}
+
+int vars_expansion_failed(void)
+{
+    int failed = expansion_failed;
+    expansion_failed = 0;
+    return failed;
+}
+
+/*
+Expand variables in one pass: literal runs are copied with one memcpy, each
+$NAME / ${NAME} is one hash lookup, and the output only grows by doubling,
+so the cost is linear in the size of the result.
+*/
+static char *expand(struct arena *a, const char *word, int keep_globs)
+{
+    struct expansion e = {a, NULL, 0, 64};
+    e.buf = arena_alloc(a, e.cap);
+
+    const char *p = word;
+    while (*p)
+    {
+        // Copy everything up to the next '$' or lexer marker at once
+        size_t run = strcspn(p, "$" "\001\002\003\004");
+        append(&e, p, run);
+        p += run;
+        if (!*p)
+            break;
+
+        if (*p == LITERAL_DOLLAR)
+        {
+            append(&e, "$", 1);
+            p++;
+            continue;
+        }
+        if (*p != '$')
+        {
+            append(&e, keep_globs ? p : &"*?["[*p - GLOB_STAR], 1);
+            p++;
+            continue;
+        }
+
+        // $((expression)): evaluated here, after the variables in it are expanded
+        size_t subst_len = (p[1] == '(') ? command_subst_length(p) : 0;
+        if (subst_len > 0 && p[2] == '(' && p[subst_len - 2] == ')')
+        {
+            char *expr = arena_strndup(e.a, p + 3, subst_len - 5);
+            long long value;
+            if (strchr(expr, '$'))
+                expr = expand_variables(e.a, expr);
+            if (arith_eval(expr, &value) == 0)
+            {
+                char number[24];
+                append(&e, number, snprintf(number, sizeof(number), "%lld", value));
+            }
+            else
+                expansion_failed = 1;
+            p += subst_len;
+            continue;
+        }
+
+        // $(command): its output, run and captured by the hook
+        if (subst_len > 0)
+        {
+            if (substitute)
+            {
+                size_t out_len = 0;
+                char *out = substitute(e.a, p + 2, subst_len - 3, &out_len, &substitution_status);
+                append(&e, out, out_len);
+            }
+            p += subst_len;
+            continue;
+        }
+
+        // ${NAME} or $NAME (a '$' not followed by a name stays as it is)
+        int braced = (p[1] == '{');
+        const char *name = p + 1 + braced;
+        if (*name && strchr("?#@*0123456789", *name) && (!braced || name[1] == '}'))
+        {
+            expand_special(&e, *name);
+            p = name + 1 + braced;
+            continue;
+        }
+        size_t len = var_name_length(name);
+        if (len == 0 || (braced && name[len] != '}'))
+        {
+            append(&e, "$", 1);
+            p++;
+            continue;
+        }
+
+        size_t value_len = 0;
+        const char *value = var_lookup(name, len, &value_len);
+        if (value)
+            append(&e, value, value_len);
+        p = name + len + braced;
+    }
+
+    e.buf[e.len] = '\0';
+    return e.buf;
+}
+
+char *expand_variables(struct arena *a, const char *word)
+{
+    return expand(a, word, 0);
+}
+
+char *expand_pattern(struct arena *a, const char *word)
+{
+    return expand(a, word, 1);
+}
+
+int is_assignment(const char *word)
+{
+    size_t len = var_name_length(word);
+    return len > 0 && word[len] == '=';
+}
+
+int handle_assignment(char *args[])
+{
+    for (int i = 0; args[i]; i++)
+        var_assign(args[i], 0);
+    return 0;
+}
+
+// export command to set environment variables.
+int handle_export(char *args[])
+{
+    if (!args[1])
+    {
+        fprintf(stderr, "\033[1;31mexport: missing argument\033[0m\n");
+        return 1;
+    }
+
+    int status = 0;
+    for (int i = 1; args[i]; i++)
+    {
+        // Locate the '=' sign to separate the variable name (a quoted value is already part of the argument)
+        size_t name_len = var_name_length(args[i]);
+        if (name_len == 0 || (args[i][name_len] != '=' && args[i][name_len] != '\0'))
+        {
+            fprintf(stderr, "\033[1;31mexport: '%s': not a valid identifier\033[0m\n", args[i]);
+            status = 1;
+            continue;
+        }
+
+        // export NAME=value sets and exports, export NAME exports what is already there
+        if (args[i][name_len] == '=')
+            var_assign(args[i], 1);
+        else
+            var_export(args[i]);
+    }
+    return status;
+}
+
+int handle_unset(char *args[])
+{
+    for (int i = 1; args[i]; i++)
+        var_unset(args[i]);
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <stddef.h>
+
+/*
+Shell variables: an open-addressing hash table (linear probing) owned by the shell.
+    - vars_init() imports the environment, those variables start exported
+    - NAME=value sets a shell variable, export makes it part of the environment
+      commands get (only exported variables are copied to it)
+    - that environment is packed into one envp array, rebuilt only after an
+      exported variable changed, so launching commands in a loop copies nothing
+    - a lookup hashes the name straight from the word being expanded,
+      without copying it or scanning environ like getenv() does
+*/
+
+struct arena;
+struct token;
+
+// Import environ (call once at startup)
+void vars_init(void);
+
+// Value of the variable named by the first 'len' bytes of 'name', NULL if unset
+const char *var_lookup(const char *name, size_t len, size_t *value_len);
+
+// Call 'fn' with the name of every variable, in no particular order
+void vars_each(void (*fn)(const char *name, void *data), void *data);
+
+// Set NAME to 'value' ('export' = 1 also exports it, 0 keeps its current export state)
+void var_set(const char *name, const char *value, int export);
+
+// NAME=value word: set NAME (the word itself is left as it is, it may be reused by a loop)
+void var_assign(const char *word, int export);
+
+// Export an existing variable (or an empty one), returns 0
+int var_export(const char *name);
+
+void var_unset(const char *name);
+
+// envp for execve() / posix_spawn(): the exported variables as NAME=value (don't modify or free it)
+char **vars_environ(void);
+
+/*
+Special parameters: $? is the last status, $0 the script's name, $1...$9 / $# / $@ / $*
+the arguments of the script or of the function being run.
+vars_set_args() doesn't copy 'args' (NULL-terminated) and returns the previous ones.
+*/
+void vars_set_status(int status);
+void vars_set_name(const char *name);
+char **vars_set_args(char **args);
+char **vars_args(void);
+
+// Is the word "$@" (quoted or not)? It stands for every argument as a word of its own
+int is_all_args(const struct token *t);
+
+// Length of the valid variable name at the start of 's' (letter or '_', then letters, digits, '_')
+size_t var_name_length(const char *s);
+
+// Is 'word' a NAME=value assignment?
+int is_assignment(const char *word);
+
+// Expand $NAME / ${NAME} / $? ... in 'word' (and the literal '$'s the lexer marked), the result is in the arena
+char *expand_variables(struct arena *a, const char *word);
+
+// The same, but the lexer's GLOB_* wildcards are kept: what the variables hold is matched literally
+char *expand_pattern(struct arena *a, const char *word);
+
+/*
+$(command): expand_variables() hands the text between the parentheses to 'run', which
+returns the command's output (in the arena, trailing newlines removed) and its status.
+Until one is set (the benchmarks), a substitution expands to nothing.
+*/
+void vars_set_substitution(char *(*run)(struct arena *a, const char *text, size_t len, size_t *out_len, int *status));
+
+// Status of the last $(...) expanded since the previous call, -1 if there was none
+int vars_substitution_status(void);
+
+// Did a $((...)) fail (error printed) since the previous call? The command it was in must not run
+int vars_expansion_failed(void);
+
+// NAME=value: set shell variables, export NAME[=value]: export, unset NAME...
+int handle_assignment(char *args[]);
+int handle_export(char *args[]);
+int handle_unset(char *args[]);
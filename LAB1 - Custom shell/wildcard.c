@@ -0,0 +1,701 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/syscall.h> // SYS_getdents64
+#include "wildcard.h"
+#include "lexer.h"
+
+#define DIR_CACHE_MAX 64      // Directories cached (the least recently used one is replaced)
+#define GETDENTS_BUF 262144   // Bytes per getdents64() call (about 8000 names)
+#define RACY_NS 1000000000LL  // A directory changed this close to its read is read again
+#define INSERTION_MAX 16      // Radix sort buckets this small are insertion sorted
+
+// What getdents64() fills the buffer with
+struct linux_dirent64
+{
+    ino_t d_ino;
+    off_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+struct dir_entry
+{
+    unsigned int name; // Offset in the directory's names
+    unsigned int len;
+    unsigned char type; // DT_*
+};
+
+struct cached_dir
+{
+    char *path; // As it was first read (for globcache), NULL = free slot
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;   // When it was read
+    struct timespec read_at; // Clock when it was read
+    char *names;             // Every name NUL-terminated, back to back
+    size_t names_len, names_cap;
+    struct dir_entry *entries; // Sorted by name
+    size_t n, cap;
+    unsigned long used; // Last use, for replacement
+    unsigned long hits;
+    int busy; // Being iterated by a glob (not refreshed or replaced until it is done)
+};
+
+enum op_type
+{
+    OP_LITERAL, // 'len' bytes at 'text'
+    OP_ANY,     // ?
+    OP_STAR,    // *
+    OP_SET,     // [...]
+};
+
+struct op
+{
+    enum op_type type;
+    const char *text;
+    size_t len;
+    unsigned char set[32]; // OP_SET: bit c = byte c matches
+};
+
+// One path component of a pattern, compiled
+struct matcher
+{
+    struct op *ops;
+    int n;
+    int wild;               // Has ? * or a set (otherwise it is a plain name)
+    int dot;                // Starts with a literal '.': hidden names can match
+    size_t min_len;         // Fewest bytes a matching name has
+    int last_star;          // Index of the last * (-1: none, every name has min_len bytes)
+    size_t tail_len;        // Bytes the ops after the last * take (each takes a fixed number)
+};
+
+// One glob_expand() call
+struct glob
+{
+    struct arena *a;
+    char **names; // Matches so far
+    int n, cap;
+    char path[PATH_MAX]; // The path being built
+};
+
+static struct cached_dir cache[DIR_CACHE_MAX];
+static unsigned long clock_ticks = 0; // Incremented at each use, orders the slots
+static unsigned long stat_reads = 0;
+static unsigned long stat_hits = 0;
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  SORTING   **********///////////////////////
+/////////////////////////////////////////////////////////////////////
+
+// Byte 'depth' of the entry's name (0 past its end)
+static unsigned char key(const char *names, const struct dir_entry *e, size_t depth)
+{
+    return (depth < e->len) ? (unsigned char)names[e->name + depth] : 0;
+}
+
+static void insertion_sort(const char *names, struct dir_entry *v, size_t n, size_t depth)
+{
+    for (size_t i = 1; i < n; i++)
+    {
+        struct dir_entry e = v[i];
+        size_t j = i;
+        while (j > 0 && strcmp(names + v[j - 1].name + depth, names + e.name + depth) > 0)
+        {
+            v[j] = v[j - 1];
+            j--;
+        }
+        v[j] = e;
+    }
+}
+
+/*
+MSD radix sort: the entries are distributed by their byte at 'depth' into 256
+buckets (one counting pass, one scatter into 'tmp'), then each bucket is sorted
+on the next byte. Names that share a prefix only cost one pass per shared byte.
+*/
+static void radix_sort(const char *names, struct dir_entry *v, struct dir_entry *tmp, size_t n, size_t depth)
+{
+    if (n <= INSERTION_MAX)
+    {
+        insertion_sort(names, v, n, depth);
+        return;
+    }
+
+    size_t count[256] = {0}, start[256];
+    for (size_t i = 0; i < n; i++)
+        count[key(names, &v[i], depth)]++;
+    start[0] = 0;
+    for (int b = 1; b < 256; b++)
+        start[b] = start[b - 1] + count[b - 1];
+
+    size_t next[256];
+    memcpy(next, start, sizeof(next));
+    for (size_t i = 0; i < n; i++)
+        tmp[next[key(names, &v[i], depth)]++] = v[i];
+    memcpy(v, tmp, n * sizeof(struct dir_entry));
+
+    // Bucket 0 holds the names that ended: they are equal, nothing left to sort
+    for (int b = 1; b < 256; b++)
+    {
+        if (count[b] > 1)
+            radix_sort(names, v + start[b], tmp, count[b], depth + 1);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  DIRECTORY CACHE   **********////////////////
+/////////////////////////////////////////////////////////////////////
+
+static int add_entry(struct cached_dir *d, const char *name, size_t len, unsigned char type)
+{
+    if (d->names_len + len + 1 > d->names_cap)
+    {
+        size_t cap = d->names_cap ? d->names_cap : 4096;
+        while (d->names_len + len + 1 > cap)
+            cap *= 2;
+        char *names = realloc(d->names, cap);
+        if (!names)
+            return -1;
+        d->names = names;
+        d->names_cap = cap;
+    }
+    if (d->n == d->cap)
+    {
+        size_t cap = d->cap ? d->cap * 2 : 128;
+        struct dir_entry *entries = realloc(d->entries, cap * sizeof(struct dir_entry));
+        if (!entries)
+            return -1;
+        d->entries = entries;
+        d->cap = cap;
+    }
+
+    d->entries[d->n].name = d->names_len;
+    d->entries[d->n].len = len;
+    d->entries[d->n].type = type;
+    d->n++;
+    memcpy(d->names + d->names_len, name, len + 1);
+    d->names_len += len + 1;
+    return 0;
+}
+
+// Read every name of the directory 'fd' into 'd' (replacing what it held), sorted
+static int read_dir(struct cached_dir *d, int fd)
+{
+    static char buf[GETDENTS_BUF] __attribute__((aligned(8)));
+
+    d->n = 0;
+    d->names_len = 0;
+    for (;;)
+    {
+        long got = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        if (got < 0)
+            return -1;
+        if (got == 0)
+            break;
+        for (long off = 0; off < got;)
+        {
+            struct linux_dirent64 *de = (struct linux_dirent64 *)(buf + off);
+            off += de->d_reclen;
+            const char *name = de->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+            if (add_entry(d, name, strlen(name), de->d_type) != 0)
+                return -1;
+        }
+    }
+
+    struct dir_entry *tmp = malloc((d->n ? d->n : 1) * sizeof(struct dir_entry));
+    if (!tmp)
+        return -1;
+    radix_sort(d->names, d->entries, tmp, d->n, 0);
+    free(tmp);
+    return 0;
+}
+
+static long long ns_between(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1000000000LL + (to->tv_nsec - from->tv_nsec);
+}
+
+/*
+The cached names of the directory 'path' (read now if it isn't cached or has
+changed), NULL if it can't be read.
+*/
+static struct cached_dir *dir_lookup(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+        return NULL;
+
+    struct cached_dir *d = NULL, *victim = NULL;
+    for (int i = 0; i < DIR_CACHE_MAX; i++)
+    {
+        struct cached_dir *c = &cache[i];
+        if (c->path && c->dev == st.st_dev && c->ino == st.st_ino)
+        {
+            d = c;
+            break;
+        }
+        if (!c->busy && (!victim || !c->path || (victim->path && c->used < victim->used)))
+            victim = c;
+    }
+
+    if (d)
+    {
+        d->used = ++clock_ticks;
+        // A busy directory is one this glob is walking (a symlink back up): keep what it has
+        if (d->busy || (ns_between(&d->mtime, &st.st_mtim) == 0 && ns_between(&d->mtime, &d->read_at) >= RACY_NS))
+        {
+            d->hits++;
+            stat_hits++;
+            return d;
+        }
+    }
+    else
+    {
+        if (!victim)
+            return NULL; // Every slot is being walked (a pattern with DIR_CACHE_MAX wildcard levels)
+        d = victim;
+        free(d->path);
+        d->path = strdup(path);
+        if (!d->path)
+            return NULL;
+        d->dev = st.st_dev;
+        d->ino = st.st_ino;
+        d->hits = 0;
+        d->used = ++clock_ticks;
+    }
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    clock_gettime(CLOCK_REALTIME, &d->read_at);
+    if (fd < 0 || fstat(fd, &st) != 0 || read_dir(d, fd) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        free(d->path);
+        d->path = NULL;
+        return NULL;
+    }
+    close(fd);
+    d->mtime = st.st_mtim;
+    stat_reads++;
+    return d;
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  MATCHING   **********//////////////////////
+/////////////////////////////////////////////////////////////////////
+
+// The byte a pattern character stands for inside [...] (markers are their characters there)
+static unsigned char set_char(char c)
+{
+    if (c == GLOB_STAR || c == GLOB_ANY || c == GLOB_BRACKET)
+        return "*?["[c - GLOB_STAR];
+    return (unsigned char)c;
+}
+
+static void set_add(unsigned char set[32], unsigned char c)
+{
+    set[c >> 3] |= 1 << (c & 7);
+}
+
+static int set_has(const unsigned char set[32], unsigned char c)
+{
+    return set[c >> 3] & (1 << (c & 7));
+}
+
+// [:name:] at 'p' added to 'set', returns its length (0 if it isn't one)
+static size_t add_class(const char *p, const char *end, unsigned char set[32])
+{
+    static const struct
+    {
+        const char *name;
+        int (*is)(int);
+    } classes[] = {{"alpha", isalpha}, {"digit", isdigit}, {"alnum", isalnum}, {"upper", isupper},
+                   {"lower", islower}, {"space", isspace}, {"punct", ispunct}, {"xdigit", isxdigit}};
+
+    for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); i++)
+    {
+        size_t len = strlen(classes[i].name);
+        if ((size_t)(end - p) >= len + 4 && p[1] == ':' && strncmp(p + 2, classes[i].name, len) == 0
+            && p[len + 2] == ':' && p[len + 3] == ']')
+        {
+            for (int c = 0; c < 256; c++)
+            {
+                if (classes[i].is(c))
+                    set_add(set, c);
+            }
+            return len + 4;
+        }
+    }
+    return 0;
+}
+
+/*
+[...] starting after the '[' at 'p': fills o->set, returns where it ends (after the ']'),
+NULL if no ']' closes it (then the '[' is literal).
+*/
+static const char *compile_set(const char *p, const char *end, struct op *o)
+{
+    int negate = 0;
+    memset(o->set, 0, sizeof(o->set));
+    if (p < end && (*p == '!' || *p == '^'))
+    {
+        negate = 1;
+        p++;
+    }
+
+    for (int first = 1; p < end; first = 0)
+    {
+        if (*p == ']' && !first)
+        {
+            if (negate)
+            {
+                for (int i = 0; i < 32; i++)
+                    o->set[i] = ~o->set[i];
+            }
+            return p + 1;
+        }
+        if (*p == GLOB_BRACKET)
+        {
+            size_t len = add_class(p, end, o->set);
+            if (len)
+            {
+                p += len;
+                continue;
+            }
+        }
+        unsigned char lo = set_char(*p);
+        if (p + 2 < end && p[1] == '-' && p[2] != ']')
+        {
+            for (unsigned int c = lo; c <= set_char(p[2]); c++)
+                set_add(o->set, c);
+            p += 3;
+        }
+        else
+        {
+            set_add(o->set, lo);
+            p++;
+        }
+    }
+    return NULL;
+}
+
+// Compile the component 'p' (its 'len' bytes) of a pattern
+static void compile(struct arena *a, const char *p, size_t len, struct matcher *m)
+{
+    const char *end = p + len;
+    memset(m, 0, sizeof(struct matcher));
+    m->ops = arena_alloc(a, (len + 1) * sizeof(struct op));
+    m->dot = (len > 0 && *p == '.');
+
+    while (p < end)
+    {
+        struct op *o = &m->ops[m->n];
+        o->type = OP_LITERAL;
+        o->text = p;
+        o->len = 0;
+
+        if (*p == GLOB_STAR)
+        {
+            while (p < end && *p == GLOB_STAR) // ** is *
+                p++;
+            o->type = OP_STAR;
+        }
+        else if (*p == GLOB_ANY)
+        {
+            o->type = OP_ANY;
+            p++;
+        }
+        else if (*p == GLOB_BRACKET)
+        {
+            const char *after = compile_set(p + 1, end, o);
+            if (after)
+            {
+                o->type = OP_SET;
+                p = after;
+            }
+            else
+            {
+                o->text = "[";
+                o->len = 1;
+                p++;
+            }
+        }
+        else
+        {
+            while (p < end && *p != GLOB_STAR && *p != GLOB_ANY && *p != GLOB_BRACKET)
+                p++;
+            o->len = p - o->text;
+        }
+
+        m->wild |= (o->type != OP_LITERAL);
+        m->min_len += (o->type == OP_LITERAL) ? o->len : (o->type != OP_STAR);
+        m->n++;
+    }
+
+    m->last_star = -1;
+    for (int i = 0; i < m->n; i++)
+    {
+        if (m->ops[i].type == OP_STAR)
+        {
+            m->last_star = i;
+            m->tail_len = 0;
+        }
+        else
+            m->tail_len += (m->ops[i].type == OP_LITERAL) ? m->ops[i].len : 1;
+    }
+}
+
+// Ops that each take a fixed number of bytes, at 's' (which has enough of them)
+static int match_fixed(const struct op *ops, int n, const char *s)
+{
+    for (int i = 0; i < n; i++)
+    {
+        const struct op *o = &ops[i];
+        if (o->type == OP_LITERAL)
+        {
+            if (memcmp(s, o->text, o->len) != 0)
+                return 0;
+            s += o->len;
+            continue;
+        }
+        if (o->type == OP_SET && !set_has(o->set, (unsigned char)*s))
+            return 0;
+        s++;
+    }
+    return 1;
+}
+
+/*
+Match 'name' against the ops, left to right. On a mismatch after a '*', that '*'
+takes one more byte and the rest is tried again (only the last '*' is ever
+retried: an earlier one can't do better), so the cost is at most names x ops.
+*/
+static int match_ops(const struct op *ops, int n, const char *s, size_t len)
+{
+    int i = 0, star = -1;
+    size_t k = 0, star_k = 0;
+
+    for (;;)
+    {
+        if (i == n)
+        {
+            if (k == len)
+                return 1;
+        }
+        else
+        {
+            const struct op *o = &ops[i];
+            if (o->type == OP_STAR)
+            {
+                star = i++;
+                star_k = k;
+                continue;
+            }
+            if ((o->type == OP_LITERAL && len - k >= o->len && memcmp(s + k, o->text, o->len) == 0)
+                || (o->type == OP_ANY && k < len)
+                || (o->type == OP_SET && k < len && set_has(o->set, (unsigned char)s[k])))
+            {
+                k += (o->type == OP_LITERAL) ? o->len : 1;
+                i++;
+                continue;
+            }
+        }
+
+        if (star < 0 || star_k == len)
+            return 0;
+        i = star + 1;
+        k = ++star_k;
+    }
+}
+
+/*
+What follows the last '*' has a fixed width, so it is checked first, at the end
+of the name ("*.txt" is one memcmp()); only the rest needs match_ops().
+*/
+static int matches(const struct matcher *m, const char *name, size_t len)
+{
+    if (len < m->min_len || (name[0] == '.' && !m->dot))
+        return 0;
+    if (m->last_star < 0)
+        return len == m->min_len && match_fixed(m->ops, m->n, name);
+
+    size_t head = len - m->tail_len;
+    return match_fixed(m->ops + m->last_star + 1, m->n - m->last_star - 1, name + head)
+        && match_ops(m->ops, m->last_star + 1, name, head);
+}
+
+/////////////////////////////////////////////////////////////////////
+//////////////*********  EXPANSION   **********/////////////////////
+/////////////////////////////////////////////////////////////////////
+
+// Turn GLOB_* markers back into the characters they were ('[' without a ']' is a plain name)
+static void restore(char *p, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (p[i] == GLOB_STAR || p[i] == GLOB_ANY || p[i] == GLOB_BRACKET)
+            p[i] = "*?["[p[i] - GLOB_STAR];
+    }
+}
+
+static void add_match(struct glob *g, size_t len)
+{
+    if (g->n + 2 > g->cap)
+    {
+        int cap = g->cap ? g->cap * 2 : 16;
+        g->names = arena_grow(g->a, g->names, g->cap * sizeof(char *), cap * sizeof(char *));
+        g->cap = cap;
+    }
+    g->names[g->n++] = arena_strndup(g->a, g->path, len);
+}
+
+// Can the entry (whose path is in g->path) be walked into?
+static int is_dir(struct glob *g, const struct dir_entry *e)
+{
+    struct stat st;
+    if (e->type == DT_DIR)
+        return 1;
+    if (e->type != DT_LNK && e->type != DT_UNKNOWN)
+        return 0;
+    return stat(g->path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// Match 'rest' (the components left) under g->path, whose first 'len' bytes are the directory so far
+static void expand_from(struct glob *g, size_t len, const char *rest)
+{
+    const char *slash = strchr(rest, '/');
+    size_t rest_len = slash ? (size_t)(slash - rest) : strlen(rest);
+    struct matcher m;
+    compile(g->a, rest, rest_len, &m);
+
+    // A plain name: no directory to read, it only has to exist
+    if (!m.wild)
+    {
+        if (len + rest_len + 2 > sizeof(g->path))
+            return;
+        memcpy(g->path + len, rest, rest_len);
+        restore(g->path + len, rest_len);
+        len += rest_len;
+        g->path[len] = '\0';
+        if (slash)
+        {
+            g->path[len++] = '/';
+            g->path[len] = '\0';
+            expand_from(g, len, slash + 1);
+        }
+        else
+        {
+            struct stat st;
+            if (lstat(g->path, &st) == 0)
+                add_match(g, len);
+        }
+        return;
+    }
+
+    g->path[len] = '\0';
+    struct cached_dir *d = dir_lookup(len ? g->path : ".");
+    if (!d)
+        return;
+
+    d->busy++;
+    for (size_t i = 0; i < d->n; i++)
+    {
+        const struct dir_entry *e = &d->entries[i];
+        const char *name = d->names + e->name;
+        if (!matches(&m, name, e->len) || len + e->len + 2 > sizeof(g->path))
+            continue;
+
+        memcpy(g->path + len, name, e->len + 1);
+        if (!slash)
+            add_match(g, len + e->len);
+        else if (is_dir(g, e))
+        {
+            g->path[len + e->len] = '/';
+            g->path[len + e->len + 1] = '\0';
+            expand_from(g, len + e->len + 1, slash + 1);
+        }
+    }
+    d->busy--;
+}
+
+char **glob_expand(struct arena *a, const char *pattern, int *n)
+{
+    // Without a wildcard the result is the word itself, matched or not: don't touch the disk
+    const char *p = pattern;
+    for (; *p; p++)
+    {
+        if (*p == GLOB_STAR || *p == GLOB_ANY || (*p == GLOB_BRACKET && strchr(p, ']')))
+            break;
+    }
+    *n = 0;
+    if (!*p)
+        return NULL;
+
+    struct glob *g = arena_alloc(a, sizeof(struct glob));
+    g->a = a;
+    g->names = NULL;
+    g->n = g->cap = 0;
+
+    // The components before the first wildcard are the directory to start from
+    size_t len = 0;
+    for (const char *q = pattern; q < p; q++)
+    {
+        if (*q == '/')
+            len = q + 1 - pattern;
+    }
+    if (len >= sizeof(g->path))
+        return NULL;
+    memcpy(g->path, pattern, len);
+    restore(g->path, len);
+    expand_from(g, len, pattern + len);
+
+    if (g->n == 0)
+        return NULL;
+    g->names[g->n] = NULL;
+    *n = g->n;
+    return g->names;
+}
+
+void glob_restore(char *pattern)
+{
+    restore(pattern, strlen(pattern));
+}
+
+int handle_globcache(char *args[])
+{
+    if (args[1] && strcmp(args[1], "-r") == 0)
+    {
+        for (int i = 0; i < DIR_CACHE_MAX; i++)
+        {
+            if (cache[i].busy)
+                continue;
+            free(cache[i].path);
+            free(cache[i].names);
+            free(cache[i].entries);
+            memset(&cache[i], 0, sizeof(struct cached_dir));
+        }
+        return 0;
+    }
+
+    printf("hits\tnames\tdirectory\n");
+    for (int i = 0; i < DIR_CACHE_MAX; i++)
+    {
+        if (cache[i].path)
+            printf("%4lu\t%zu\t%s\n", cache[i].hits, cache[i].n, cache[i].path);
+    }
+    unsigned long lookups = stat_hits + stat_reads;
+    printf("lookups: %lu, hits: %lu, reads: %lu, hit rate: %.1f%%\n", lookups, stat_hits, stat_reads,
+           lookups ? 100.0 * stat_hits / lookups : 0.0);
+    return 0;
+}
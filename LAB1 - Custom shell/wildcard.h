@@ -0,0 +1,29 @@
+/*
+Filename globbing: a word with an unquoted * ? or [...] becomes the sorted list of
+file names it matches (or stays as written when nothing matches).
+    - each directory is read once with getdents64() into a cache of its names,
+      sorted when it is read (MSD radix sort on the bytes): matching keeps that
+      order, so the result is never sorted again
+    - a cached directory is found by device and inode (so cd doesn't confuse it)
+      and is trusted while its mtime is unchanged: one stat() per glob. A directory
+      changed in the last second before it was read is read again next time
+      (a second change within the same timestamp tick would not show)
+    - each path component of the pattern is compiled once into a small matcher
+      (literal runs, ?, *, character sets). What follows the last * has a fixed
+      width and is checked first at the end of the name: "*.txt" rejects most
+      names with one memcmp()
+    - names starting with '.' only match a pattern component starting with '.',
+      and "." / ".." are never listed
+Order is byte order (LC_ALL=C), directory by directory.
+*/
+
+struct arena;
+
+// Names 'pattern' (wildcards as the lexer's GLOB_* markers) matches, NULL-terminated in 'a'; NULL if none
+char **glob_expand(struct arena *a, const char *pattern, int *n);
+
+// Turn the GLOB_* markers of 'pattern' back into * ? [ (in place): the word as it was written
+void glob_restore(char *pattern);
+
+// globcache builtin: "globcache" lists the cached directories, "globcache -r" empties the cache
+int handle_globcache(char *args[]);
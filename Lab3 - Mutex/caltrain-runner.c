@@ -8,12 +8,18 @@
  * close.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 #include <time.h>
 #include <unistd.h>
+#include <sched.h>
 #include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 
 #include "caltrain.h"
 
@@ -30,6 +36,17 @@ passenger_thread(void *arg)
 	return NULL;
 }
 
+// Waits with a deadline far away so only a cancellation can end the wait early.
+void*
+cancellable_passenger_thread(void *arg)
+{
+	struct station *station = (struct station*)arg;
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += 5;
+	return (void*)(long)station_wait_for_train_timed(station, &deadline);
+}
+
 struct load_train_args {
 	struct station *station;
 	int free_seats;
@@ -70,12 +87,194 @@ alarm_handler(int foo)
 #define MIN(_x,_y) ((_x) < (_y)) ? (_x) : (_y)
 #endif
 
+/*
+ * Benchmark mode: ./caltrain bench [max_passengers] [stack_kb]
+ *
+ * Sweeps passenger counts (100 .. max_passengers, x10 each step), seat
+ * distributions and the number of cores the process is pinned to, and prints
+ * one CSV row per run: boardings/s, context switches and CPU time per boarding.
+ * Counts that don't fit (kernel.pid_max, kernel.threads-max) are skipped.
+ */
+
+// Passengers in bench mode board themselves
+volatile int bench_boarded = 0;
+
+void*
+bench_passenger_thread(void *arg)
+{
+	struct station *station = (struct station*)arg;
+	station_wait_for_train(station);
+	__sync_add_and_fetch(&bench_boarded, 1);
+	station_on_board(station);
+	return NULL;
+}
+
+struct seat_dist {
+	const char *name;
+	int min_seats;
+	int max_seats;
+};
+
+const struct seat_dist seat_dists[] = {
+	{ "one",        1,   1   },
+	{ "uniform50",  0,   49  }, // what the regular test does
+	{ "fixed50",    50,  50  },
+	{ "uniform500", 0,   499 },
+};
+
+static double
+timeval_sec(struct timeval tv)
+{
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static double
+now_sec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// One benchmark run, returns 0 and prints a CSV row, or -1 if the threads didn't fit
+static int
+bench_run(int passengers, const struct seat_dist *dist, int cores, const cpu_set_t *allowed,
+	size_t stack_size)
+{
+	struct station station;
+	cpu_set_t set;
+	int i, c, created = 0;
+
+	// Pin the whole process (passenger threads inherit the mask) to the first 'cores'
+	// CPUs it may run on (they aren't always 0..n-1, e.g. under taskset or in a container)
+	CPU_ZERO(&set);
+	for (i = 0, c = 0; i < cores && c < CPU_SETSIZE; c++) {
+		if (CPU_ISSET(c, allowed)) {
+			CPU_SET(c, &set);
+			i++;
+		}
+	}
+	if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+		perror("sched_setaffinity");
+		return -1;
+	}
+
+	// All the stacks come from one mapping, so there is no guard page or extra
+	// mapping per thread and only the pages a passenger touches get allocated
+	size_t slab_size = (size_t)passengers * stack_size;
+	char *slab = mmap(NULL, slab_size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (slab == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+
+	pthread_t *tids = malloc(passengers * sizeof(pthread_t));
+	station_init(&station);
+	bench_boarded = 0;
+
+	for (i = 0; i < passengers; i++) {
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setstack(&attr, slab + (size_t)i * stack_size, stack_size);
+		int ret = pthread_create(&tids[i], &attr, bench_passenger_thread, &station);
+		pthread_attr_destroy(&attr);
+		if (ret != 0)
+			break;
+		created++;
+	}
+
+	// Let every passenger reach the platform so only boarding gets timed
+	while (created == passengers && station.rdv.waiting < passengers)
+		sched_yield();
+
+	struct rusage before, after;
+	getrusage(RUSAGE_SELF, &before);
+	double start = now_sec();
+
+	long trains = 0;
+	while (bench_boarded < created) {
+		int range = dist->max_seats - dist->min_seats + 1;
+		int free_seats = dist->min_seats + random() % range;
+		if (created < passengers)
+			free_seats = created; // Just send the ones we got home
+		station_load_train(&station, free_seats);
+		trains++;
+	}
+
+	double elapsed = now_sec() - start;
+	getrusage(RUSAGE_SELF, &after);
+
+	for (i = 0; i < created; i++)
+		pthread_join(tids[i], NULL);
+	free(tids);
+	munmap(slab, slab_size);
+	rdv_destroy(&station.rdv);
+
+	if (created < passengers) {
+		fprintf(stderr, "Skipping %d passengers: only %d threads could be created\n",
+			passengers, created);
+		return -1;
+	}
+
+	long ctx = (after.ru_nvcsw - before.ru_nvcsw) + (after.ru_nivcsw - before.ru_nivcsw);
+	double cpu = (timeval_sec(after.ru_utime) - timeval_sec(before.ru_utime))
+		+ (timeval_sec(after.ru_stime) - timeval_sec(before.ru_stime));
+
+	printf("%d,%s,%d,%zu,%ld,%.6f,%.0f,%ld,%.3f\n",
+		passengers, dist->name, cores, stack_size / 1024, trains, elapsed,
+		passengers / elapsed, ctx, cpu * 1e6 / passengers);
+	fflush(stdout);
+	return 0;
+}
+
+int
+bench_main(int argc, char *argv[])
+{
+	int max_passengers = (argc > 1) ? atoi(argv[1]) : 100000;
+	size_t stack_size = ((argc > 2) ? atoi(argv[2]) : 16) * 1024;
+	cpu_set_t all;
+	int ncpu;
+	int passengers, cores;
+	size_t d;
+
+	if (stack_size < (size_t)sysconf(_SC_THREAD_STACK_MIN))
+		stack_size = sysconf(_SC_THREAD_STACK_MIN);
+
+	if (sched_getaffinity(0, sizeof(all), &all) != 0) {
+		perror("sched_getaffinity");
+		return 1;
+	}
+	ncpu = CPU_COUNT(&all);
+	srandom(getpid() ^ time(NULL));
+
+	printf("passengers,seats,cores,stack_kb,trains,elapsed_s,boardings_per_s,"
+		"ctx_switches,cpu_us_per_boarding\n");
+
+	for (passengers = 100; passengers <= max_passengers; passengers *= 10) {
+		for (d = 0; d < sizeof(seat_dists) / sizeof(seat_dists[0]); d++) {
+			// 1, 2, 4, ... and every CPU we may use last, even if that isn't a power of 2
+			for (cores = 1; ; cores = (cores * 2 < ncpu) ? cores * 2 : ncpu) {
+				bench_run(passengers, &seat_dists[d], cores, &all, stack_size);
+				if (cores >= ncpu)
+					break;
+			}
+		}
+	}
+
+	sched_setaffinity(0, sizeof(all), &all);
+	return 0;
+}
+
 /*
  * This creates a bunch of threads to simulate arriving trains and passengers.
  */
 int
-main()
+main(int argc, char *argv[])
 {
+	if (argc > 1 && strcmp(argv[1], "bench") == 0)
+		return bench_main(argc - 1, argv + 1);
+
 	struct station station;
 	station_init(&station);
 
@@ -89,6 +288,40 @@ main()
 	station_load_train(&station, 10);
 	_alarm(0, NULL);
 
+	// Make sure a timed wait gives up when no train comes and leaves the waiting count alone.
+	_alarm(1, "station_wait_for_train_timed() did not return at its deadline");
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_nsec += 10 * 1000 * 1000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+	if (station_wait_for_train_timed(&station, &deadline) != ETIMEDOUT
+	    || station.rdv.waiting != 0) {
+		fprintf(stderr, "Error: timed out passenger was not removed from the station!\n");
+		exit(1);
+	}
+	_alarm(0, NULL);
+
+	// Make sure a cancelled passenger leaves the platform without boarding.
+	_alarm(2, "station_cancel_waiting() did not wake up the waiting passenger");
+	pthread_t cancel_tid;
+	void *cancel_ret;
+	if (pthread_create(&cancel_tid, NULL, cancellable_passenger_thread, &station) != 0) {
+		perror("pthread_create");
+		exit(1);
+	}
+	while (station_cancel_waiting(&station, 1) == 0)
+		usleep(100);
+	pthread_join(cancel_tid, &cancel_ret);
+	if ((long)cancel_ret != ECANCELED || station.rdv.waiting != 0) {
+		fprintf(stderr, "Error: cancelled passenger was not removed from the station!\n");
+		exit(1);
+	}
+	station_load_train(&station, 10);
+	_alarm(0, NULL);
+
 	// Create a bunch of 'passengers', each in their own thread.
 	int i;
 	const int total_passengers = 100;
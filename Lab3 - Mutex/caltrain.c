@@ -5,89 +5,37 @@
 to complie the code: make caltrain
 to run the code: ./repeat.sh
 
+The synchronization itself lives in rendezvous.c, a station is a thin wrapper over it.
 */
 
 void station_init(struct station *station)
 {
-	// Init counters
-	station->waiting = 0;
-	station->seats_available = 0;
-	station->people_to_sit = 0;
-	station->boarding = 0;
-
-	// Init mutex and conds
-	pthread_mutex_init(&station->lock, NULL);
-	pthread_cond_init(&station->train_arrived, NULL);
-	pthread_cond_init(&station->all_boarded, NULL);
+	// Passengers sleep right away, a train can wait a while for boarding
+	rdv_init(&station->rdv, 0);
 }
 
 void station_load_train(struct station *station, int count)
 {
-	pthread_mutex_lock(&station->lock);
-
-	// Save the number of available seat
-	station->seats_available = count;
-
-	/*
-	If the number of people waiting less than the number of available seats then everybody waiting can sit
-	else then it's the number of all available seats
-	 */
-	station->people_to_sit = (station->waiting < count) ? station->waiting : count;
-
-	// Let the people waiting know that a train arrived
-	pthread_cond_broadcast(&station->train_arrived);
-
-	// Wait untill everybody who can sit boards
-	while (station->boarding < station->people_to_sit)
-	{
-		pthread_cond_wait(&station->all_boarded, &station->lock);
-	}
-
-	// Reset for the next train
-	station->boarding = 0;
-	station->seats_available = 0;
-	station->people_to_sit = 0;
-
-	pthread_mutex_unlock(&station->lock);
+	// Offer the free seats and wait untill everybody who can sit boards
+	rdv_offer(&station->rdv, count);
 }
 
 void station_wait_for_train(struct station *station)
 {
-	pthread_mutex_lock(&station->lock);
-
-	// Inc the number of waiting passengers
-	station->waiting++;
-
-	// Loop until there is an available seat
-	while (station->seats_available == 0)
-	{
-		// Waits on the condition variable until it ges a signal that there is an available seat
-		pthread_cond_wait(&station->train_arrived, &station->lock);
-
-		// When a seat is available it exists the loop
-	}
+	rdv_claim(&station->rdv);
+}
 
-	// When the seat is available dec this seat and the number of waiting passengers
-	// as one of them has taken the seat
-	station->seats_available--;
-	station->waiting--;
+int station_wait_for_train_timed(struct station *station, const struct timespec *deadline)
+{
+	return rdv_claim_timed(&station->rdv, deadline);
+}
 
-	pthread_mutex_unlock(&station->lock);
+int station_cancel_waiting(struct station *station, int count)
+{
+	return rdv_cancel(&station->rdv, count);
 }
 
 void station_on_board(struct station *station)
 {
-	pthread_mutex_lock(&station->lock);
-
-	// Inc boarding
-	station->boarding++;
-
-	// If the number of people boarding equal to the number of people who will sit 
-	if (station->boarding == station->people_to_sit)
-	{
-		// Signal that the train is fully boarded
-		pthread_cond_broadcast(&station->all_boarded);
-	}
-
-	pthread_mutex_unlock(&station->lock);
+	rdv_confirm(&station->rdv);
 }
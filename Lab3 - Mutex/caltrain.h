@@ -1,15 +1,15 @@
 #include <pthread.h>
+#include <time.h>
+#include "rendezvous.h"
 
+/*
+The station is a batch rendezvous (see rendezvous.h):
+	- a train offers its free seats (the slots)
+	- waiting passengers claim one seat each
+	- the train leaves once every passenger who claimed a seat is on board
+*/
 struct station {
-	int waiting;          // Number of waiting passengers
-    int seats_available;  // Number of free seats on the arriving train
-	int people_to_sit;    // Number of people that can actually sit
-    int boarding;         // Number of passengers currently boarding
-
-	pthread_mutex_t lock; // Mutex to lock shared resources
-    pthread_cond_t train_arrived; // Cond variable to signal a train has arrived
-    pthread_cond_t all_boarded;   // Cond variable to signal that boarding is complete  
-
+	struct rendezvous rdv; // waiting = passengers waiting, offered = seats still free
 };
 
 void station_init(struct station *station);
@@ -18,4 +18,11 @@ void station_load_train(struct station *station, int count);
 
 void station_wait_for_train(struct station *station);
 
-void station_on_board(struct station *station);
\ No newline at end of file
+// Like station_wait_for_train() but gives up at 'deadline' (absolute, CLOCK_MONOTONIC).
+// Returns 0 once a seat is taken, ETIMEDOUT or ECANCELED if the passenger left instead.
+int station_wait_for_train_timed(struct station *station, const struct timespec *deadline);
+
+// Ask up to 'count' waiting passengers to leave the platform, returns how many will
+int station_cancel_waiting(struct station *station, int count);
+
+void station_on_board(struct station *station);
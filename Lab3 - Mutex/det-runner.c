@@ -0,0 +1,135 @@
+/*
+ * Runs the station under the deterministic scheduler (detsched.c), so any
+ * interleaving can be replayed from its seed.
+ *
+ * Usage:
+ *	./det-runner [seed] [passengers] [-v]    run one schedule (-v prints every step)
+ *	./det-runner search <from> <to> [passengers]
+ *	                                          run a range of seeds and report the
+ *	                                          ones that hit the slow paths the most
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "caltrain.h"
+#include "detsched.h"
+
+// Only one managed thread runs at a time, so plain ints are fine here
+struct station station;
+int boarded = 0;
+int gave_up = 0;
+
+// Every fourth passenger waits with a deadline (which the scheduler may let expire)
+void*
+passenger_thread(void *arg)
+{
+	long idx = (long)arg;
+	int ret;
+
+	if (idx % 4 == 3) {
+		struct timespec deadline = { 0, 0 };
+		ret = station_wait_for_train_timed(&station, &deadline);
+	} else {
+		station_wait_for_train(&station);
+		ret = 0;
+	}
+
+	if (ret == 0) {
+		boarded++;
+		station_on_board(&station);
+	} else {
+		gave_up++;
+	}
+	return NULL;
+}
+
+struct run_result {
+	struct ds_stats stats;
+	long trains;
+	int boarded;
+	int gave_up;
+};
+
+static struct run_result
+run(unsigned int seed, int passengers, int verbose)
+{
+	struct run_result res;
+	int *ids = malloc(passengers * sizeof(int));
+	unsigned int seats_seed = seed;
+	long i;
+
+	ds_init(seed, verbose);
+	station_init(&station);
+	boarded = gave_up = 0;
+
+	for (i = 0; i < passengers; i++)
+		ids[i] = ds_spawn(passenger_thread, (void*)i);
+
+	// The main thread is the train
+	res.trains = 0;
+	while (boarded + gave_up < passengers) {
+		station_load_train(&station, rand_r(&seats_seed) % 8);
+		res.trains++;
+	}
+
+	for (i = 0; i < passengers; i++)
+		ds_join(ids[i]);
+
+	res.stats = ds_finish();
+	res.boarded = boarded;
+	res.gave_up = gave_up;
+	rdv_destroy(&station.rdv);
+	free(ids);
+	return res;
+}
+
+static void
+print_result(unsigned int seed, struct run_result *r)
+{
+	printf("seed=%u steps=%ld switches=%ld futile_wakeups=%ld timeouts=%ld trains=%ld "
+		"boarded=%d gave_up=%d hash=%016llx\n",
+		seed, r->stats.steps, r->stats.switches, r->stats.futile, r->stats.timeouts,
+		r->trains, r->boarded, r->gave_up, (unsigned long long)r->stats.hash);
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "search") == 0) {
+		unsigned int from = (argc > 2) ? atoi(argv[2]) : 1;
+		unsigned int to = (argc > 3) ? atoi(argv[3]) : 1000;
+		int passengers = (argc > 4) ? atoi(argv[4]) : 10;
+		unsigned int seed, worst_futile = from, worst_steps = from;
+		struct run_result r, futile = { { 0 } }, steps = { { 0 } };
+
+		for (seed = from; seed <= to; seed++) {
+			r = run(seed, passengers, 0);
+			if (r.stats.futile > futile.stats.futile) {
+				futile = r;
+				worst_futile = seed;
+			}
+			if (r.stats.steps > steps.stats.steps) {
+				steps = r;
+				worst_steps = seed;
+			}
+		}
+
+		printf("Most futile wakeups: ");
+		print_result(worst_futile, &futile);
+		printf("Longest schedule:    ");
+		print_result(worst_steps, &steps);
+		printf("Replay with: ./det-runner <seed> %d -v\n", passengers);
+		return 0;
+	}
+
+	unsigned int seed = (argc > 1) ? atoi(argv[1]) : 1;
+	int passengers = (argc > 2) ? atoi(argv[2]) : 10;
+	int verbose = (argc > 3 && strcmp(argv[3], "-v") == 0);
+
+	struct run_result r = run(seed, passengers, verbose);
+	print_result(seed, &r);
+	return 0;
+}
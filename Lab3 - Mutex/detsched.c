@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+// The scheduler itself uses the real pthread functions
+#undef DETSCHED
+#include "detsched.h"
+
+enum ds_state { DS_RUNNABLE, DS_BLOCKED, DS_DONE };
+
+struct ds_thread {
+	enum ds_state state;
+	void *blocked_on;   // Mutex, cond or thread this one waits for
+	int timed;          // Blocked in a timed wait (can be timed out)
+	int timed_out;
+	long wait_seq;      // FIFO order of the waiters of a cond
+	void *woken_from;   // Cond that woke us up, to spot futile wakeups
+	pthread_cond_t turn; // Signalled when the scheduler picks this thread
+	pthread_t tid;
+	void *(*fn)(void *);
+	void *arg;
+};
+
+// Mutexes and conds get small ids in order of first use so traces don't depend on addresses
+struct ds_object {
+	void *addr;
+	int owner; // Thread holding the mutex (-1 = free)
+};
+
+static struct {
+	pthread_mutex_t big; // Protects everything here, held by the running thread
+	struct ds_thread threads[DS_MAX_THREADS];
+	int n_threads;
+	int current;
+	struct ds_object objects[DS_MAX_OBJECTS];
+	int n_objects;
+	uint64_t rng;
+	long seq;
+	int verbose;
+	struct ds_stats stats;
+} ds = { .big = PTHREAD_MUTEX_INITIALIZER };
+
+static __thread int ds_self = -1;
+
+static uint64_t ds_random(void)
+{
+	// xorshift64*
+	ds.rng ^= ds.rng >> 12;
+	ds.rng ^= ds.rng << 25;
+	ds.rng ^= ds.rng >> 27;
+	return ds.rng * 2685821657736338717ULL;
+}
+
+// FNV-1a step: fold 'len' bytes into the schedule hash
+static void ds_hash(const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	size_t i;
+	for (i = 0; i < len; i++)
+		ds.stats.hash = (ds.stats.hash ^ p[i]) * 1099511628211ULL;
+}
+
+static struct ds_object *ds_object(void *addr)
+{
+	int i;
+	for (i = 0; i < ds.n_objects; i++)
+	{
+		if (ds.objects[i].addr == addr)
+			return &ds.objects[i];
+	}
+	if (ds.n_objects == DS_MAX_OBJECTS)
+	{
+		fprintf(stderr, "detsched: more than %d sync objects\n", DS_MAX_OBJECTS);
+		exit(1);
+	}
+	ds.objects[ds.n_objects].addr = addr;
+	ds.objects[ds.n_objects].owner = -1;
+	return &ds.objects[ds.n_objects++];
+}
+
+static void ds_wake(struct ds_thread *t)
+{
+	t->state = DS_RUNNABLE;
+	t->blocked_on = NULL;
+}
+
+/*
+Yield point: pick the next thread to run and wait for our turn.
+Called with 'big' held by the running thread (which may have just blocked or finished).
+*/
+static void ds_schedule(const char *op, void *obj)
+{
+	int candidates[DS_MAX_THREADS];
+	int n = 0, timed = 0, i;
+
+	for (i = 0; i < ds.n_threads; i++)
+	{
+		if (ds.threads[i].state == DS_RUNNABLE)
+			candidates[n++] = i;
+	}
+
+	// Now and then (or when nothing else can run) let virtual time pass for a timed waiter
+	if (n == 0 || ds_random() % 16 == 0)
+	{
+		for (i = 0; i < ds.n_threads; i++)
+		{
+			if (ds.threads[i].state == DS_BLOCKED && ds.threads[i].timed)
+				timed++;
+		}
+		if (timed > 0 && (n == 0 || ds_random() % 2 == 0))
+		{
+			int pick = ds_random() % timed;
+			for (i = 0; i < ds.n_threads; i++)
+			{
+				struct ds_thread *t = &ds.threads[i];
+				if (t->state == DS_BLOCKED && t->timed && pick-- == 0)
+				{
+					ds_wake(t);
+					t->timed_out = 1;
+					ds.stats.timeouts++;
+					n = 0;
+					candidates[n++] = i;
+					break;
+				}
+			}
+		}
+	}
+
+	if (n == 0)
+	{
+		fprintf(stderr, "detsched: deadlock at step %ld (after T%d %s)\n",
+			ds.stats.steps, ds_self, op);
+		for (i = 0; i < ds.n_threads; i++)
+		{
+			if (ds.threads[i].state == DS_BLOCKED)
+				fprintf(stderr, "  T%d blocked on #%ld\n", i,
+					(long)(ds_object(ds.threads[i].blocked_on) - ds.objects));
+		}
+		exit(2);
+	}
+
+	int next = candidates[ds_random() % n];
+
+	ds.stats.steps++;
+	if (next != ds_self)
+		ds.stats.switches++;
+	// FNV-1a over (thread, op with its NUL, next) so two schedules only hash the same if they are the same
+	ds_hash(&ds_self, sizeof(ds_self));
+	ds_hash(op, strlen(op) + 1);
+	ds_hash(&next, sizeof(next));
+
+	if (ds.verbose)
+		printf("step %ld: T%d %s #%ld -> T%d\n", ds.stats.steps, ds_self, op,
+			obj ? (long)(ds_object(obj) - ds.objects) : -1L, next);
+
+	ds.current = next;
+	pthread_cond_signal(&ds.threads[next].turn);
+
+	if (ds.threads[ds_self].state == DS_DONE)
+		return;
+	while (ds.current != ds_self)
+		pthread_cond_wait(&ds.threads[ds_self].turn, &ds.big);
+}
+
+void ds_init(unsigned int seed, int verbose)
+{
+	memset(&ds.stats, 0, sizeof(ds.stats));
+	ds.stats.hash = 14695981039346656037ULL;
+	ds.rng = seed * 0x9E3779B97F4A7C15ULL + 1;
+	ds.verbose = verbose;
+	ds.n_objects = 0;
+	ds.seq = 0;
+
+	// The calling thread becomes T0 and holds the first turn
+	ds.n_threads = 1;
+	ds.current = 0;
+	ds_self = 0;
+	memset(&ds.threads[0], 0, sizeof(struct ds_thread));
+	ds.threads[0].state = DS_RUNNABLE;
+	pthread_cond_init(&ds.threads[0].turn, NULL);
+}
+
+static void *ds_trampoline(void *arg)
+{
+	struct ds_thread *t = (struct ds_thread *)arg;
+	int i;
+
+	ds_self = t - ds.threads;
+
+	// Don't start before the scheduler says so
+	pthread_mutex_lock(&ds.big);
+	while (ds.current != ds_self)
+		pthread_cond_wait(&t->turn, &ds.big);
+	pthread_mutex_unlock(&ds.big);
+
+	t->fn(t->arg);
+
+	pthread_mutex_lock(&ds.big);
+	t->state = DS_DONE;
+	for (i = 0; i < ds.n_threads; i++)
+	{
+		if (ds.threads[i].state == DS_BLOCKED && ds.threads[i].blocked_on == t)
+			ds_wake(&ds.threads[i]);
+	}
+	ds_schedule("exit", NULL);
+	pthread_mutex_unlock(&ds.big);
+	return NULL;
+}
+
+int ds_spawn(void *(*fn)(void *), void *arg)
+{
+	pthread_mutex_lock(&ds.big);
+	if (ds.n_threads == DS_MAX_THREADS)
+	{
+		fprintf(stderr, "detsched: more than %d threads\n", DS_MAX_THREADS);
+		exit(1);
+	}
+
+	int id = ds.n_threads++;
+	struct ds_thread *t = &ds.threads[id];
+	memset(t, 0, sizeof(struct ds_thread));
+	t->state = DS_RUNNABLE;
+	t->fn = fn;
+	t->arg = arg;
+	pthread_cond_init(&t->turn, NULL);
+
+	if (pthread_create(&t->tid, NULL, ds_trampoline, t) != 0)
+	{
+		perror("pthread_create");
+		exit(1);
+	}
+
+	ds_schedule("spawn", NULL);
+	pthread_mutex_unlock(&ds.big);
+	return id;
+}
+
+void ds_join(int id)
+{
+	struct ds_thread *t = &ds.threads[id];
+
+	pthread_mutex_lock(&ds.big);
+	while (t->state != DS_DONE)
+	{
+		ds.threads[ds_self].state = DS_BLOCKED;
+		ds.threads[ds_self].blocked_on = t;
+		ds_schedule("join", NULL);
+	}
+	pthread_mutex_unlock(&ds.big);
+
+	pthread_join(t->tid, NULL);
+}
+
+struct ds_stats ds_finish(void)
+{
+	int i;
+	for (i = 0; i < ds.n_threads; i++)
+		pthread_cond_destroy(&ds.threads[i].turn);
+	ds.n_threads = 0;
+	return ds.stats;
+}
+
+// Take the mutex for the running thread, blocking (in the schedule) while someone else has it
+static void ds_acquire(pthread_mutex_t *mutex)
+{
+	struct ds_object *obj = ds_object(mutex);
+	while (obj->owner != -1)
+	{
+		ds.threads[ds_self].state = DS_BLOCKED;
+		ds.threads[ds_self].blocked_on = mutex;
+		ds_schedule("lock-wait", mutex);
+	}
+	obj->owner = ds_self;
+}
+
+static void ds_release(pthread_mutex_t *mutex)
+{
+	int i;
+	ds_object(mutex)->owner = -1;
+	for (i = 0; i < ds.n_threads; i++)
+	{
+		if (ds.threads[i].state == DS_BLOCKED && ds.threads[i].blocked_on == mutex)
+			ds_wake(&ds.threads[i]);
+	}
+}
+
+int ds_mutex_lock(pthread_mutex_t *mutex)
+{
+	pthread_mutex_lock(&ds.big);
+	ds_schedule("lock", mutex);
+	ds_acquire(mutex);
+	pthread_mutex_unlock(&ds.big);
+	return 0;
+}
+
+int ds_mutex_unlock(pthread_mutex_t *mutex)
+{
+	pthread_mutex_lock(&ds.big);
+	ds.threads[ds_self].woken_from = NULL;
+	ds_release(mutex);
+	ds_schedule("unlock", mutex);
+	pthread_mutex_unlock(&ds.big);
+	return 0;
+}
+
+static int ds_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, int timed)
+{
+	struct ds_thread *self;
+	int ret;
+
+	pthread_mutex_lock(&ds.big);
+	self = &ds.threads[ds_self];
+
+	// Woken up from this cond only to wait on it again
+	if (self->woken_from == cond)
+		ds.stats.futile++;
+	self->woken_from = NULL;
+
+	ds_release(mutex);
+	self->state = DS_BLOCKED;
+	self->blocked_on = cond;
+	self->timed = timed;
+	self->timed_out = 0;
+	self->wait_seq = ++ds.seq;
+	ds_schedule(timed ? "timedwait" : "wait", cond);
+
+	ret = self->timed_out ? ETIMEDOUT : 0;
+	self->timed = 0;
+	self->timed_out = 0;
+	ds_acquire(mutex);
+	pthread_mutex_unlock(&ds.big);
+	return ret;
+}
+
+int ds_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+	return ds_wait(cond, mutex, 0);
+}
+
+int ds_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime)
+{
+	// Virtual time: the scheduler decides when the deadline passes
+	return ds_wait(cond, mutex, 1);
+}
+
+// Wake the waiters of 'cond', oldest first ('all' = broadcast)
+static int ds_notify(pthread_cond_t *cond, int all)
+{
+	int i;
+
+	pthread_mutex_lock(&ds.big);
+	ds.threads[ds_self].woken_from = NULL;
+	do
+	{
+		struct ds_thread *oldest = NULL;
+		for (i = 0; i < ds.n_threads; i++)
+		{
+			struct ds_thread *t = &ds.threads[i];
+			if (t->state == DS_BLOCKED && t->blocked_on == cond
+			    && (!oldest || t->wait_seq < oldest->wait_seq))
+				oldest = t;
+		}
+		if (!oldest)
+			break;
+		ds_wake(oldest);
+		oldest->woken_from = cond;
+	} while (all);
+
+	ds_schedule(all ? "broadcast" : "signal", cond);
+	pthread_mutex_unlock(&ds.big);
+	return 0;
+}
+
+int ds_cond_signal(pthread_cond_t *cond)
+{
+	return ds_notify(cond, 0);
+}
+
+int ds_cond_broadcast(pthread_cond_t *cond)
+{
+	return ds_notify(cond, 1);
+}
@@ -0,0 +1,55 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+Deterministic scheduler for reproducible runs:
+	- only one managed thread runs at a time
+	- every lock, unlock, wait, signal and broadcast is a yield point where the
+	  scheduler picks the next runnable thread from a seeded PRNG
+	- timed waits use virtual time: the scheduler decides when they time out
+So the same seed always gives the same interleaving, and the hash of the
+schedule lets you check that a replay really was identical.
+*/
+
+#define DS_MAX_THREADS 4096
+#define DS_MAX_OBJECTS 256
+
+struct ds_stats {
+	long steps;     // Scheduling decisions
+	long switches;  // Decisions that ran a different thread
+	long futile;    // Wakeups that went straight back to waiting on the same cond
+	long timeouts;  // Timed waits the scheduler let expire
+	uint64_t hash;  // Hash of the whole schedule
+};
+
+// Start a run from the calling (main) thread, verbose prints every decision
+void ds_init(unsigned int seed, int verbose);
+
+// Create a managed thread, returns its id
+int ds_spawn(void *(*fn)(void *), void *arg);
+
+void ds_join(int id);
+
+// End the run (every spawned thread must be joined) and get the stats
+struct ds_stats ds_finish(void);
+
+int ds_mutex_lock(pthread_mutex_t *mutex);
+int ds_mutex_unlock(pthread_mutex_t *mutex);
+int ds_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
+int ds_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime);
+int ds_cond_signal(pthread_cond_t *cond);
+int ds_cond_broadcast(pthread_cond_t *cond);
+
+/*
+Build the synchronization code with -DDETSCHED and include this header after
+<pthread.h> to route its lock/unlock/wait/signal calls through the scheduler.
+*/
+#ifdef DETSCHED
+#define pthread_mutex_lock ds_mutex_lock
+#define pthread_mutex_unlock ds_mutex_unlock
+#define pthread_cond_wait ds_cond_wait
+#define pthread_cond_timedwait ds_cond_timedwait
+#define pthread_cond_signal ds_cond_signal
+#define pthread_cond_broadcast ds_cond_broadcast
+#endif
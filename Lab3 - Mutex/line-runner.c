@@ -0,0 +1,71 @@
+/*
+ * Runs the multi-stop line simulation built on struct station and prints
+ * throughput and per-stop dwell times.
+ *
+ * Usage:
+ *	./line [stops] [trains] [capacity] [workers] [trips_per_stop] [travel_us]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "line.h"
+
+void
+alarm_handler(int foo)
+{
+	fprintf(stderr, "Error: line simulation did not finish in time, "
+		"passengers are probably stuck waiting or riding.\n");
+	exit(1);
+}
+
+static int
+arg_or(int argc, char *argv[], int i, int def)
+{
+	return (argc > i) ? atoi(argv[i]) : def;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int stops = arg_or(argc, argv, 1, 8);
+	int trains = arg_or(argc, argv, 2, 3);
+	int capacity = arg_or(argc, argv, 3, 50);
+	int workers = arg_or(argc, argv, 4, 64);
+	int trips = arg_or(argc, argv, 5, 200);
+	int travel_us = arg_or(argc, argv, 6, 100);
+
+	struct line line;
+	if (line_init(&line, stops, trains, capacity, travel_us) != 0) {
+		fprintf(stderr, "Error: invalid line (need >= 2 stops, >= 1 train, capacity >= 1)\n");
+		return 1;
+	}
+
+	signal(SIGALRM, alarm_handler);
+	alarm(60);
+
+	if (line_run(&line, workers, trips, getpid() ^ time(NULL)) != 0) {
+		fprintf(stderr, "Error: line_run failed\n");
+		return 1;
+	}
+	alarm(0);
+
+	line_report(&line, stdout);
+
+	// Everyone who boarded must have got off somewhere
+	long boarded = 0, alighted = 0;
+	int i;
+	for (i = 0; i < stops; i++) {
+		boarded += line.stops[i].boardings;
+		alighted += line.stops[i].alightings;
+	}
+	int ok = (line.trips_done == line.trips_total && boarded == alighted
+		&& boarded == line.trips_total);
+	printf(ok ? "Looks good!\n" : "Error: boardings/alightings don't match trips!\n");
+
+	line_destroy(&line);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "line.h"
+
+/*
+A line of stops built on top of struct station:
+	- every train thread visits the stops in order (0 .. n-1) and then starts over
+	- at each stop the riders going there get off first, then the free seats are
+	  offered through station_load_train()
+	- one thread per stop produces trips into a queue shared by a pool of worker
+	  threads, each worker rides one trip at a time (so many stops compete for the
+	  same workers)
+*/
+
+static double elapsed_since(const struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int line_init(struct line *line, int n_stops, int n_trains, int capacity, int travel_us)
+{
+	int i;
+
+	if (n_stops < 2 || n_trains < 1 || capacity < 1)
+		return -1;
+
+	line->n_stops = n_stops;
+	line->n_trains = n_trains;
+	line->travel_us = travel_us;
+	line->running = 0;
+
+	line->stops = calloc(n_stops, sizeof(struct line_stop));
+	line->trains = calloc(n_trains, sizeof(struct line_train));
+	if (!line->stops || !line->trains)
+		return -1;
+
+	for (i = 0; i < n_stops; i++)
+	{
+		station_init(&line->stops[i].station);
+		pthread_mutex_init(&line->stops[i].dock, NULL);
+	}
+
+	for (i = 0; i < n_trains; i++)
+	{
+		struct line_train *train = &line->trains[i];
+		train->id = i;
+		train->capacity = capacity;
+		train->position = -1;
+		train->line = line;
+		train->alighting = calloc(n_stops, sizeof(int));
+		if (!train->alighting)
+			return -1;
+
+		pthread_mutex_init(&train->lock, NULL);
+		pthread_cond_init(&train->moved, NULL);
+		pthread_cond_init(&train->alighted, NULL);
+	}
+
+	line->queue = NULL;
+	line->queue_cap = 0;
+	pthread_mutex_init(&line->pool_lock, NULL);
+	pthread_cond_init(&line->pool_ready, NULL);
+
+	return 0;
+}
+
+void line_destroy(struct line *line)
+{
+	int i;
+
+	for (i = 0; i < line->n_trains; i++)
+	{
+		free(line->trains[i].alighting);
+		pthread_mutex_destroy(&line->trains[i].lock);
+		pthread_cond_destroy(&line->trains[i].moved);
+		pthread_cond_destroy(&line->trains[i].alighted);
+	}
+	for (i = 0; i < line->n_stops; i++)
+		pthread_mutex_destroy(&line->stops[i].dock);
+
+	pthread_mutex_destroy(&line->pool_lock);
+	pthread_cond_destroy(&line->pool_ready);
+
+	free(line->trains);
+	free(line->stops);
+	free(line->queue);
+}
+
+void line_ride(struct line *line, int origin, int dest)
+{
+	struct line_stop *stop = &line->stops[origin];
+
+	// Wait for a seat like any other caltrain passenger
+	station_wait_for_train(&stop->station);
+
+	// The train that offered the seat can't leave until we call station_on_board(),
+	// so 'docked' is stable here
+	struct line_train *train = stop->docked;
+
+	pthread_mutex_lock(&train->lock);
+	train->occupancy++;
+	train->alighting[dest]++;
+	pthread_mutex_unlock(&train->lock);
+
+	station_on_board(&stop->station);
+
+	// Ride until the train stops at our destination
+	pthread_mutex_lock(&train->lock);
+	while (train->position != dest)
+		pthread_cond_wait(&train->moved, &train->lock);
+
+	// Get off and free the seat
+	train->occupancy--;
+	if (--train->alighting[dest] == 0)
+		pthread_cond_signal(&train->alighted);
+	pthread_mutex_unlock(&train->lock);
+}
+
+// Stop the train at 's': let riders off, then load from the platform
+static void train_visit(struct line_train *train, int s)
+{
+	struct line *line = train->line;
+	struct line_stop *stop = &line->stops[s];
+	struct timespec arrived;
+	int got_off, free_seats, boarded;
+
+	clock_gettime(CLOCK_MONOTONIC, &arrived);
+
+	pthread_mutex_lock(&train->lock);
+	train->position = s;
+	got_off = train->alighting[s];
+	pthread_cond_broadcast(&train->moved);
+
+	// Wait until everybody going here is off
+	while (train->alighting[s] > 0)
+		pthread_cond_wait(&train->alighted, &train->lock);
+
+	free_seats = train->capacity - train->occupancy;
+	pthread_mutex_unlock(&train->lock);
+
+	pthread_mutex_lock(&stop->dock);
+	stop->docked = train;
+	station_load_train(&stop->station, free_seats);
+	stop->docked = NULL;
+
+	// Every boarder has called station_on_board() so occupancy is final
+	pthread_mutex_lock(&train->lock);
+	boarded = train->occupancy - (train->capacity - free_seats);
+	train->position = -1;
+	pthread_mutex_unlock(&train->lock);
+
+	double dwell = elapsed_since(&arrived);
+	stop->visits++;
+	stop->boardings += boarded;
+	stop->alightings += got_off;
+	stop->dwell_total += dwell;
+	if (dwell > stop->dwell_max)
+		stop->dwell_max = dwell;
+	pthread_mutex_unlock(&stop->dock);
+}
+
+static void *train_thread(void *arg)
+{
+	struct line_train *train = (struct line_train *)arg;
+	struct line *line = train->line;
+	int s;
+
+	while (line->running)
+	{
+		for (s = 0; s < line->n_stops; s++)
+		{
+			train_visit(train, s);
+			if (line->travel_us > 0)
+				usleep(line->travel_us);
+		}
+	}
+	return NULL;
+}
+
+struct stop_args {
+	struct line *line;
+	int stop;
+	int trips;
+	unsigned int seed;
+};
+
+// Produces the trips starting at one stop into the shared pool queue
+static void *stop_thread(void *arg)
+{
+	struct stop_args *sa = (struct stop_args *)arg;
+	struct line *line = sa->line;
+	int i;
+
+	for (i = 0; i < sa->trips; i++)
+	{
+		struct line_trip trip;
+		trip.origin = sa->stop;
+		trip.dest = sa->stop + 1 + rand_r(&sa->seed) % (line->n_stops - sa->stop - 1);
+		clock_gettime(CLOCK_MONOTONIC, &trip.created);
+
+		pthread_mutex_lock(&line->pool_lock);
+		line->queue[line->queue_tail++] = trip;
+		pthread_cond_signal(&line->pool_ready);
+		pthread_mutex_unlock(&line->pool_lock);
+	}
+
+	pthread_mutex_lock(&line->pool_lock);
+	line->producers_left--;
+	pthread_cond_broadcast(&line->pool_ready);
+	pthread_mutex_unlock(&line->pool_lock);
+	return NULL;
+}
+
+// Pool worker: takes the next trip from any stop and rides it
+static void *worker_thread(void *arg)
+{
+	struct line *line = (struct line *)arg;
+
+	while (1)
+	{
+		struct line_trip trip;
+
+		pthread_mutex_lock(&line->pool_lock);
+		while (line->queue_head == line->queue_tail && line->producers_left > 0)
+			pthread_cond_wait(&line->pool_ready, &line->pool_lock);
+
+		if (line->queue_head == line->queue_tail)
+		{
+			// Nothing left to produce or ride
+			pthread_mutex_unlock(&line->pool_lock);
+			return NULL;
+		}
+		trip = line->queue[line->queue_head++];
+		line->queue_wait_total += elapsed_since(&trip.created);
+		pthread_mutex_unlock(&line->pool_lock);
+
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		line_ride(line, trip.origin, trip.dest);
+		double ride = elapsed_since(&start);
+
+		pthread_mutex_lock(&line->pool_lock);
+		line->ride_total += ride;
+		if (++line->trips_done == line->trips_total)
+			line->running = 0; // Last trip is done, trains can stop
+		pthread_mutex_unlock(&line->pool_lock);
+	}
+}
+
+int line_run(struct line *line, int workers, int trips_per_stop, unsigned int seed)
+{
+	// The last stop has nowhere to go, so it produces no trips
+	int producers = line->n_stops - 1;
+	pthread_t *tids = malloc((producers + workers + line->n_trains) * sizeof(pthread_t));
+	struct stop_args *sargs = malloc(producers * sizeof(struct stop_args));
+	struct timespec start;
+	int i, n = 0, ret = 0;
+
+	if (!tids || !sargs || workers < 1)
+	{
+		free(tids);
+		free(sargs);
+		return -1;
+	}
+
+	free(line->queue);
+	line->trips_total = (long)producers * trips_per_stop;
+	line->queue_cap = line->trips_total;
+	line->queue = malloc((line->queue_cap > 0 ? line->queue_cap : 1) * sizeof(struct line_trip));
+	line->queue_head = line->queue_tail = 0;
+	line->producers_left = producers;
+	line->trips_done = 0;
+	line->queue_wait_total = 0;
+	line->ride_total = 0;
+	line->running = (line->trips_total > 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < line->n_trains && !ret; i++)
+		ret = pthread_create(&tids[n++], NULL, train_thread, &line->trains[i]);
+	for (i = 0; i < workers && !ret; i++)
+		ret = pthread_create(&tids[n++], NULL, worker_thread, line);
+	for (i = 0; i < producers && !ret; i++)
+	{
+		sargs[i].line = line;
+		sargs[i].stop = i;
+		sargs[i].trips = trips_per_stop;
+		sargs[i].seed = seed + i;
+		ret = pthread_create(&tids[n++], NULL, stop_thread, &sargs[i]);
+	}
+
+	if (ret != 0)
+	{
+		// If this fails, perhaps we exceeded some system limit.
+		perror("pthread_create");
+		exit(1);
+	}
+
+	for (i = 0; i < n; i++)
+		pthread_join(tids[i], NULL);
+
+	line->elapsed = elapsed_since(&start);
+
+	free(tids);
+	free(sargs);
+	return 0;
+}
+
+void line_report(struct line *line, FILE *out)
+{
+	int i;
+
+	fprintf(out, "Line: %d stops, %d trains, %ld trips in %.3f s (%.0f trips/s)\n",
+		line->n_stops, line->n_trains, line->trips_done, line->elapsed,
+		line->elapsed > 0 ? line->trips_done / line->elapsed : 0);
+	if (line->trips_done > 0)
+		fprintf(out, "Avg queue wait: %.3f ms, avg ride: %.3f ms\n",
+			line->queue_wait_total * 1e3 / line->trips_done,
+			line->ride_total * 1e3 / line->trips_done);
+
+	fprintf(out, "%5s %8s %10s %10s %14s %14s\n",
+		"stop", "visits", "boardings", "alightings", "avg dwell(us)", "max dwell(us)");
+	for (i = 0; i < line->n_stops; i++)
+	{
+		struct line_stop *stop = &line->stops[i];
+		fprintf(out, "%5d %8ld %10ld %10ld %14.1f %14.1f\n",
+			i, stop->visits, stop->boardings, stop->alightings,
+			stop->visits ? stop->dwell_total * 1e6 / stop->visits : 0,
+			stop->dwell_max * 1e6);
+	}
+}
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include "caltrain.h"
+
+struct line_train;
+
+// A trip a passenger wants to make (origin < dest)
+struct line_trip {
+	int origin;
+	int dest;
+	struct timespec created; // When the stop produced the trip
+};
+
+struct line_stop {
+	struct station station;     // Boarding rendezvous for this stop
+	pthread_mutex_t dock;       // Only one train loads at a stop at a time
+	struct line_train *docked;  // Train currently loading (set while holding dock)
+
+	// Metrics (protected by dock)
+	long visits;       // Number of trains that stopped here
+	long boardings;    // Passengers who got on here
+	long alightings;   // Passengers who got off here
+	double dwell_total; // Seconds trains spent stopped here
+	double dwell_max;
+};
+
+struct line_train {
+	int id;
+	int capacity;     // Total seats
+	int occupancy;    // Seats taken
+	int position;     // Stop the train is stopped at (-1 while travelling)
+	int *alighting;   // Riders on board per destination stop
+
+	pthread_mutex_t lock;    // Protects the fields above
+	pthread_cond_t moved;    // Broadcast when the train reaches a new stop
+	pthread_cond_t alighted; // Signalled when the last rider for a stop gets off
+
+	struct line *line;
+};
+
+struct line {
+	int n_stops;
+	struct line_stop *stops;
+	int n_trains;
+	struct line_train *trains;
+	int travel_us;        // Travel time between two stops
+	volatile int running; // Trains keep looping while set
+
+	// Worker pool shared by every stop: stops produce trips, workers ride them
+	struct line_trip *queue;
+	int queue_cap;
+	int queue_head;
+	int queue_tail;
+	int producers_left;   // Stop threads still producing trips
+	long trips_total;     // Trips that will be produced in this run
+	long trips_done;      // Trips that reached their destination
+	double queue_wait_total; // Seconds trips sat in the queue before a worker took them
+	double ride_total;       // Seconds from boarding request to alighting
+	pthread_mutex_t pool_lock;
+	pthread_cond_t pool_ready;
+
+	double elapsed; // Wall time of the last line_run
+};
+
+int line_init(struct line *line, int n_stops, int n_trains, int capacity, int travel_us);
+
+void line_destroy(struct line *line);
+
+// Wait at 'origin', ride a train and get off at 'dest' (blocking)
+void line_ride(struct line *line, int origin, int dest);
+
+// Run the whole line: one thread per stop producing 'trips_per_stop' trips,
+// 'workers' pool threads riding them and one thread per train
+int line_run(struct line *line, int workers, int trips_per_stop, unsigned int seed);
+
+void line_report(struct line *line, FILE *out);
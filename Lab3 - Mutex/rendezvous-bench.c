@@ -0,0 +1,106 @@
+/*
+ * Microbenchmark for the batch rendezvous: one producer offering batches of
+ * 1 .. 1024 slots to as many consumer threads, with and without spinning.
+ *
+ * Usage:
+ *	./rendezvous-bench [items_per_run] [spin]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "rendezvous.h"
+
+// Consumer: claim and confirm slots until cancelled
+void*
+consumer_thread(void *arg)
+{
+	struct rendezvous *rdv = (struct rendezvous*)arg;
+	while (rdv_claim(rdv) == 0)
+		rdv_confirm(rdv);
+	return NULL;
+}
+
+static double
+now_sec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Runs one batch size, returns slots handed over per second
+static double
+run(int batch, int spin, long items, double *batch_us, double *fill)
+{
+	struct rendezvous rdv;
+	pthread_t *tids = malloc(batch * sizeof(pthread_t));
+	pthread_attr_t attr;
+	long handed = 0, batches = 0;
+	int i;
+
+	rdv_init(&rdv, spin);
+
+	// Consumers do nothing but claim, small stacks are plenty
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, 64 * 1024);
+	for (i = 0; i < batch; i++) {
+		if (pthread_create(&tids[i], &attr, consumer_thread, &rdv) != 0) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	pthread_attr_destroy(&attr);
+
+	// Let every consumer get to the platform before timing
+	while (__atomic_load_n(&rdv.waiting, __ATOMIC_RELAXED) < batch)
+		sched_yield();
+
+	double start = now_sec();
+	while (handed < items) {
+		int claimed = rdv_offer(&rdv, batch);
+		// Offers made before any consumer came back hand over nothing
+		if (claimed > 0) {
+			handed += claimed;
+			batches++;
+		}
+	}
+	double elapsed = now_sec() - start;
+
+	// Send everybody home
+	int left = batch;
+	while (left > 0)
+		left -= rdv_cancel(&rdv, left);
+	for (i = 0; i < batch; i++)
+		pthread_join(tids[i], NULL);
+
+	rdv_destroy(&rdv);
+	free(tids);
+
+	*batch_us = elapsed * 1e6 / batches;
+	*fill = (double)handed / batches;
+	return handed / elapsed;
+}
+
+int
+main(int argc, char *argv[])
+{
+	long items = (argc > 1) ? atol(argv[1]) : 50000;
+	int spin = (argc > 2) ? atoi(argv[2]) : 200;
+	int batch;
+
+	printf("%6s %6s %14s %12s %12s %8s\n", "batch", "spin", "slots/s", "ns/slot", "us/batch", "fill");
+	for (batch = 1; batch <= 1024; batch *= 2) {
+		int s;
+		for (s = 0; s <= spin; s += (spin > 0 ? spin : 1)) {
+			double batch_us, fill;
+			double rate = run(batch, s, items, &batch_us, &fill);
+			printf("%6d %6d %14.0f %12.1f %12.1f %8.1f\n",
+				batch, s, rate, 1e9 / rate, batch_us, fill);
+		}
+	}
+	return 0;
+}
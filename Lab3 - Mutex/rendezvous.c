@@ -0,0 +1,229 @@
+#include <pthread.h>
+#include <errno.h>
+#include "rendezvous.h"
+
+#ifdef DETSCHED
+// Deterministic build: every lock/unlock/wait/signal below yields to detsched
+#include "detsched.h"
+#endif
+
+/*
+Wakeups are kept to the minimum:
+	- the producer signals slot_offered once per slot instead of broadcasting,
+	  so a batch of 4 doesn't wake 1000 waiting consumers
+	- only the last claimer to confirm signals the producer
+	- with spin > 0 both sides poll the counter they wait on for a while before
+	  sleeping, which skips the futex round trip when the other side is running
+*/
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#else
+#define cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+
+static inline int load_relaxed(int *counter)
+{
+	return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+void rdv_init(struct rendezvous *rdv, int spin)
+{
+	// Init counters
+	rdv->waiting = 0;
+	rdv->offered = 0;
+	rdv->expected = 0;
+	rdv->confirmed = 0;
+	rdv->cancel_pending = 0;
+	rdv->spin = spin;
+
+	// Init mutex and conds (timed waits use the monotonic clock)
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+	pthread_mutex_init(&rdv->lock, NULL);
+	pthread_cond_init(&rdv->slot_offered, &attr);
+	pthread_cond_init(&rdv->batch_done, &attr);
+
+	pthread_condattr_destroy(&attr);
+}
+
+void rdv_destroy(struct rendezvous *rdv)
+{
+	pthread_mutex_destroy(&rdv->lock);
+	pthread_cond_destroy(&rdv->slot_offered);
+	pthread_cond_destroy(&rdv->batch_done);
+}
+
+// Spin (without the lock) until *counter differs from 'value' or we run out of spins
+static void spin_while_equal(struct rendezvous *rdv, int *counter, int value)
+{
+	int i;
+	for (i = 0; i < rdv->spin && load_relaxed(counter) == value; i++)
+		cpu_relax();
+}
+
+int rdv_offer_timed(struct rendezvous *rdv, int count, const struct timespec *deadline)
+{
+	int i, claimed;
+
+	pthread_mutex_lock(&rdv->lock);
+
+	// Only offer as many slots as there are consumers to claim them
+	rdv->expected = (rdv->waiting < count) ? rdv->waiting : count;
+	rdv->offered = rdv->expected;
+	rdv->confirmed = 0;
+
+	// Wake one waiting consumer per slot
+	for (i = 0; i < rdv->expected; i++)
+		pthread_cond_signal(&rdv->slot_offered);
+
+	while (rdv->confirmed < rdv->expected)
+	{
+		if (rdv->spin > 0)
+		{
+			int seen = rdv->confirmed;
+			pthread_mutex_unlock(&rdv->lock);
+			spin_while_equal(rdv, &rdv->confirmed, seen);
+			pthread_mutex_lock(&rdv->lock);
+			if (rdv->confirmed >= rdv->expected)
+				break;
+		}
+
+		if (deadline && rdv->offered > 0)
+		{
+			if (pthread_cond_timedwait(&rdv->batch_done, &rdv->lock, deadline) == ETIMEDOUT)
+			{
+				// Withdraw what nobody claimed, but still wait for those who did
+				rdv->expected -= rdv->offered;
+				rdv->offered = 0;
+			}
+		}
+		else
+			pthread_cond_wait(&rdv->batch_done, &rdv->lock);
+	}
+
+	// Reset for the next batch
+	claimed = rdv->expected;
+	rdv->expected = 0;
+	rdv->confirmed = 0;
+	rdv->offered = 0;
+
+	pthread_mutex_unlock(&rdv->lock);
+	return claimed;
+}
+
+int rdv_offer(struct rendezvous *rdv, int count)
+{
+	return rdv_offer_timed(rdv, count, NULL);
+}
+
+int rdv_claim_timed(struct rendezvous *rdv, const struct timespec *deadline)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&rdv->lock);
+	rdv->waiting++;
+
+	while (rdv->offered == 0)
+	{
+		/*
+		Leaving is only safe while no slot is on offer: once the producer has counted
+		this consumer in 'expected' it waits for him, so he takes the slot instead.
+		*/
+		if (rdv->cancel_pending > 0)
+		{
+			rdv->cancel_pending--;
+			ret = ECANCELED;
+			break;
+		}
+		if (ret == ETIMEDOUT)
+			break;
+
+		if (rdv->spin > 0)
+		{
+			pthread_mutex_unlock(&rdv->lock);
+			spin_while_equal(rdv, &rdv->offered, 0);
+			pthread_mutex_lock(&rdv->lock);
+
+			// A slot or a cancellation may have shown up (and its wakeup gone by) while spinning
+			if (rdv->offered > 0 || rdv->cancel_pending > 0)
+				continue;
+		}
+
+		if (deadline)
+			ret = pthread_cond_timedwait(&rdv->slot_offered, &rdv->lock, deadline);
+		else
+			pthread_cond_wait(&rdv->slot_offered, &rdv->lock);
+	}
+
+	if (rdv->offered > 0)
+	{
+		// Take the slot (even if the deadline passed meanwhile)
+		rdv->offered--;
+		ret = 0;
+	}
+	rdv->waiting--;
+
+	// Never keep more cancellations around than there are consumers to cancel
+	if (rdv->cancel_pending > rdv->waiting)
+		rdv->cancel_pending = rdv->waiting;
+
+	pthread_mutex_unlock(&rdv->lock);
+	return ret;
+}
+
+int rdv_claim(struct rendezvous *rdv)
+{
+	return rdv_claim_timed(rdv, NULL);
+}
+
+int rdv_try_claim(struct rendezvous *rdv)
+{
+	int ret = EAGAIN;
+
+	// Cheap check first so an idle rendezvous doesn't cost a lock
+	if (load_relaxed(&rdv->offered) == 0)
+		return EAGAIN;
+
+	pthread_mutex_lock(&rdv->lock);
+	if (rdv->offered > 0)
+	{
+		rdv->offered--;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&rdv->lock);
+	return ret;
+}
+
+int rdv_cancel(struct rendezvous *rdv, int count)
+{
+	pthread_mutex_lock(&rdv->lock);
+
+	// Consumers that the producer is waiting for can't be cancelled
+	int cancellable = rdv->waiting - rdv->offered;
+	if (rdv->cancel_pending + count > cancellable)
+		count = cancellable - rdv->cancel_pending;
+	if (count < 0)
+		count = 0;
+	rdv->cancel_pending += count;
+
+	// Cancellation is rare, wake everybody so the ones asked to leave can do so
+	if (count > 0)
+		pthread_cond_broadcast(&rdv->slot_offered);
+
+	pthread_mutex_unlock(&rdv->lock);
+	return count;
+}
+
+void rdv_confirm(struct rendezvous *rdv)
+{
+	pthread_mutex_lock(&rdv->lock);
+
+	// The last one to confirm lets the producer go
+	if (++rdv->confirmed == rdv->expected)
+		pthread_cond_signal(&rdv->batch_done);
+
+	pthread_mutex_unlock(&rdv->lock);
+}
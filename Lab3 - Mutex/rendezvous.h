@@ -0,0 +1,50 @@
+#include <pthread.h>
+#include <time.h>
+
+/*
+Batch rendezvous: a producer offers N slots, up to N waiting consumers claim one each,
+and the producer returns once every claimer has confirmed.
+(station_load_train / station_wait_for_train / station_on_board are this pattern)
+
+Nothing is allocated, the struct can live anywhere (stack, array, inside another struct).
+Deadlines are absolute CLOCK_MONOTONIC times.
+*/
+
+struct rendezvous {
+	int waiting;        // Consumers blocked waiting for a slot
+	int offered;        // Slots of the current batch nobody claimed yet
+	int expected;       // Claimers the producer waits for
+	int confirmed;      // Claimers that confirmed so far
+	int cancel_pending; // Waiting consumers asked to leave
+	int spin;           // Iterations to spin before sleeping (0 = always sleep)
+
+	pthread_mutex_t lock;         // Protects the counters above
+	pthread_cond_t slot_offered;  // Signalled once per slot offered
+	pthread_cond_t batch_done;    // Signalled by the last claimer to confirm
+};
+
+void rdv_init(struct rendezvous *rdv, int spin);
+
+void rdv_destroy(struct rendezvous *rdv);
+
+// Producer: offer 'count' slots and wait until every claimer confirmed, returns slots claimed
+int rdv_offer(struct rendezvous *rdv, int count);
+
+// Like rdv_offer() but slots still unclaimed at 'deadline' are withdrawn
+// (claimers that already took a slot are still waited for)
+int rdv_offer_timed(struct rendezvous *rdv, int count, const struct timespec *deadline);
+
+// Consumer: wait for a slot, returns 0 (or ECANCELED after rdv_cancel())
+int rdv_claim(struct rendezvous *rdv);
+
+// Take a slot only if one is on offer right now, EAGAIN otherwise
+int rdv_try_claim(struct rendezvous *rdv);
+
+// Wait for a slot until 'deadline', 0 on success, ETIMEDOUT or ECANCELED if no slot was taken
+int rdv_claim_timed(struct rendezvous *rdv, const struct timespec *deadline);
+
+// Ask up to 'count' waiting consumers to leave, returns how many will
+int rdv_cancel(struct rendezvous *rdv, int count);
+
+// Consumer: done with the claimed slot
+void rdv_confirm(struct rendezvous *rdv);